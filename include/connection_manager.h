@@ -0,0 +1,104 @@
+#pragma once
+
+#include <QObject>
+#include <QTimer>
+#include <QHash>
+#include <QList>
+#include <QSet>
+#include <QUrl>
+
+class Tcp_socket;
+
+// per-torrent queue of peer candidates. dials them within the per-torrent and process-wide connection limits, times out
+// stalled connects and makes room for new candidates by dropping peers that have been useless for a while
+class Connection_manager : public QObject {
+	Q_OBJECT
+public:
+	enum class Priority {
+		Normal,
+		High
+	};
+
+	explicit Connection_manager(QObject * parent = nullptr);
+	~Connection_manager() override;
+
+	static std::int32_t global_connection_count() noexcept {
+		return global_connection_cnt_;
+	}
+
+	std::int32_t connection_count() const noexcept {
+		return static_cast<std::int32_t>(established_sockets_.size());
+	}
+
+	std::int32_t half_open_count() const noexcept {
+		return static_cast<std::int32_t>(half_open_sockets_.size());
+	}
+
+	// connected, still waiting for the peer's handshake
+	std::int32_t handshaking_count() const noexcept {
+		return static_cast<std::int32_t>(handshaking_sockets_.size());
+	}
+
+	qsizetype candidate_count() const noexcept {
+		return candidates_.size();
+	}
+
+	std::int32_t max_connection_count() const noexcept {
+		return max_torrent_connection_cnt_;
+	}
+
+	bool is_paused() const noexcept {
+		return paused_;
+	}
+
+	const QSet<Tcp_socket *> & established_sockets() const noexcept {
+		return established_sockets_;
+	}
+
+	// uTP when the peer advertised it (or network/prefer_utp is set) and has not already failed over it
+	bool prefers_utp(const QUrl & peer_url) const noexcept {
+		return !tcp_only_peers_.contains(peer_url) && (prefer_utp_ || utp_peers_.contains(peer_url));
+	}
+
+	void mark_utp_capable(const QUrl & peer_url) noexcept {
+		utp_peers_.insert(peer_url);
+	}
+
+	static QUrl normalized_peer_url(const QUrl & peer_url) noexcept;
+	bool can_accept() const noexcept;
+	void add_candidates(const QList<QUrl> & peer_urls, Priority priority = Priority::Normal) noexcept;
+	void on_dial_started(Tcp_socket * socket) noexcept;
+	void on_peer_accepted(Tcp_socket * socket) noexcept;
+	void on_peer_established(Tcp_socket * socket) noexcept;
+	void release(Tcp_socket * socket) noexcept;
+	void set_paused(bool paused) noexcept;
+signals:
+	void dial_requested(const QUrl & peer_url) const;
+
+private:
+	void dial_candidates() noexcept;
+	void replace_poor_peer() noexcept;
+	void forget_socket(Tcp_socket * socket, const QUrl & peer_url) noexcept;
+	///
+	constexpr static qsizetype max_candidate_cnt = 1000;
+	inline static std::int32_t global_connection_cnt_ = 0;
+	inline static std::int32_t global_half_open_cnt_ = 0;
+	inline static std::int32_t global_handshaking_cnt_ = 0;
+	QList<QUrl> candidates_;
+	QSet<QUrl> known_peers_; // queued, dialing or connected
+	QSet<QUrl> utp_peers_;
+	QSet<QUrl> tcp_only_peers_;
+	QSet<Tcp_socket *> half_open_sockets_;
+	QSet<Tcp_socket *> handshaking_sockets_;
+	QSet<Tcp_socket *> established_sockets_;
+	QHash<Tcp_socket *, std::int64_t> last_dled_byte_cnts_;
+	QTimer dial_timer_;
+	QTimer replacement_timer_;
+	std::int32_t max_connection_cnt_ = 0;
+	std::int32_t max_torrent_connection_cnt_ = 0;
+	std::int32_t max_half_open_cnt_ = 0;
+	std::chrono::seconds connect_timeout_{};
+	bool prefer_utp_ = false;
+	bool ipv6_enabled_ = true;
+	bool paused_ = false;
+};
\ No newline at end of file
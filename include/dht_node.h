@@ -0,0 +1,155 @@
+#pragma once
+
+#include <bencode_parser.h>
+#include <QElapsedTimer>
+#include <QHostAddress>
+#include <QUdpSocket>
+#include <QPointer>
+#include <QObject>
+#include <QTimer>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QSet>
+#include <QUrl>
+#include <array>
+
+// mainline DHT (BEP 5) node over IPv4. keeps a kademlia routing table of other nodes, answers their queries and runs
+// iterative get_peers lookups for the registered torrents, announcing our listen port to the closest nodes at the end
+class Dht_node : public QObject {
+	Q_OBJECT
+public:
+	enum class Query_Type {
+		Ping,
+		Find_Node,
+		Get_Peers,
+		Announce_Peer
+	};
+
+	Q_ENUM(Query_Type);
+
+	explicit Dht_node(QObject * parent = nullptr);
+	~Dht_node() override;
+
+	// null when the DHT is disabled or its port could not be bound
+	static Dht_node * instance() noexcept {
+		return instance_;
+	}
+
+	static std::uint16_t dht_port() noexcept;
+	static bool is_enabled() noexcept;
+	qsizetype node_count() const noexcept;
+
+	// differs from dht_port() when that is 0 and the system picked one
+	std::uint16_t local_port() const noexcept {
+		return udp_socket_.localPort();
+	}
+
+	// hex info hashes, looked up and announced every 15 minutes until removed
+	void add_torrent(const QByteArray & info_sha1_hash) noexcept;
+	void remove_torrent(const QByteArray & info_sha1_hash) noexcept;
+	// learned from a peer's port message; enters the routing table once it answers a ping
+	void add_node(const QHostAddress & address, std::uint16_t port) noexcept;
+signals:
+	void peers_found(const QByteArray & info_sha1_hash, const QList<QUrl> & peer_urls) const;
+
+private:
+	struct Node {
+		QByteArray id;
+		QHostAddress address;
+		QElapsedTimer last_seen_timer; // invalid until the node answers us (e.g. restored from the cache)
+		std::uint16_t port = 0;
+		std::int32_t failed_query_cnt = 0;
+	};
+
+	struct Lookup_node {
+		QByteArray id;
+		QHostAddress address;
+		QByteArray token;
+		std::uint16_t port = 0;
+		bool queried = false;
+		bool responded = false;
+	};
+
+	struct Lookup {
+		QByteArray target;
+		QMap<QByteArray, Lookup_node> closest_nodes; // {distance to target,node}
+		std::int32_t in_flight_cnt = 0;
+		bool get_peers = false;
+		bool announce = false;
+	};
+
+	struct Pending_query {
+		Query_Type type = Query_Type::Ping;
+		QByteArray node_id; // empty for bootstrap nodes and pings to unknown nodes
+		QByteArray target;  // of the lookup the query belongs to, if any
+		QHostAddress address;
+		QElapsedTimer sent_timer;
+		std::uint16_t port = 0;
+	};
+
+	static QByteArray distance(const QByteArray & lhs, const QByteArray & rhs) noexcept;
+	static QByteArray compact_endpoint(const QHostAddress & address, std::uint16_t port) noexcept;
+	static QByteArray bencoded_string(const QByteArray & str) noexcept;
+	static std::optional<QByteArray> extract_string(const bencode::dictionary & dict, const std::string & key) noexcept;
+	static std::optional<std::int64_t> extract_integer(const bencode::dictionary & dict, const std::string & key) noexcept;
+	static std::optional<bencode::dictionary> extract_dictionary(const bencode::dictionary & dict, const std::string & key) noexcept;
+
+	qsizetype bucket_index(const QByteArray & node_id) const noexcept;
+	QList<Node> closest_nodes(const QByteArray & target, qsizetype node_cnt) const noexcept;
+	QByteArray compact_nodes(const QByteArray & target) const noexcept;
+	QByteArray token(const QHostAddress & address, const QByteArray & secret) const noexcept;
+
+	void on_ready_read() noexcept;
+	void on_query_received(const bencode::dictionary & message, const QHostAddress & address, std::uint16_t port) noexcept;
+	void on_response_received(const bencode::dictionary & message, const QHostAddress & address, std::uint16_t port) noexcept;
+	void on_query_failed(const QByteArray & txn_id) noexcept;
+	void on_node_seen(const QByteArray & node_id, const QHostAddress & address, std::uint16_t port) noexcept;
+
+	void send_query(Query_Type type, const QByteArray & arguments, const QHostAddress & address, std::uint16_t port, const QByteArray & node_id = {},
+			    const QByteArray & target = {}) noexcept;
+	void send_response(const QByteArray & txn_id, const QByteArray & response, const QHostAddress & address, std::uint16_t port) noexcept;
+	void send_error(const QByteArray & txn_id, std::int32_t error_code, const QByteArray & error_msg, const QHostAddress & address, std::uint16_t port) noexcept;
+
+	void bootstrap() noexcept;
+	void start_lookup(const QByteArray & target, bool get_peers, bool announce) noexcept;
+	void continue_lookup(const QByteArray & target) noexcept;
+	void finish_lookup(const Lookup & lookup) noexcept;
+	void announce_torrents() noexcept;
+	void maintain() noexcept;
+
+	void read_node_cache() noexcept;
+	void write_node_cache() const noexcept;
+	///
+	constexpr static std::uint16_t default_dht_port = 6890;
+	constexpr static qsizetype node_id_size = 20;
+	constexpr static qsizetype compact_endpoint_size = 6;
+	constexpr static qsizetype bucket_cnt = node_id_size * 8;
+	constexpr static qsizetype bucket_size = 8;		// k
+	constexpr static std::int32_t lookup_parallelism = 3;	// alpha
+	constexpr static qsizetype max_lookup_node_cnt = 4 * bucket_size;
+	constexpr static std::int32_t max_failed_query_cnt = 3;
+	constexpr static qsizetype max_stored_torrent_cnt = 1000;
+	constexpr static qsizetype max_stored_peer_cnt = 100; // per torrent
+	constexpr static qsizetype max_peer_value_cnt = 50;   // per get_peers reply, keeps it within one datagram
+	constexpr static qsizetype max_cached_node_cnt = 200;
+	constexpr static std::chrono::seconds query_timeout{5};
+	constexpr static std::chrono::minutes node_refresh_interval{15};
+	constexpr static std::chrono::minutes stored_peer_ttl{30};
+	inline static QPointer<Dht_node> instance_;
+	std::array<QList<Node>, bucket_cnt> buckets_;
+	QHash<QByteArray, Pending_query> pending_queries_; // {txn_id,query}
+	QHash<QByteArray, Lookup> lookups_;		    // {target,lookup}
+	QHash<QByteArray, QHash<QByteArray, std::chrono::steady_clock::time_point>> stored_peers_; // {info_hash,{compact endpoint,announce time}}
+	QSet<QByteArray> torrents_; // raw info hashes
+	QUdpSocket udp_socket_;
+	QTimer timeout_timer_;
+	QTimer maintenance_timer_;
+	QTimer announce_timer_;
+	QTimer secret_timer_;
+	QByteArray id_;
+	QByteArray secret_;
+	QByteArray previous_secret_;
+	std::uint16_t txn_cnt_ = 0;
+	bool bootstrapped_ = false;
+};
\ No newline at end of file
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <QByteArray>
+#include <QPointer>
+#include <QFile>
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <functional>
+#include <optional>
+#include <deque>
+
+#ifdef TORAPP_IO_URING
+#include <liburing.h>
+#endif
+
+class QSocketNotifier;
+
+// asynchronous positional file io used for torrent storage. submits through io_uring when built with liburing and supported by
+// the running kernel and reaps the completions from the event loop, otherwise (or whenever a submission fails) falls back to plain
+// QFile seek + read/write. either way the caller hears back from the event loop, never from within read() or write()
+class Disk_io {
+public:
+	struct Request {
+		QPointer<QFile> file_handle; // owned by the torrent, which may be deleted with jobs queued or in flight
+		std::int64_t file_offset = 0;
+		char * data = nullptr;
+		std::int64_t byte_cnt = 0;
+	};
+
+	// receives the buffer of the requests back, nullopt when the io failed
+	using Completion = std::function<void(std::optional<QByteArray>)>;
+
+	static Disk_io & instance() noexcept;
+
+	Disk_io(const Disk_io &) = delete;
+	Disk_io & operator=(const Disk_io &) = delete;
+	~Disk_io();
+
+	bool uses_io_uring() const noexcept {
+		return ring_ready_;
+	}
+
+	// the requests point into the buffer, which is kept alive until they complete. on_completed is dropped along with the context
+	void read(QList<Request> requests, QByteArray buffer, QObject * context, Completion on_completed) noexcept;
+	void write(QList<Request> requests, QByteArray buffer, QObject * context, Completion on_completed) noexcept;
+
+private:
+	enum class Operation {
+		Read,
+		Write
+	};
+
+	struct Job {
+		QList<Request> requests;
+		QByteArray buffer;
+		QPointer<QObject> context;
+		Completion on_completed;
+		Operation operation = Operation::Read;
+		QList<int> fds; // duplicated per request so that neither the file pool nor a removed torrent closes them mid-flight
+		qsizetype pending_cnt = 0;
+		bool failed = false;
+	};
+
+	Disk_io();
+
+	static bool is_abandoned(const Job & job) noexcept;
+	static bool submit_fallback(const QList<Request> & requests, Operation operation) noexcept;
+	static void complete(Job job, bool succeeded) noexcept;
+	void submit(Job job) noexcept;
+#ifdef TORAPP_IO_URING
+	bool init_ring() noexcept;
+	void submit_uring(Job job) noexcept;
+	void submit_queued_jobs() noexcept;
+	void on_completion_queued(const io_uring_cqe * cqe) noexcept;
+	void finish_job(Job job) noexcept;
+	void reap_completions() noexcept;
+	void drain_ring() noexcept;
+	void reset_ring() noexcept;
+#endif
+	///
+	bool ring_ready_ = false;
+#ifdef TORAPP_IO_URING
+	constexpr static std::uint32_t queue_depth = 64;
+	io_uring ring_{};
+	int event_fd_ = -1;
+	QPointer<QSocketNotifier> completion_notifier_;
+	QHash<std::uint32_t, Job> in_flight_jobs_;
+	std::deque<Job> queued_jobs_; // wait for room in the ring, in submission order
+	std::uint32_t next_job_id_ = 0;
+	qsizetype in_flight_sqe_cnt_ = 0;
+	qsizetype in_flight_write_cnt_ = 0;
+#endif
+};
\ No newline at end of file
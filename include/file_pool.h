@@ -0,0 +1,38 @@
+#pragma once
+
+#include <QHash>
+#include <list>
+
+class QFile;
+class QObject;
+
+// process-wide LRU of open torrent file handles. files are opened (and their directories created) on first access
+class File_pool {
+public:
+	static File_pool & instance() noexcept;
+
+	File_pool(const File_pool &) = delete;
+	File_pool & operator=(const File_pool &) = delete;
+
+	qsizetype open_file_count() const noexcept {
+		return static_cast<qsizetype>(lru_file_handles_.size());
+	}
+
+	qsizetype max_open_file_count() const noexcept {
+		return max_open_file_cnt_;
+	}
+
+	void set_max_open_file_count(qsizetype max_open_file_cnt) noexcept;
+	bool acquire(QFile * file_handle, bool create_if_missing = true) noexcept;
+	void release(QFile * file_handle) noexcept;
+
+private:
+	File_pool();
+
+	void evict_least_recently_used() noexcept;
+	///
+	constexpr static qsizetype default_max_open_file_cnt = 512;
+	std::list<QFile *> lru_file_handles_; // front is the most recently used
+	QHash<const QObject *, std::list<QFile *>::iterator> pooled_file_handles_;
+	qsizetype max_open_file_cnt_ = default_max_open_file_cnt;
+};
\ No newline at end of file
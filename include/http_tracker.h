@@ -0,0 +1,33 @@
+#pragma once
+
+#include "tracker.h"
+
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QPointer>
+#include <QUrl>
+
+// announces and scrapes over http(s) (BEP 3, BEP 23 compact peers, BEP 7 peers6)
+class Http_tracker : public Tracker {
+	Q_OBJECT
+public:
+	Http_tracker(QUrl announce_url, QNetworkAccessManager * network_manager, QObject * parent = nullptr);
+
+	void announce(const Announce_parameters & parameters) noexcept override;
+	void scrape(const QByteArray & info_sha1_hash) noexcept override;
+	void stop() noexcept override;
+
+private:
+	static QUrl scrape_url(const QUrl & announce_url) noexcept;
+	static QUrl append_query(const QUrl & url, const QByteArray & query) noexcept;
+	QByteArray craft_announce_query(const Announce_parameters & parameters) const noexcept;
+	void on_announce_finished(QNetworkReply * network_reply) noexcept;
+	void on_scrape_finished(QNetworkReply * network_reply, const QByteArray & info_hash) noexcept;
+	///
+	constexpr static std::chrono::seconds transfer_timeout{30};
+	QPointer<QNetworkAccessManager> network_manager_;
+	QPointer<QNetworkReply> announce_reply_; // in flight
+	QByteArray tracker_id_;
+	std::int32_t scraped_completed_cnt_ = 0; // announce replies carry no completed count
+	bool stopping_ = false;
+};
\ No newline at end of file
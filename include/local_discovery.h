@@ -0,0 +1,51 @@
+#pragma once
+
+#include <QElapsedTimer>
+#include <QHostAddress>
+#include <QUdpSocket>
+#include <QPointer>
+#include <QObject>
+#include <QTimer>
+#include <QHash>
+#include <QList>
+#include <QUrl>
+
+// local service discovery (BEP 14). announces the registered torrents to the LAN multicast groups every 5 minutes and reports the
+// peers that announce the same torrents, which lets the machines of one network find each other without a tracker
+class Local_discovery : public QObject {
+	Q_OBJECT
+public:
+	explicit Local_discovery(QObject * parent = nullptr);
+
+	// null when LSD is disabled or the multicast port could not be bound
+	static Local_discovery * instance() noexcept {
+		return instance_;
+	}
+
+	static bool is_enabled() noexcept;
+
+	// hex info hashes in either case, announced until removed. peers_found reports them in lowercase
+	void add_torrent(const QByteArray & info_sha1_hash) noexcept;
+	void remove_torrent(const QByteArray & info_sha1_hash) noexcept;
+signals:
+	void peers_found(const QByteArray & info_sha1_hash, const QList<QUrl> & peer_urls) const;
+
+private:
+	QByteArray craft_announce(const QByteArray & host, const QList<QByteArray> & info_sha1_hashes) const noexcept;
+	void on_ready_read(QUdpSocket & udp_socket) noexcept;
+	void on_announce_received(const QByteArray & announce, const QHostAddress & address) noexcept;
+	void announce(const QList<QByteArray> & info_sha1_hashes) noexcept;
+	///
+	constexpr static std::uint16_t multicast_port = 6771;
+	constexpr static qsizetype max_announced_hash_cnt = 16; // per datagram, keeps it well within the mtu
+	constexpr static std::chrono::minutes announce_interval{5};
+	constexpr static std::chrono::minutes min_announce_gap{1}; // per torrent
+	inline static const QHostAddress ipv4_group{"239.192.152.143"};
+	inline static const QHostAddress ipv6_group{"ff15::efc0:988f"};
+	inline static QPointer<Local_discovery> instance_;
+	QHash<QByteArray, QElapsedTimer> torrents_; // {info_sha1_hash (hex),since the last announce}
+	QUdpSocket ipv4_socket_;
+	QUdpSocket ipv6_socket_;
+	QTimer announce_timer_;
+	QByteArray cookie_; // recognizes our own announces looped back to us
+};
\ No newline at end of file
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <bencode_parser.h>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <optional>
+
+// BEP 52 hashes of a hybrid torrent. each file has a SHA-256 merkle tree over its 16 KiB blocks and the v1 pieces of a hybrid
+// torrent never cross into another file, so every piece is one subtree of a file tree. once the leaves of a piece are known
+// (fetched from a peer with hash requests), each block of it is judged on its own
+class Merkle_hashes {
+public:
+	// the fields shared by the hash request, hashes and hash reject messages
+	struct Hash_request {
+		QByteArray pieces_root;
+		std::int32_t base_layer = 0;
+		std::int32_t index = 0;
+		std::int32_t length = 0;
+		std::int32_t proof_layer_cnt = 0;
+	};
+
+	Merkle_hashes() = default;
+	explicit Merkle_hashes(const bencode::Metadata & torrent_metadata) noexcept;
+
+	// v1 only torrent, or a file tree that does not line up with the v1 pieces
+	bool is_empty() const noexcept {
+		return files_.isEmpty();
+	}
+
+	bool has_block_hashes(const std::int32_t piece_idx) const noexcept {
+		return block_hashes_.contains(piece_idx);
+	}
+
+	void add_piece_layers(const QHash<QByteArray, QByteArray> & piece_layers) noexcept;
+	std::optional<Hash_request> block_hash_request(std::int32_t piece_idx) const noexcept;
+	bool on_hashes_received(const Hash_request & request, const QList<QByteArray> & hashes) noexcept;
+	std::optional<bool> verify_block(std::int32_t piece_idx, std::int32_t block_idx, const QByteArray & block) const noexcept;
+	QList<std::int32_t> duplicate_pieces(std::int32_t piece_idx) const noexcept;
+	std::optional<std::int32_t> leaf_piece_index(const Hash_request & request) const noexcept;
+	std::optional<QList<QByteArray>> requested_hashes(const Hash_request & request, const QByteArray & piece = {}) const noexcept;
+	///
+	constexpr static std::int32_t hash_byte_cnt = 32;
+	constexpr static std::int32_t max_hash_cnt = 1 << 13; // per message, bounds the hashing one request can cause
+
+private:
+	struct File_tree {
+		QByteArray pieces_root;
+		QList<QByteArray> piece_layer; // empty until known
+		std::int64_t byte_cnt = 0;
+		std::int32_t first_piece_idx = 0;
+		std::int32_t piece_cnt = 0;
+		std::int32_t tree_height = 0;  // layers above the leaves
+		std::int32_t piece_height = 0; // layers of the subtree a piece spans
+	};
+
+	static QByteArray hash(const QByteArray & data) noexcept;
+	static QByteArray pad_hash(std::int32_t layer) noexcept;
+	static QList<QByteArray> parent_layer(const QList<QByteArray> & hashes, std::int32_t layer) noexcept;
+	static QByteArray subtree_root(QList<QByteArray> hashes, std::int32_t base_layer, std::int32_t height) noexcept;
+	static QList<QByteArray> upper_layer(const File_tree & file_tree, std::int32_t layer) noexcept;
+	void set_piece_layer(File_tree & file_tree, QList<QByteArray> piece_layer) noexcept;
+	QList<QByteArray> piece_block_hashes(const File_tree & file_tree, std::int32_t piece_idx, const QByteArray & piece) const noexcept;
+	const File_tree * file_tree(std::int32_t piece_idx) const noexcept;
+	const File_tree * file_tree(const QByteArray & pieces_root) const noexcept;
+	std::int32_t real_block_count(const File_tree & file_tree, std::int32_t piece_idx) const noexcept;
+	std::int64_t real_byte_count(const File_tree & file_tree, std::int32_t piece_idx) const noexcept;
+	///
+	constexpr static std::int32_t block_size = 1 << 14;
+	QList<File_tree> files_; // torrent order
+	QHash<std::int32_t, QList<QByteArray>> block_hashes_; // {piece_idx,leaves of its blocks that hold file data}
+	std::int64_t piece_length_ = 0;
+};
\ No newline at end of file
@@ -1,5 +1,9 @@
 #pragma once
 
+#include "peer_listener.h"
+#include "dht_node.h"
+#include "local_discovery.h"
+#include "udp_tracker_endpoint.h"
 #include "util.h"
 
 #include <QNetworkAccessManager>
@@ -26,4 +30,10 @@ public:
 	void download(QString dl_path, magnet::Metadata torrent_metadata, Download_tracker * tracker) noexcept;
 signals:
 	void new_download_requested(QString dl_path, bencode::Metadata torrent_metadata, QByteArray info_sha1_hash) const;
+
+private:
+	Peer_listener peer_listener_{this};
+	Dht_node dht_node_{this};
+	Local_discovery local_discovery_{this};
+	Udp_tracker_endpoint udp_tracker_endpoint_{this};
 };
\ No newline at end of file
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "utp_multiplexer.h"
+
+#include <QElapsedTimer>
+#include <QTcpServer>
+#include <QSettings>
+#include <QPointer>
+#include <QHash>
+
+class Peer_wire_client;
+class Tcp_socket;
+
+// accepts incoming peer connections (tcp and uTP) on the announced port and routes each one to the torrent named in its handshake
+class Peer_listener : public QTcpServer {
+	Q_OBJECT
+public:
+	explicit Peer_listener(QObject * parent = nullptr);
+
+	// kept inline, the DHT and LSD announce it without depending on the listener
+	static std::uint16_t listen_port() noexcept {
+		QSettings settings;
+		settings.beginGroup("network");
+		return qvariant_cast<std::uint16_t>(settings.value("listen_port", default_listen_port));
+	}
+
+	static void register_client(const QByteArray & info_sha1_hash, Peer_wire_client * peer_client) noexcept;
+	static void unregister_client(const QByteArray & info_sha1_hash, const Peer_wire_client * peer_client) noexcept;
+
+	// peers of a magnet download, parked until the download that replaces it takes them over
+	static void hand_over_sockets(const QByteArray & info_sha1_hash, const QList<Tcp_socket *> & sockets) noexcept;
+	static QList<Tcp_socket *> take_handed_over_sockets(const QByteArray & info_sha1_hash) noexcept;
+
+	// null when uTP is disabled or its port could not be bound
+	static Utp_multiplexer * utp_multiplexer() noexcept {
+		return utp_multiplexer_;
+	}
+
+	std::int32_t inbound_connection_count() const noexcept {
+		return inbound_connection_cnt_;
+	}
+
+protected:
+	void incomingConnection(qintptr socket_descriptor) override;
+
+private:
+	bool consume_accept_token() noexcept;
+	bool can_accept() noexcept;
+	void accept_socket(Tcp_socket * socket) noexcept;
+	void on_handshake_received(Tcp_socket * socket, const QByteArray & handshake) noexcept;
+	///
+	constexpr static std::uint16_t default_listen_port = 6889;
+	constexpr static std::chrono::minutes handover_timeout{2};
+	inline static QHash<QByteArray, Peer_wire_client *> peer_clients_; // {info_sha1_hash (hex),client}
+	inline static QHash<QByteArray, QList<QPointer<Tcp_socket>>> handed_over_sockets_; // {info_sha1_hash (hex),sockets}
+	inline static QPointer<Utp_multiplexer> utp_multiplexer_;
+	QElapsedTimer accept_timer_;
+	double accept_token_cnt_ = 0;
+	double max_accepts_per_sec_ = 0;
+	std::int32_t max_inbound_connection_cnt_ = 0;
+	std::int32_t inbound_connection_cnt_ = 0;
+};
\ No newline at end of file
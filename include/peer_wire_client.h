@@ -1,13 +1,20 @@
 #pragma once
 
 #include "torrent_properties_displayer.h"
+#include "connection_manager.h"
+#include "token_bucket.h"
+#include "web_seed.h"
+#include "merkle_hashes.h"
 #include "util.h"
 
 #include <bencode_parser.h>
+#include <QElapsedTimer>
 #include <QBitArray>
 #include <QObject>
+#include <QPointer>
 #include <QTimer>
 #include <QSet>
+#include <functional>
 
 namespace magnet {
 
@@ -30,12 +37,16 @@ public:
 		Request,
 		Piece,
 		Cancel,
+		Port,
 		Suggest_Piece = 13,
 		Have_All,
 		Have_None,
 		Reject_Request,
 		Allowed_Fast,
-		Extended_Protocol = 20
+		Extended_Protocol = 20,
+		Hash_Request,
+		Hashes,
+		Hash_Reject
 	};
 
 	Q_ENUM(Message_Id);
@@ -56,8 +67,18 @@ public:
 
 	Q_ENUM(Metadata_Id);
 
+	// message ids we advertise in the extended handshake; peers address their extension messages to us with these
+	enum Extension_Id {
+		Handshake,
+		Ut_Metadata,
+		Ut_Pex
+	};
+
+	Q_ENUM(Extension_Id);
+
 	Peer_wire_client(bencode::Metadata torrent_metadata, util::Download_resources resources, QByteArray id, QByteArray info_sha1_hash);
 	Peer_wire_client(magnet::Metadata torrent_metadata, util::Download_resources resources, QByteArray id);
+	~Peer_wire_client() override;
 
 	std::int64_t downloaded_byte_count() const noexcept {
 		return dled_byte_cnt_;
@@ -71,7 +92,20 @@ public:
 		return total_byte_cnt_ - dled_byte_cnt_;
 	}
 
+	const Connection_manager & connection_manager() const noexcept {
+		return connection_manager_;
+	}
+
+	// "private" key of the info dictionary (BEP 27), unknown to magnet downloads
+	bool is_private() const noexcept {
+		return is_private_;
+	}
+
 	void connect_to_peers(const QList<QUrl> & peer_urls) noexcept;
+	void connect_to_local_peers(const QList<QUrl> & peer_urls) noexcept;
+	void add_web_seeds(const QList<QUrl> & web_seed_urls, QNetworkAccessManager * network_manager) noexcept;
+	void add_piece_layers(const QHash<QByteArray, QByteArray> & piece_layers) noexcept;
+	void on_incoming_connection(Tcp_socket * socket, const QByteArray & handshake) noexcept;
 signals:
 	void piece_verified(std::int32_t piece_idx) const;
 	void existing_pieces_verified() const;
@@ -83,11 +117,13 @@ signals:
 	void new_download_requested(QString dl_path, bencode::Metadata torrent_metadata, QByteArray info_sha1_hash) const;
 
 private:
+	// only kept for pieces in flight (or briefly cached for uploads); everything else is described by bitfield_
 	struct Piece {
 		QList<std::int8_t> requested_blocks;
 		QBitArray received_blocks;
 		QByteArray data;
 		std::int32_t received_block_cnt = 0;
+		bool restored = false; // some blocks are only on the disk (received before a restart or without a buffer)
 	};
 
 	struct Piece_metadata {
@@ -96,6 +132,18 @@ private:
 		std::int32_t block_cnt = 0;
 	};
 
+	struct Metadata_request {
+		QPointer<Tcp_socket> socket;
+		QElapsedTimer timer;
+	};
+
+	struct File_span {
+		qsizetype file_handle_idx = 0;
+		std::int64_t file_offset = 0;
+		std::int64_t buffer_offset = 0;
+		std::int64_t byte_cnt = 0;
+	};
+
 	template<Message_Id message_id>
 	static QByteArray craft_generic_message(util::Packet_metadata packet_metadata) noexcept;
 
@@ -103,8 +151,10 @@ private:
 	static QByteArray craft_piece_message(const QByteArray & piece_data, std::int32_t piece_idx, std::int32_t piece_offset) noexcept;
 	static QByteArray craft_bitfield_message(const QBitArray & bitfield) noexcept;
 	static QByteArray craft_allowed_fast_message(std::int32_t piece_idx) noexcept;
-	static QByteArray craft_metadata_request(std::int64_t block_idx, std::int8_t peer_ut_metadata_idx) noexcept;
-	QByteArray craft_handshake_message() const noexcept;
+	QByteArray craft_metadata_message(Metadata_Id msg_type, std::int64_t block_idx, std::int8_t peer_ut_metadata_idx, const QByteArray & metadata_block = {}) const noexcept;
+	QByteArray craft_extended_handshake() const noexcept;
+	QByteArray craft_handshake_message(const QByteArray & info_hash) const noexcept;
+	static QByteArray craft_hash_message(Message_Id msg_id, const Merkle_hashes::Hash_request & hash_request, const QList<QByteArray> & hashes = {}) noexcept;
 
 	void on_socket_ready_read(Tcp_socket * socket) noexcept;
 	void on_have_message_received(Tcp_socket * socket, std::int32_t peer_have_piece_idx) noexcept;
@@ -112,21 +162,57 @@ private:
 	void on_block_received(Tcp_socket * socket, const QByteArray & reply) noexcept;
 	void on_allowed_fast_received(Tcp_socket * socket, std::int32_t allowed_piece_idx) noexcept;
 	void on_piece_downloaded(Piece & dled_piece, std::int32_t dled_piece_idx) noexcept;
+	void verify_downloaded_piece(Piece & dled_piece, std::int32_t dled_piece_idx) noexcept;
+	void on_block_written(std::int32_t piece_idx, std::int32_t block_idx, bool is_written) noexcept;
+	void on_piece_completed(std::int32_t completed_piece_idx) noexcept;
+	void on_web_seed_pieces_received(Web_seed * web_seed, std::int32_t first_piece_idx, std::int32_t piece_cnt, const QByteArray & pieces) noexcept;
+	void on_web_seed_failed(Web_seed * web_seed) noexcept;
+	void assign_web_seed_pieces() noexcept;
 	void on_block_request_received(Tcp_socket * socket, const QByteArray & request) noexcept;
 	void on_suggest_piece_received(Tcp_socket * socket, std::int32_t suggested_piece_idx) noexcept;
+	void on_hash_request_received(Tcp_socket * socket, const QByteArray & reply) noexcept;
+	void send_requested_hashes(Tcp_socket * socket, const Merkle_hashes::Hash_request & hash_request, const QByteArray & piece) noexcept;
+	void on_hashes_received(Tcp_socket * socket, const QByteArray & reply) noexcept;
+	void send_block_hash_request(Tcp_socket * socket, std::int32_t piece_idx) noexcept;
+	bool drop_corrupt_blocks(std::int32_t piece_idx, Piece & piece) noexcept;
+	void complete_duplicate_pieces(std::int32_t piece_idx, QByteArray piece) noexcept;
+	void on_peer_pieces_announced(Tcp_socket * announcer, bool is_bitfield) noexcept;
+	void reveal_super_seed_piece(Tcp_socket * socket) noexcept;
 	void on_socket_connected(Tcp_socket * socket) noexcept;
+	void attach_socket(Tcp_socket * socket) noexcept;
+	void on_peer_established(Tcp_socket * socket, bool is_taken_over = false) noexcept;
+	void send_piece_availability(Tcp_socket * socket, bool is_taken_over) noexcept;
+	void hand_over_peers() noexcept;
+	void take_over_peers() noexcept;
+	void on_dial_requested(const QUrl & peer_url) noexcept;
 	void on_handshake_reply_received(Tcp_socket * socket, const QByteArray & reply);
+	void on_peer_message_received(Tcp_socket * socket, const QByteArray & reply);
 	void on_piece_verified(std::int32_t verified_piece_idx) noexcept;
 	void send_block_requests(Tcp_socket * socket, std::int32_t piece_idx) noexcept;
 	void on_extension_message_received(Tcp_socket * socket, const QByteArray & message);
 	void on_extension_handshake_received(Tcp_socket * socket, const QByteArray & message);
 	void on_extension_metadata_message_received(Tcp_socket * socket, const QByteArray & message);
-	void send_metadata_requests(Tcp_socket * socket) const noexcept;
+	void on_extension_pex_message_received(Tcp_socket * socket, const QByteArray & message);
+	void on_metadata_request_received(Tcp_socket * socket, std::int64_t metadata_piece_idx) noexcept;
+	void send_metadata_requests() noexcept;
+	void send_pex_message(Tcp_socket * socket) noexcept;
+	static std::optional<QUrl> pex_peer_url(const Tcp_socket * socket) noexcept;
 
 	qsizetype file_size(qsizetype file_idx) const noexcept {
 		return static_cast<qsizetype>(torrent_metadata_.file_info[static_cast<std::size_t>(file_idx)].second);
 	}
 
+	// what a magnet download keeps of a peer's messages for the download that takes the peer over
+	static bool is_deferrable_message(const Message_Id msg_id) noexcept {
+		return msg_id != Message_Id::Request && msg_id != Message_Id::Piece && msg_id != Message_Id::Cancel && msg_id != Message_Id::Reject_Request &&
+		       msg_id != Message_Id::Extended_Protocol && msg_id != Message_Id::Hash_Request && msg_id != Message_Id::Hashes && msg_id != Message_Id::Hash_Reject;
+	}
+
+	// while we are the only seed, the peers learn our pieces one at a time so that they trade them instead of all downloading from us
+	bool is_super_seeding() const noexcept {
+		return super_seeding_ && state_ == State::Seed;
+	}
+
 	bool is_valid_piece_index(std::int32_t piece_idx) const noexcept {
 		return piece_idx >= 0 && piece_idx < total_piece_cnt_;
 	}
@@ -137,24 +223,32 @@ private:
 	bool validate_metadata_piece_info(std::int64_t piece_idx, std::int64_t received_raw_dict_size) const noexcept;
 
 	static util::Packet_metadata extract_packet_metadata(const QByteArray & reply);
+	static Merkle_hashes::Hash_request extract_hash_request(const QByteArray & reply) noexcept;
 	void communicate_with_peer(Tcp_socket * socket);
 	Piece_metadata piece_info(std::int32_t piece_idx, std::int32_t piece_offset = 0) const noexcept;
 
-	bool write_to_disk(const QByteArray & received_piece, std::int32_t received_piece_idx) noexcept;
-	std::optional<QByteArray> read_from_disk(std::int32_t requested_piece_idx) noexcept;
+	// both complete from the event loop
+	void write_to_disk(QByteArray data, std::int32_t piece_idx, std::int32_t piece_offset, std::function<void(bool)> on_written) noexcept;
+	void read_from_disk(std::int32_t requested_piece_idx, std::function<void(std::optional<QByteArray>)> on_read) noexcept;
 
 	void write_settings() const noexcept;
 	void read_settings() noexcept;
+	void read_rate_limits() noexcept;
+	void apply_rate_limits(Tcp_socket * socket) noexcept;
 
 	static bool is_valid_reply(Tcp_socket * socket, const QByteArray & reply, Message_Id received_msg_id) noexcept;
 
-	std::optional<std::pair<qsizetype, qsizetype>> beginning_file_handle_info(std::int32_t piece_idx) const noexcept;
+	QList<File_span> file_spans(std::int32_t piece_idx, std::int32_t piece_offset, std::int64_t byte_cnt) const noexcept;
 	std::int32_t piece_size(std::int32_t piece_idx) const noexcept;
 
 	static QSet<std::int32_t> generate_allowed_fast_set(std::uint32_t peer_ip, std::int32_t total_piece_cnt) noexcept;
 	void clear_piece(std::int32_t piece_idx) noexcept;
 	void configure_default_connections() noexcept;
+	void configure_connection_manager() noexcept;
 	void fill_target_piece_indexes() noexcept;
+	void run_choker() noexcept;
+	void revoke_queued_pieces(Tcp_socket * socket) noexcept;
+	qsizetype unchoked_peer_count() const noexcept;
 	///
 	constexpr static std::string_view protocol_tag{"BitTorrent protocol"};
 	constexpr static std::string_view keep_alive_msg{"00000000"};
@@ -164,15 +258,31 @@ private:
 	constexpr static std::string_view uninterested_msg{"0000000103"};
 	constexpr static std::string_view have_all_msg{"000000010e"};
 	constexpr static std::string_view have_none_msg{"000000010f"};
-	constexpr static std::string_view reserved_bytes{"0000000000100004"};
-	constexpr static std::string_view extended_handshake_dict{"d1:md11:ut_metadatai1eee"};
+	constexpr static std::string_view port_msg_prefix{"0000000309"};
+	constexpr static std::string_view reserved_bytes{"0000000000100005"};
+	constexpr static std::string_view v2_reserved_bytes{"0000000000100015"}; // BEP 52 bit on top
+	constexpr static std::int32_t hash_msg_header_size = 49; // id, pieces root, base layer, index, length and proof layers
+	constexpr static qsizetype max_pex_peer_cnt = 50; // per direction in one message
+	constexpr static qsizetype max_metadata_request_cnt = 2; // per peer
+	constexpr static qsizetype max_deferred_msg_cnt = 1 << 12; // per peer
+	constexpr static std::chrono::seconds metadata_request_timeout{10};
+	constexpr static std::chrono::seconds block_hash_request_timeout{10};
+	constexpr static std::chrono::seconds min_pex_interval{60}; // per peer
 	constexpr static std::int16_t max_block_size = 1 << 14;
+	constexpr static std::int64_t max_web_seed_run_byte_cnt = 1 << 22; // at least one piece is always fetched
 	QList<std::pair<QFile *, std::int64_t>> file_handles_; // {file_handle,count of bytes downloaded}
-	QList<QUrl> active_peers_;
+	QList<std::int64_t> file_beg_offsets_; // torrent offset at which each file begins
 	QList<std::int32_t> target_piece_idxes_;
+	QList<Web_seed *> web_seeds_;
+	QSet<std::int32_t> web_seed_piece_idxes_; // fetched by a web seed, never requested from the peers
+	QSet<std::int32_t> reserved_piece_idxes_; // picked, holding budget in Piece_buffer_pool until they get a buffer
+	QSet<QString> local_peer_hosts_;	  // found through LSD, treated as LAN peers
 	Torrent_properties_displayer properties_displayer_;
+	Connection_manager connection_manager_;
+	Merkle_hashes merkle_hashes_; // empty for v1 only torrents
 	QByteArray id_;
 	QByteArray info_sha1_hash_;
+	QByteArray info_v2_hash_; // truncated SHA-256 of the info dictionary (hex), hybrid torrents only
 	QByteArray handshake_msg_;
 	QByteArray raw_metadata_;
 	QString dl_path_;
@@ -180,8 +290,22 @@ private:
 	QBitArray metadata_field_;
 	QTimer settings_timer_;
 	QTimer request_timer_;
+	QTimer choke_timer_;
+	QTimer pex_timer_;
+	QTimer metadata_timer_;
+	QHash<const Tcp_socket *, std::int64_t> last_choke_byte_cnts_;
+	QHash<std::int64_t, Metadata_request> metadata_requests_; // in flight, by metadata piece
+	QHash<std::int64_t, QPointer<Tcp_socket>> metadata_piece_sources_; // who served each metadata piece
+	QHash<std::int32_t, QElapsedTimer> block_hash_requests_; // in flight, by piece
+	QHash<std::int32_t, std::int32_t> pending_write_cnts_; // {piece_idx,count of its block writes in flight}
+	QHash<std::int32_t, std::int32_t> super_seed_reveal_cnts_; // {piece_idx,count of peers it was revealed to}
+	QPointer<Tcp_socket> optimistic_peer_;
 	bencode::Metadata torrent_metadata_;
 	Download_tracker * tracker_ = nullptr;
+	Token_bucket upload_bucket_{&Token_bucket::global_upload()};
+	Token_bucket download_bucket_{&Token_bucket::global_download()};
+	std::int64_t peer_upload_byte_rate_ = 0;
+	std::int64_t peer_download_byte_rate_ = 0;
 	std::int64_t dled_byte_cnt_ = 0;
 	std::int64_t uled_byte_cnt_ = 0;
 	std::int64_t session_dled_byte_cnt_ = 0;
@@ -195,8 +319,13 @@ private:
 	std::int32_t average_block_cnt_ = 0;
 	std::int32_t dled_piece_cnt_ = 0;
 	std::int32_t obtained_metadata_piece_cnt_ = 0;
+	std::int32_t upload_slot_cnt_ = 4;
+	std::int32_t choke_round_cnt_ = 0;
 	bool has_metadata_ = false;
+	bool is_private_ = false;
+	bool rate_limit_lan_peers_ = false;
+	bool super_seeding_ = false;
 	State state_ = State::Verification;
-	QList<std::int32_t> peer_additive_bitfield_;
-	QList<Piece> pieces_;
+	QList<std::uint16_t> peer_additive_bitfield_; // count of connected peers having each piece
+	QHash<std::int32_t, Piece> active_pieces_;
 };
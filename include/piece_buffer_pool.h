@@ -0,0 +1,48 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <optional>
+
+// recycles in-progress piece buffers across all torrents and bounds their total size, cached free buffers included. the pieces
+// cached for uploads and the runs of web seeds are not pooled: the former live for seconds, the latter are bounded per web seed
+class Piece_buffer_pool {
+public:
+	static Piece_buffer_pool & instance() noexcept;
+
+	Piece_buffer_pool(const Piece_buffer_pool &) = delete;
+	Piece_buffer_pool & operator=(const Piece_buffer_pool &) = delete;
+
+	std::int64_t used_byte_count() const noexcept {
+		return used_byte_cnt_;
+	}
+
+	std::int64_t byte_budget() const noexcept {
+		return byte_budget_;
+	}
+
+	// free buffers are evicted to make room, so only the lent and reserved bytes count
+	bool can_allocate(const std::int64_t byte_cnt) const noexcept {
+		return used_byte_cnt_ + reserved_byte_cnt_ + byte_cnt <= byte_budget_;
+	}
+
+	void set_byte_budget(std::int64_t byte_budget) noexcept;
+	// sets memory aside for a piece that is picked but has no buffer yet
+	bool reserve(std::int64_t byte_cnt) noexcept;
+	void cancel_reservation(std::int64_t byte_cnt) noexcept;
+	std::optional<QByteArray> acquire(qsizetype byte_cnt, bool is_reserved = false) noexcept;
+	void release(QByteArray && buffer) noexcept;
+
+private:
+	Piece_buffer_pool();
+
+	void evict_free_buffers(std::int64_t needed_byte_cnt) noexcept;
+	///
+	constexpr static std::int64_t default_byte_budget = 256LL << 20;
+	QHash<qsizetype, QList<QByteArray>> free_buffers_; // {capacity,buffers}
+	QHash<const char *, qsizetype> lent_buffers_;	     // {buffer,capacity}
+	std::int64_t byte_budget_ = default_byte_budget;
+	std::int64_t used_byte_cnt_ = 0;
+	std::int64_t reserved_byte_cnt_ = 0;
+	std::int64_t free_byte_cnt_ = 0;
+};
\ No newline at end of file
@@ -1,24 +1,45 @@
 #pragma once
 
 #include "util.h"
+#include "token_bucket.h"
 
+#include <QElapsedTimer>
 #include <QTcpSocket>
 #include <QBitArray>
 #include <QTimer>
 #include <QUrl>
+#include <functional>
 
 class Tcp_socket : public QTcpSocket {
 	Q_OBJECT
 public:
-	explicit Tcp_socket(QUrl peer_url, const std::int64_t uled_byte_threshold, QObject * const parent)
-	    : QTcpSocket(parent),
-		uled_byte_threshold(uled_byte_threshold),
-		peer_url_(std::move(peer_url)) {
+	explicit Tcp_socket(QUrl peer_url, QObject * const parent) : QTcpSocket(parent), peer_url_(std::move(peer_url)), outgoing_(true) {
 		configure_default_connections();
 		connectToHost(QHostAddress(peer_url_.host()), static_cast<std::uint16_t>(peer_url_.port()));
 		disconnect_timer_.setSingleShot(true);
 	}
 
+	// already connected socket accepted by Peer_listener
+	explicit Tcp_socket(const qintptr socket_descriptor, QObject * const parent) : QTcpSocket(parent) {
+		configure_default_connections();
+		setSocketDescriptor(socket_descriptor);
+
+		{
+			auto peer_address = peerAddress();
+			bool is_ipv4_mapped = false;
+
+			if(const auto ipv4_address = peer_address.toIPv4Address(&is_ipv4_mapped); is_ipv4_mapped) {
+				peer_address = QHostAddress(ipv4_address);
+			}
+
+			peer_url_.setHost(peer_address.toString());
+			peer_url_.setPort(peerPort());
+		}
+
+		disconnect_timer_.setSingleShot(true);
+		disconnect_timer_.start(std::chrono::minutes(2));
+	}
+
 	std::int64_t downloaded_byte_count() const noexcept {
 		return dled_byte_cnt_;
 	}
@@ -35,6 +56,11 @@ public:
 		return peer_url_;
 	}
 
+	// we dialed the peer, so peer_url() is where it listens
+	bool is_outgoing() const noexcept {
+		return outgoing_;
+	}
+
 	bool remove_request(const util::Packet_metadata request_metadata) noexcept {
 		return pending_requests_.remove(request_metadata);
 	}
@@ -54,6 +80,15 @@ public:
 		}
 	}
 
+	// false while the download buckets are in debt; the caller retries after receive_delay()
+	bool can_receive() noexcept {
+		return !download_bucket_.is_limited() || download_bucket_.has_tokens();
+	}
+
+	std::chrono::milliseconds receive_delay() noexcept {
+		return download_bucket_.refill_delay();
+	}
+
 	void on_peer_fault() noexcept {
 
 		if(constexpr auto peer_fault_threshold = 50; ++peer_fault_cnt_ > peer_fault_threshold) {
@@ -74,23 +109,30 @@ public:
 		emit downloaded_byte_count_changed(dled_byte_cnt_);
 	}
 
-	bool is_good_ratio() const noexcept {
-		constexpr auto min_ratio = 1;
-		assert(uled_byte_cnt_ >= 0 && dled_byte_cnt_ >= 0);
-		return uled_byte_cnt_ <= uled_byte_threshold ? true : static_cast<double>(dled_byte_cnt_) / static_cast<double>(uled_byte_cnt_) >= min_ratio;
-	}
-
 	std::optional<QByteArray> receive_packet() noexcept;
 	void post_request(util::Packet_metadata request, QByteArray packet) noexcept;
+	void send_rate_limited_packet(QByteArray packet) noexcept;
+	// removes the packets still waiting for upload tokens that predicate picks, e.g. pieces revoked by a choke
+	QList<QByteArray> take_throttled_packets(const std::function<bool(const QByteArray &)> & predicate) noexcept;
+	void set_rate_limits(Token_bucket * torrent_upload_bucket, Token_bucket * torrent_download_bucket, std::int64_t upload_byte_rate, std::int64_t download_byte_rate) noexcept;
+	bool is_lan_peer() const noexcept;
 	///
 	QBitArray peer_bitfield;
 	QByteArray peer_id;
 	QSet<std::int32_t> peer_allowed_fast_set;
 	QSet<std::int32_t> allowed_fast_set;
 	QSet<util::Packet_metadata> rejected_requests;
+	QSet<std::int32_t> super_seed_piece_idxes; // revealed to the peer, the only pieces it may request
+	QSet<QUrl> pex_advertised_peers;
+	QList<QByteArray> deferred_messages; // received while the torrent had no metadata
+	QElapsedTimer pex_receive_timer;
+	QElapsedTimer pex_send_timer;
 	QTimer request_timer;
-	std::int64_t uled_byte_threshold = 0;
 	std::int64_t peer_ut_metadata_id = -1;
+	std::int64_t peer_ut_pex_id = -1;
+	std::uint16_t peer_listen_port = 0; // "p" of the extension handshake
+	std::int32_t metadata_timeout_cnt = 0; // ut_metadata requests that went unanswered
+	std::int32_t super_seed_piece_idx = -1; // last revealed, the next one waits until this shows up at another peer
 	bool handshake_done = false;
 	bool am_choking = true;
 	bool peer_choked = true;
@@ -98,20 +140,42 @@ public:
 	bool peer_interested = false;
 	bool fast_extension_enabled = false;
 	bool extension_protocol_enabled = false;
+	bool dht_enabled = false;
+	bool v2_enabled = false; // BEP 52 hash messages
+	bool peer_lacks_metadata = false; // rejected a ut_metadata request
+	bool super_seeded = false; // established while super seeding, never saw our bitfield
 signals:
 	void got_choked() const;
 	void uploaded_byte_count_changed(std::int64_t uled_byte_cnt) const;
 	void downloaded_byte_count_changed(std::int64_t uled_byte_cnt) const;
 
+protected:
+	struct Unconnected_tag {};
+
+	// for transports that manage the connection themselves (Utp_socket)
+	Tcp_socket(QUrl peer_url, QObject * const parent, const bool outgoing, Unconnected_tag /* tag */)
+	    : QTcpSocket(parent),
+		peer_url_(std::move(peer_url)),
+		outgoing_(outgoing) {
+		configure_default_connections();
+		disconnect_timer_.setSingleShot(true);
+	}
+
 private:
 	void configure_default_connections() noexcept;
+	void send_throttled_packets() noexcept;
 	///
 	std::pair<std::optional<std::int32_t>, QByteArray> receive_buffer_;
 	QHash<util::Packet_metadata, QByteArray> pending_requests_;
 	QSet<util::Packet_metadata> sent_requests_;
+	QList<QByteArray> throttled_packets_;
+	QTimer throttle_timer_;
+	Token_bucket upload_bucket_;
+	Token_bucket download_bucket_;
 	QTimer disconnect_timer_;
 	QUrl peer_url_;
 	std::int64_t dled_byte_cnt_ = 0;
 	std::int64_t uled_byte_cnt_ = 0;
 	std::int8_t peer_fault_cnt_ = 0;
+	bool outgoing_ = false;
 };
\ No newline at end of file
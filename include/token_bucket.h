@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// byte rate limiter. buckets form a chain (peer -> torrent -> global) and traffic is only allowed while every limited bucket
+// in the chain holds tokens. a rate of 0 means unlimited; a chain without limits is never refilled nor waited upon
+class Token_bucket {
+public:
+	explicit Token_bucket(Token_bucket * parent = nullptr, std::int64_t byte_rate = 0) noexcept;
+
+	static Token_bucket & global_upload() noexcept;
+	static Token_bucket & global_download() noexcept;
+	static void reload_global_rates() noexcept; // picks up limits changed since the global buckets were made
+
+	std::int64_t byte_rate() const noexcept {
+		return byte_rate_;
+	}
+
+	void set_parent(Token_bucket * const parent) noexcept {
+		parent_ = parent;
+	}
+
+	bool is_limited() const noexcept {
+		return byte_rate_ || (parent_ && parent_->is_limited());
+	}
+
+	void set_byte_rate(std::int64_t byte_rate) noexcept;
+	bool has_tokens() noexcept;
+	void consume(std::int64_t byte_cnt) noexcept;
+	std::chrono::milliseconds refill_delay() noexcept;
+
+private:
+	void refill() noexcept;
+	///
+	constexpr static std::int64_t min_burst_byte_cnt = 1 << 15; // a couple of blocks so that a single PIECE never stalls
+	Token_bucket * parent_ = nullptr;
+	std::chrono::steady_clock::time_point last_refill_time_ = std::chrono::steady_clock::now();
+	std::int64_t byte_rate_ = 0;
+	double token_cnt_ = 0;
+};
\ No newline at end of file
@@ -27,7 +27,7 @@ public:
 	explicit Torrent_properties_displayer(const bencode::Metadata & torrent_metadata, QWidget * parent = nullptr);
 
 	void add_peer(const Tcp_socket * socket) noexcept;
-	void remove_peer(std::int32_t peer_row_idx) noexcept;
+	void remove_peer(const Tcp_socket * socket) noexcept;
 	void update_file_info(qsizetype file_idx, std::int64_t file_dled_byte_cnt) noexcept;
 	void setup_file_info_widget(const bencode::Metadata & torrent_metadata, const QList<std::pair<QFile *, std::int64_t>> & file_handles) noexcept;
 	void display_file_bar() noexcept;
@@ -43,6 +43,7 @@ private:
 	QWidget general_info_tab_;
 	QWidget file_info_tab_;
 	QTableWidget peer_table_;
+	QList<const Tcp_socket *> peer_rows_; // socket shown on each row of peer_table_
 	QFormLayout general_info_layout_{&general_info_tab_};
 	QFormLayout file_info_layout_{&file_info_tab_};
 };
\ No newline at end of file
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <QObject>
+#include <QTimer>
+#include <QList>
+#include <QUrl>
+
+// one announce url of a torrent. Udp_torrent_client orders them in tiers, races the first announce and fails over between them;
+// the subclasses only speak their protocol and re-announce on the interval the tracker asked for
+class Tracker : public QObject {
+	Q_OBJECT
+public:
+	// BEP 15 numbering, http trackers get the names
+	enum class Event {
+		None,
+		Completed,
+		Started,
+		Stopped
+	};
+
+	Q_ENUM(Event);
+
+	struct Announce_parameters {
+		QByteArray info_sha1_hash; // hex
+		QByteArray peer_id;	   // hex
+		std::int64_t dled_byte_cnt = 0;
+		std::int64_t left_byte_cnt = 0;
+		std::int64_t uled_byte_cnt = 0;
+		Event event = Event::None;
+		std::int32_t num_want = -1; // tracker's default
+		std::uint16_t listen_port = 0;
+	};
+
+	struct Announce_reply {
+		QList<QUrl> peer_urls;
+		std::int32_t interval_time = 0;
+		std::int32_t min_interval_time = 0; // http trackers only
+		std::int32_t leecher_cnt = 0;
+		std::int32_t seed_cnt = 0;
+	};
+
+	struct Swarm_metadata {
+		std::int32_t seed_cnt = 0;
+		std::int32_t completed_cnt = 0;
+		std::int32_t leecher_cnt = 0;
+	};
+
+	constexpr static std::chrono::seconds default_interval_time{std::chrono::minutes(30)};
+
+	Tracker(QUrl announce_url, QObject * const parent) : QObject(parent), announce_url_(std::move(announce_url)) {
+		assert(announce_url_.isValid());
+		interval_timer_.setSingleShot(true);
+		connect(&interval_timer_, &QTimer::timeout, this, &Tracker::announce_due);
+	}
+
+	static bool is_supported_url(const QUrl & tracker_url) noexcept {
+		const auto scheme = tracker_url.scheme();
+		return tracker_url.isValid() && (scheme == "udp" || scheme == "http" || scheme == "https");
+	}
+
+	// BEP 23 compact peers, 6 bytes each (18 with BEP 7 ipv6 peers)
+	static QList<QUrl> extract_compact_peers(const QByteArray & compact_peers, bool ipv6_peers);
+
+	const QUrl & announce_url() const noexcept {
+		return announce_url_;
+	}
+
+	virtual void announce(const Announce_parameters & parameters) noexcept = 0;
+	virtual void scrape(const QByteArray & info_sha1_hash) noexcept = 0;
+
+	// overrides the interval the tracker asked for, until its next reply
+	void reschedule_announce(const std::chrono::seconds delay) noexcept {
+		interval_timer_.start(delay);
+	}
+
+	// drops whatever is in flight and the re-announce schedule
+	virtual void stop() noexcept {
+		interval_timer_.stop();
+	}
+signals:
+	void announce_due() const;
+	void announce_reply_received(const Tracker::Announce_reply & announce_reply) const;
+	void announce_failed(const QByteArray & error) const;
+	void swarm_metadata_received(const Tracker::Swarm_metadata & swarm_metadata) const;
+
+protected:
+	void start_interval_timer(const std::chrono::seconds interval_time) noexcept {
+		interval_timer_.start(interval_time.count() > 0 ? interval_time : default_interval_time);
+	}
+
+private:
+	QUrl announce_url_;
+	QTimer interval_timer_;
+};
\ No newline at end of file
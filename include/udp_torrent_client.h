@@ -1,82 +1,86 @@
 #pragma once
 
 #include "peer_wire_client.h"
-#include "udp_socket.h"
+#include "tracker.h"
 #include "util.h"
 #include "magnet_url_parser.h"
 
 #include <bencode_parser.h>
+#include <QNetworkAccessManager>
 #include <QCryptographicHash>
+#include <QElapsedTimer>
+#include <QPointer>
 #include <random>
 
 class Udp_torrent_client : public QObject {
 	Q_OBJECT
 public:
-	enum class Action_Code {
-		Connect,
-		Announce,
-		Scrape,
-		Error,
-	};
-
-	Q_ENUM(Action_Code);
-
-	enum class Event {
-		None,
-		Started,
-		Stopped,
-		Completed
-	};
-
-	Q_ENUM(Event);
-
-	struct Swarm_metadata {
-		std::int32_t seed_cnt = 0;
-		std::int32_t completed_cnt = 0;
-		std::int32_t leecher_cnt = 0;
-	};
-
-	struct Announce_reply {
-		QList<QUrl> peer_urls;
-		std::int32_t interval_time = 0;
-		std::int32_t leecher_cnt = 0;
-		std::int32_t seed_cnt = 0;
-	};
-
-	Udp_torrent_client(bencode::Metadata torrent_metadata, util::Download_resources resources, QByteArray info_sha1_hash, QObject * parent = nullptr);
-	Udp_torrent_client(magnet::Metadata torrent_metadata, util::Download_resources resources, QObject * parent = nullptr);
-
-	void send_connect_request(qsizetype tracker_url_idx = 0) noexcept;
+	Udp_torrent_client(bencode::Metadata torrent_metadata, util::Download_resources resources, QByteArray info_sha1_hash, QNetworkAccessManager * network_manager);
+	Udp_torrent_client(magnet::Metadata torrent_metadata, util::Download_resources resources, QNetworkAccessManager * network_manager);
+	~Udp_torrent_client() override;
 signals:
-	void announce_reply_received(const Announce_reply & announce_reply) const;
-	void swarm_metadata_received(const Swarm_metadata & swarm_metadata) const;
+	void announce_reply_received(const Tracker::Announce_reply & announce_reply) const;
+	void swarm_metadata_received(const Tracker::Swarm_metadata & swarm_metadata) const;
 	void error_received(const QByteArray & array) const;
 	void new_download_requested(QString dl_path, bencode::Metadata torrent_metadata, QByteArray info_sha1_hash) const;
 
 private:
-	static QByteArray craft_connect_request() noexcept;
-	QByteArray craft_scrape_request(std::int64_t tracker_connection_id) const noexcept;
-	QByteArray craft_announce_request(std::int64_t tracker_connection_id) const noexcept;
-
-	static std::optional<QByteArray> extract_tracker_error(const QByteArray & reply, std::int32_t sent_txn_id);
-	static std::optional<std::int64_t> extract_connect_reply(const QByteArray & reply, std::int32_t sent_txn_id);
-	static std::optional<Announce_reply> extract_announce_reply(const QByteArray & reply, std::int32_t sent_txn_id);
-	static std::optional<Swarm_metadata> extract_scrape_reply(const QByteArray & reply, std::int32_t sent_txn_id);
+	enum class Peer_Demand {
+		Starving,
+		Normal,
+		Saturated
+	};
 
 	static QByteArray calculate_info_sha1_hash(const bencode::Metadata & torrent_metadata) noexcept;
-	static bool verify_txn_id(const QByteArray & reply, std::int32_t sent_txn_id);
-	void communicate_with_tracker(Udp_socket * socket);
+	static QList<QList<QUrl>> extract_tracker_tiers(QString dl_path, const std::vector<std::string> & announce_url_list) noexcept;
+	static QList<QUrl> extract_web_seed_urls(QString dl_path) noexcept;
+	static QHash<QByteArray, QByteArray> extract_piece_layers(QString dl_path) noexcept;
+	static QByteArray stored_torrent_content(QString dl_path) noexcept;
+	static std::int32_t tracker_failure_count(const QUrl & tracker_url) noexcept;
+	static void set_tracker_failure_count(const QUrl & tracker_url, std::int32_t failure_cnt) noexcept;
+
+	Peer_Demand peer_demand() const noexcept;
+	Tracker::Announce_parameters announce_parameters(Tracker::Event event) const noexcept;
+	Tracker * find_or_create_tracker(const QUrl & tracker_url) noexcept;
+	void set_tracker_tiers(QList<QList<QUrl>> tracker_tiers) noexcept;
+	void race_trackers() noexcept;
+	void announce_to(const QUrl & tracker_url, Tracker::Event event) noexcept;
+	void announce_to_next_tracker() noexcept;
+	void stop_trackers() noexcept;
+	void schedule_scrape() noexcept;
+	void schedule_announce(const Tracker::Announce_reply & announce_reply) noexcept;
+	void on_tracker_replied(const QUrl & tracker_url, const Tracker::Announce_reply & announce_reply) noexcept;
+	void on_tracker_failed(const QUrl & tracker_url) noexcept;
 	void configure_default_connections() noexcept;
-	void on_socket_ready_read(Udp_socket * socket) noexcept;
+	void start_peer_discovery() noexcept;
 	///
+	constexpr static qsizetype max_racing_tracker_cnt = 4;
+	constexpr static std::int32_t max_tracker_failure_cnt = 10;
+	constexpr static std::chrono::seconds tracker_reply_timeout{60};
+	constexpr static std::chrono::minutes scrape_interval{30};
+	constexpr static std::chrono::minutes min_announce_gap{5}; // when the tracker sets no min interval
+	constexpr static std::int32_t max_num_want = 200;
 	inline static std::mt19937 random_generator{std::random_device{}()};
-	inline static std::uniform_int_distribution<std::int32_t> random_id_range;
 	inline const static auto id = QByteArray("-TORAP0-AXT134ZXCLLZ").toHex();
 
 	bencode::Metadata torrent_metadata_;
 	QByteArray info_sha1_hash_;
 	Peer_wire_client peer_client_;
+	QPointer<QNetworkAccessManager> network_manager_;
 	Download_tracker * tracker_ = nullptr;
-	Event event_ = Event::None;
-	bool connect_requests_sent_ = false;
+	QList<QList<QUrl>> tracker_tiers_; // BEP 12
+	QHash<QUrl, Tracker *> trackers_;
+	QHash<QUrl, QElapsedTimer> pending_trackers_; // announced to, no reply yet
+	QSet<QUrl> started_trackers_;		      // saw our "started" since the last resume
+	QSet<QUrl> failed_trackers_;		      // since the last successful announce
+	QUrl active_tracker_url_;
+	QTimer tracker_timeout_timer_;
+	QTimer tracker_retry_timer_;
+	QTimer scrape_timer_;
+	QTimer peer_demand_timer_;
+	QElapsedTimer last_announce_timer_; // to the active tracker
+	std::chrono::seconds min_reannounce_gap_{min_announce_gap};
+	std::int32_t tracker_retry_cnt_ = 0;
+	bool peer_discovery_started_ = false;
+	bool paused_ = false;
 };
\ No newline at end of file
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "tracker.h"
+
+#include <QHostAddress>
+#include <QHostInfo>
+#include <random>
+
+// BEP 15 announces and scrapes through the shared Udp_tracker_endpoint. announces go to one address per family since
+// dual-stack trackers hand out different peers to each
+class Udp_tracker : public Tracker {
+	Q_OBJECT
+public:
+	enum class Action_Code {
+		Connect,
+		Announce,
+		Scrape,
+		Error,
+	};
+
+	Q_ENUM(Action_Code);
+
+	explicit Udp_tracker(QUrl announce_url, QObject * parent = nullptr);
+	~Udp_tracker() override;
+
+	void announce(const Announce_parameters & parameters) noexcept override;
+	void scrape(const QByteArray & info_sha1_hash) noexcept override;
+	void stop() noexcept override;
+
+private:
+	QByteArray craft_announce_request(std::int64_t tracker_connection_id) const noexcept;
+
+	static std::optional<Announce_reply> extract_announce_reply(const QByteArray & reply, bool ipv6_peers);
+	// one torrent's 12 bytes of a (batched) scrape reply
+	static std::optional<Swarm_metadata> extract_scrape_reply(const QByteArray & torrent_stats);
+
+	void resolve_then(std::function<void()> on_resolved) noexcept;
+	void on_announce_reply(const std::optional<QByteArray> & reply, bool ipv6_peers) noexcept;
+	void fail_announce(const QByteArray & error) noexcept;
+	///
+	inline static std::mt19937 random_generator{std::random_device{}()};
+	inline static std::uniform_int_distribution<std::int32_t> random_id_range;
+
+	QList<QHostAddress> addresses_; // one per address family, resolved once
+	QObject scrape_context_;	     // scrapes are cancelled apart from announces
+	Announce_parameters announce_parameters_;
+	qsizetype pending_reply_cnt_ = 0;
+	bool announce_pending_ = false;
+};
\ No newline at end of file
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <QHostAddress>
+#include <QUdpSocket>
+#include <QPointer>
+#include <QObject>
+#include <QTimer>
+#include <QHash>
+#include <QList>
+#include <functional>
+#include <array>
+
+// the one udp socket every tracker request goes through (BEP 15). replies are routed back by transaction id and unanswered
+// requests are retransmitted after 15 * 2^n seconds, all of them tracked on a single one-second timer wheel. connection ids
+// are cached per tracker endpoint for a minute, so torrents sharing a tracker skip the connect round trip
+class Udp_tracker_endpoint : public QObject {
+	Q_OBJECT
+public:
+	// builds the hex request that follows the connect exchange. the transaction id in it is replaced by a unique one
+	using Request_crafter = std::function<QByteArray(std::int64_t connection_id)>;
+	// the raw reply (announce, scrape or error), or nothing once the retransmissions ran out
+	using Reply_handler = std::function<void(const std::optional<QByteArray> & reply)>;
+
+	explicit Udp_tracker_endpoint(QObject * parent = nullptr);
+
+	// null when the socket could not be bound
+	static Udp_tracker_endpoint * instance() noexcept {
+		return instance_;
+	}
+
+	void send_request(const QHostAddress & address, std::uint16_t port, const QObject * context, Request_crafter craft_request, Reply_handler on_reply) noexcept;
+	// sent together with the other scrapes of the tracker queued within scrape_batch_delay, up to 74 info hashes per packet.
+	// the handler gets the 12 byte slice of the reply that belongs to its (hex) info hash
+	void queue_scrape(const QHostAddress & address, std::uint16_t port, const QObject * context, const QByteArray & info_sha1_hash, Reply_handler on_reply) noexcept;
+	// drops every request and queued scrape of the context without calling its handlers
+	void cancel_requests(const QObject * context) noexcept;
+
+private:
+	using Tracker_endpoint = std::pair<QHostAddress, std::uint16_t>;
+
+	struct Request {
+		Tracker_endpoint tracker_endpoint;
+		QPointer<const QObject> context; // null for connect requests, which belong to the endpoint itself
+		Request_crafter craft_request;
+		Reply_handler on_reply;
+		QByteArray packet; // raw, the one in flight
+		std::chrono::steady_clock::time_point connected_time;
+		std::int64_t deadline_tick = 0;
+		std::int32_t timeout_factor = 0;
+		bool is_connect = false;
+	};
+
+	struct Queued_scrape {
+		QPointer<const QObject> context;
+		QByteArray info_sha1_hash;
+		Reply_handler on_reply;
+	};
+
+	struct Connection {
+		std::int64_t id = 0;
+		std::chrono::steady_clock::time_point connected_time;
+	};
+
+	static QByteArray craft_connect_request() noexcept;
+	std::int32_t unique_txn_id() const noexcept;
+	std::optional<Connection> cached_connection(const Tracker_endpoint & tracker_endpoint) const noexcept;
+	void connect_then_send(Request request) noexcept;
+	void send_with_connection(Request request, const Connection & connection) noexcept;
+	void transmit(std::int32_t txn_id, Request request) noexcept;
+	void schedule_timeout(std::int32_t txn_id) noexcept;
+	void on_ready_read() noexcept;
+	void on_reply_received(const QByteArray & reply, const QHostAddress & address, std::uint16_t port) noexcept;
+	void on_connect_finished(const Tracker_endpoint & tracker_endpoint, const std::optional<QByteArray> & reply) noexcept;
+	void on_tick() noexcept;
+	void send_scrapes() noexcept;
+	///
+	constexpr static qsizetype timer_wheel_slot_cnt = 64;
+	constexpr static std::int32_t max_timeout_factor = 8;
+	constexpr static std::chrono::minutes connection_id_ttl{1};
+	constexpr static std::chrono::seconds scrape_batch_delay{5};
+	constexpr static qsizetype max_scrape_hash_cnt = 74; // keeps the packet within 1500 bytes
+	inline static QPointer<Udp_tracker_endpoint> instance_;
+	QUdpSocket udp_socket_;
+	QTimer tick_timer_;
+	QTimer scrape_batch_timer_;
+	QHash<std::int32_t, Request> requests_;				      // {txn_id,request}
+	QHash<Tracker_endpoint, Connection> connections_;		      // valid for connection_id_ttl
+	QHash<Tracker_endpoint, QList<Request>> requests_awaiting_connection_; // while a connect is in flight
+	QHash<Tracker_endpoint, QList<Queued_scrape>> queued_scrapes_;
+	std::array<QList<std::int32_t>, timer_wheel_slot_cnt> timer_wheel_;
+	std::int64_t current_tick_ = 0;
+};
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <QUdpSocket>
+#include <QObject>
+#include <QHash>
+
+class Utp_socket;
+
+// owns the udp socket shared by every uTP connection and routes datagrams to them by {peer endpoint,connection id}
+class Utp_multiplexer : public QObject {
+	Q_OBJECT
+public:
+	explicit Utp_multiplexer(std::uint16_t port, QObject * parent = nullptr);
+
+	bool is_bound() const noexcept {
+		return udp_socket_.state() == QUdpSocket::SocketState::BoundState;
+	}
+
+	std::uint16_t local_port() const noexcept {
+		return udp_socket_.localPort();
+	}
+
+	std::uint16_t unused_connection_id(const QHostAddress & peer_address, std::uint16_t peer_port) const noexcept;
+	void register_socket(Utp_socket * socket) noexcept;
+	void unregister_socket(const Utp_socket * socket) noexcept;
+	void send_datagram(const QByteArray & datagram, const QHostAddress & peer_address, std::uint16_t peer_port) noexcept;
+signals:
+	void incoming_connection(Utp_socket * socket) const;
+
+private:
+	static QByteArray connection_key(const QHostAddress & peer_address, std::uint16_t peer_port, std::uint16_t connection_id) noexcept;
+	void on_ready_read() noexcept;
+	///
+	QHash<QByteArray, Utp_socket *> sockets_;
+	QUdpSocket udp_socket_;
+};
\ No newline at end of file
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "tcp_socket.h"
+
+#include <QPointer>
+#include <QHash>
+
+class Utp_multiplexer;
+
+// BEP 29 stream carried over the shared uTP udp socket and exposed through the Tcp_socket interface, so that Peer_wire_client
+// treats both transports alike. congestion control is LEDBAT: the window grows while the one-way queuing delay measured by
+// the peer stays under the target and shrinks above it, which keeps router buffers (and everyone else's latency) low
+class Utp_socket : public Tcp_socket {
+	Q_OBJECT
+public:
+	enum class Packet_Type : std::uint8_t {
+		Data,
+		Fin,
+		State,
+		Reset,
+		Syn
+	};
+
+	struct Header {
+		Packet_Type type = Packet_Type::Data;
+		std::uint16_t connection_id = 0;
+		std::uint32_t timestamp_us = 0;
+		std::uint32_t timestamp_diff_us = 0;
+		std::uint32_t wnd_size = 0;
+		std::uint16_t seq_nr = 0;
+		std::uint16_t ack_nr = 0;
+		qsizetype payload_offset = 0; // past the extension chain
+		QByteArray selective_acks;    // bit i stands for ack_nr + 2 + i, empty without the extension
+	};
+
+	// dials peer_url
+	Utp_socket(QUrl peer_url, Utp_multiplexer * multiplexer, QObject * parent);
+	// answers the SYN of a remote peer
+	Utp_socket(const QHostAddress & peer_address, std::uint16_t peer_port, const Header & syn_header, Utp_multiplexer * multiplexer, QObject * parent);
+	~Utp_socket() override;
+
+	static std::optional<Header> parse_header(const QByteArray & datagram) noexcept;
+
+	std::uint16_t receive_connection_id() const noexcept {
+		return recv_connection_id_;
+	}
+
+	QHostAddress peer_host_address() const noexcept {
+		return peer_host_address_;
+	}
+
+	std::uint16_t peer_host_port() const noexcept {
+		return peer_host_port_;
+	}
+
+	qint64 bytesAvailable() const override;
+	void disconnectFromHost() override;
+	void on_packet_received(const Header & header, const QByteArray & payload) noexcept;
+
+protected:
+	qint64 readData(char * data, qint64 max_size) override;
+	qint64 writeData(const char * data, qint64 size) override;
+
+private:
+	struct Outgoing_packet {
+		QByteArray payload;
+		Packet_Type type = Packet_Type::Data;
+		std::chrono::steady_clock::time_point sent_time;
+		std::int32_t transmission_cnt = 0;
+	};
+
+	static bool is_seq_less(std::uint16_t lhs, std::uint16_t rhs) noexcept {
+		return static_cast<std::int16_t>(lhs - rhs) < 0;
+	}
+
+	static std::uint32_t timestamp_us() noexcept;
+	static std::uint16_t random_seq_nr() noexcept;
+	static QUrl make_peer_url(const QHostAddress & peer_address, std::uint16_t peer_port) noexcept;
+
+	void configure_utp_connections() noexcept;
+	QByteArray craft_selective_acks() const noexcept;
+	void send(Packet_Type type, std::uint16_t seq_nr, const QByteArray & payload = {}) noexcept;
+	void transmit(std::uint16_t seq_nr) noexcept;
+	void flush_send_buffer() noexcept;
+	void on_ack_received(const Header & header) noexcept;
+	std::int64_t on_selective_acks_received(const Header & header) noexcept;
+	void on_data_received(const Header & header, const QByteArray & payload) noexcept;
+	void on_retransmit_timeout() noexcept;
+	void update_congestion_window(std::int64_t acked_byte_cnt, std::uint32_t peer_delay_us) noexcept;
+	void fail(QAbstractSocket::SocketError socket_error, const QString & error_string) noexcept;
+	void close_connection() noexcept;
+
+	std::int64_t send_window() const noexcept {
+		return std::min<std::int64_t>(static_cast<std::int64_t>(cwnd_), peer_wnd_size_);
+	}
+
+	// closing keeps the connection up until what was written before disconnectFromHost() and the FIN are acked
+	bool is_established() const noexcept {
+		return state() == SocketState::ConnectedState || state() == SocketState::ClosingState;
+	}
+
+	std::int64_t receive_window() const noexcept {
+		return std::max<std::int64_t>(0, max_receive_buffer_size - receive_buffer_.size());
+	}
+	///
+	constexpr static qsizetype header_size = 20;
+	constexpr static std::uint8_t utp_version = 1;
+	constexpr static std::uint8_t selective_ack_extension = 1;
+	constexpr static qsizetype max_selective_ack_size = 32; // bytes of the bitmask, whole multiples of 4
+	constexpr static std::int64_t max_payload_size = 1400;
+	constexpr static std::int64_t max_receive_buffer_size = 1 << 20;
+	constexpr static std::int64_t max_cwnd = 1 << 20;
+	constexpr static std::uint32_t target_delay_us = 100'000;
+	constexpr static std::int32_t max_syn_transmission_cnt = 3;
+	constexpr static std::int32_t max_transmission_cnt = 6;
+	constexpr static std::int32_t duplicate_ack_threshold = 3;
+	constexpr static qsizetype max_reordered_packet_cnt = 1024;
+	QPointer<Utp_multiplexer> multiplexer_;
+	QHash<std::uint16_t, Outgoing_packet> outgoing_packets_; // sent but not acked yet, {seq_nr,packet}
+	QHash<std::uint16_t, QByteArray> reordered_payloads_;	   // arrived ahead of ack_nr_ + 1
+	QList<std::uint32_t> base_delays_us_;			   // lowest delay seen in each of the last two minutes
+	QByteArray send_buffer_;
+	QByteArray receive_buffer_;
+	QHostAddress peer_host_address_;
+	QTimer retransmit_timer_;
+	QTimer base_delay_timer_;
+	std::chrono::milliseconds rto_{1000};
+	std::chrono::microseconds rtt_{};
+	std::chrono::microseconds rtt_var_{};
+	std::optional<std::uint16_t> fin_seq_nr_;
+	double cwnd_ = 2 * max_payload_size;
+	std::int64_t in_flight_byte_cnt_ = 0;
+	std::int64_t peer_wnd_size_ = max_payload_size;
+	std::uint32_t reply_micro_ = 0; // timestamp_diff_us echoed back to the peer
+	std::uint16_t peer_host_port_ = 0;
+	std::uint16_t recv_connection_id_ = 0;
+	std::uint16_t send_connection_id_ = 0;
+	std::uint16_t seq_nr_ = 1;
+	std::uint16_t ack_nr_ = 0;
+	std::uint16_t last_ack_nr_ = 0;
+	std::int32_t duplicate_ack_cnt_ = 0;
+	bool fin_queued_ = false;
+};
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <bencode_parser.h>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QElapsedTimer>
+#include <QPointer>
+#include <QObject>
+#include <QUrl>
+
+// one BEP 19 http mirror. Peer_wire_client hands it a run of whole pieces; the run is fetched with one range request per file it
+// spans and handed back in one buffer, verification stays with the client
+class Web_seed : public QObject {
+	Q_OBJECT
+public:
+	struct File_range {
+		qsizetype file_idx = 0;
+		std::int64_t file_offset = 0;
+		std::int64_t byte_cnt = 0;
+	};
+
+	Web_seed(QUrl url, const bencode::Metadata & torrent_metadata, QNetworkAccessManager * network_manager, QObject * parent = nullptr);
+
+	const QUrl & url() const noexcept {
+		return url_;
+	}
+
+	bool has_failed() const noexcept {
+		return failure_cnt_ >= max_failure_cnt;
+	}
+
+	// not fetching and not backing off after a failure
+	bool is_idle() const noexcept {
+		return !piece_cnt_ && (!failure_cnt_ || retry_timer_.hasExpired(std::chrono::milliseconds(retry_delay()).count()));
+	}
+
+	void fetch(std::int32_t first_piece_idx, std::int32_t piece_cnt, QList<File_range> file_ranges) noexcept;
+	void on_pieces_rejected() noexcept;
+	void stop() noexcept;
+signals:
+	void pieces_received(std::int32_t first_piece_idx, std::int32_t piece_cnt, const QByteArray & pieces) const;
+	void fetch_failed(std::int32_t first_piece_idx, std::int32_t piece_cnt) const;
+
+private:
+	static QList<QUrl> file_urls(const QUrl & url, const bencode::Metadata & torrent_metadata) noexcept;
+	void fetch_next_range() noexcept;
+	void on_range_finished(QNetworkReply * network_reply, const File_range & file_range) noexcept;
+	void fail_fetch() noexcept;
+
+	std::chrono::seconds retry_delay() const noexcept {
+		return retry_delay_unit * failure_cnt_;
+	}
+	///
+	constexpr static std::int32_t max_failure_cnt = 5;
+	constexpr static std::chrono::seconds retry_delay_unit{30};
+	constexpr static std::chrono::seconds transfer_timeout{30};
+	QUrl url_;
+	QList<QUrl> file_urls_; // torrent file order
+	QPointer<QNetworkAccessManager> network_manager_;
+	QPointer<QNetworkReply> fetch_reply_;
+	QList<File_range> file_ranges_; // still to be fetched for the current run
+	QByteArray pieces_; // the run in flight, outside of Piece_buffer_pool (Peer_wire_client caps a run at 4 MiB)
+	QElapsedTimer retry_timer_;
+	std::int32_t first_piece_idx_ = 0;
+	std::int32_t piece_cnt_ = 0; // of the run in flight
+	std::int32_t failure_cnt_ = 0;
+};
\ No newline at end of file
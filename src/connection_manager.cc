@@ -0,0 +1,230 @@
+#include "connection_manager.h"
+#include "utp_socket.h"
+
+#include <QHostAddress>
+#include <QSettings>
+#include <QPointer>
+
+Connection_manager::Connection_manager(QObject * const parent) : QObject(parent) {
+	QSettings settings;
+	settings.beginGroup("network");
+
+	max_connection_cnt_ = std::max(1, qvariant_cast<std::int32_t>(settings.value("max_connections", 300)));
+	max_torrent_connection_cnt_ = std::max(1, qvariant_cast<std::int32_t>(settings.value("max_connections_per_torrent", 60)));
+	max_half_open_cnt_ = std::max(1, qvariant_cast<std::int32_t>(settings.value("max_half_open_connections", 16)));
+	prefer_utp_ = qvariant_cast<bool>(settings.value("prefer_utp", false));
+	ipv6_enabled_ = qvariant_cast<bool>(settings.value("enable_ipv6", true));
+	connect_timeout_ = std::chrono::seconds(std::max(1, qvariant_cast<std::int32_t>(settings.value("connect_timeout_seconds", 10))));
+
+	dial_timer_.callOnTimeout(this, &Connection_manager::dial_candidates);
+	replacement_timer_.callOnTimeout(this, &Connection_manager::replace_poor_peer);
+
+	dial_timer_.start(std::chrono::milliseconds(250));
+	replacement_timer_.start(std::chrono::minutes(1));
+}
+
+Connection_manager::~Connection_manager() {
+	global_connection_cnt_ -= connection_count();
+	global_half_open_cnt_ -= half_open_count();
+	global_handshaking_cnt_ -= handshaking_count();
+	assert(global_connection_cnt_ >= 0 && global_half_open_cnt_ >= 0 && global_handshaking_cnt_ >= 0);
+}
+
+QUrl Connection_manager::normalized_peer_url(const QUrl & peer_url) noexcept {
+	QHostAddress peer_address(peer_url.host());
+
+	if(peer_address.isNull()) {
+		return {};
+	}
+
+	// one spelling per peer, so that "::ffff:1.2.3.4" and "1.2.3.4" (or differently cased IPv6) are not dialed twice
+	bool is_ipv4_mapped = false;
+
+	if(const auto ipv4_address = peer_address.toIPv4Address(&is_ipv4_mapped); is_ipv4_mapped) {
+		peer_address = QHostAddress(ipv4_address);
+	}
+
+	QUrl normalized_url;
+	normalized_url.setHost(peer_address.toString());
+	normalized_url.setPort(peer_url.port());
+	return normalized_url;
+}
+
+bool Connection_manager::can_accept() const noexcept {
+	// peers that accept the connect but never handshake hold their slot until they are dropped
+	return !paused_ && connection_count() + half_open_count() + handshaking_count() < max_torrent_connection_cnt_ &&
+		 global_connection_cnt_ + global_handshaking_cnt_ < max_connection_cnt_;
+}
+
+void Connection_manager::add_candidates(const QList<QUrl> & peer_urls, const Priority priority) noexcept {
+	qsizetype high_priority_insert_idx = 0;
+
+	std::ranges::for_each(peer_urls, [this, priority, &high_priority_insert_idx](const QUrl & candidate_url) {
+		const auto peer_url = normalized_peer_url(candidate_url);
+
+		if(!peer_url.isValid() || known_peers_.contains(peer_url)) {
+			return;
+		}
+
+		// pex and trackers can hand out far more peers than will ever be dialed
+		if(priority == Priority::Normal && candidates_.size() >= max_candidate_cnt) {
+			return;
+		}
+
+		if(!ipv6_enabled_ && QHostAddress(peer_url.host()).protocol() == QAbstractSocket::NetworkLayerProtocol::IPv6Protocol) {
+			return;
+		}
+
+		known_peers_.insert(peer_url);
+
+		if(priority == Priority::High) {
+			candidates_.insert(high_priority_insert_idx++, peer_url);
+		} else {
+			candidates_.push_back(peer_url);
+		}
+	});
+
+	dial_candidates();
+}
+
+void Connection_manager::set_paused(const bool paused) noexcept {
+	paused_ = paused;
+	paused_ ? dial_timer_.stop() : dial_timer_.start();
+}
+
+void Connection_manager::dial_candidates() noexcept {
+
+	auto can_dial = [this] {
+		return !paused_ && !candidates_.isEmpty() && can_accept() && global_half_open_cnt_ < max_half_open_cnt_ &&
+			 global_connection_cnt_ + global_half_open_cnt_ + global_handshaking_cnt_ < max_connection_cnt_;
+	};
+
+	while(can_dial()) {
+		emit dial_requested(candidates_.takeFirst());
+	}
+}
+
+void Connection_manager::on_dial_started(Tcp_socket * const socket) noexcept {
+	assert(socket);
+	assert(!half_open_sockets_.contains(socket));
+
+	half_open_sockets_.insert(socket);
+	++global_half_open_cnt_;
+
+	connect(socket, &Tcp_socket::connected, this, [this, socket] {
+		if(half_open_sockets_.remove(socket)) {
+			--global_half_open_cnt_;
+			handshaking_sockets_.insert(socket);
+			++global_handshaking_cnt_;
+		}
+	});
+
+	connect(socket, &Tcp_socket::errorOccurred, this, [socket] {
+		if(socket->state() != Tcp_socket::SocketState::ConnectedState) {
+			socket->deleteLater();
+		}
+	});
+
+	QTimer::singleShot(connect_timeout_, socket, [socket] {
+		if(socket->state() != Tcp_socket::SocketState::ConnectedState) {
+			qDebug() << "connect timed out" << socket->peer_url();
+			socket->abort();
+			socket->deleteLater();
+		}
+	});
+
+	connect(socket, &Tcp_socket::destroyed, this, [this, socket, peer_url = socket->peer_url(), is_utp = qobject_cast<Utp_socket *>(socket) != nullptr] {
+		const auto utp_dial_failed = is_utp && half_open_sockets_.contains(socket);
+		forget_socket(socket, peer_url);
+
+		if(utp_dial_failed) { // likely filtered udp, try again over tcp
+			tcp_only_peers_.insert(peer_url);
+			add_candidates({peer_url}, Priority::High);
+		}
+	});
+}
+
+void Connection_manager::on_peer_accepted(Tcp_socket * const socket) noexcept {
+	assert(socket);
+	known_peers_.insert(socket->peer_url());
+
+	connect(socket, &Tcp_socket::destroyed, this, [this, socket, peer_url = socket->peer_url()] {
+		forget_socket(socket, peer_url);
+	});
+
+	on_peer_established(socket);
+}
+
+void Connection_manager::on_peer_established(Tcp_socket * const socket) noexcept {
+	assert(socket);
+	assert(!half_open_sockets_.contains(socket));
+
+	if(established_sockets_.contains(socket)) {
+		return;
+	}
+
+	if(handshaking_sockets_.remove(socket)) {
+		--global_handshaking_cnt_;
+	}
+
+	established_sockets_.insert(socket);
+	last_dled_byte_cnts_[socket] = socket->downloaded_byte_count();
+	++global_connection_cnt_;
+
+	connect(socket, &Tcp_socket::disconnected, this, [this, socket, peer_url = socket->peer_url()] {
+		forget_socket(socket, peer_url);
+	});
+}
+
+// the socket lives on with another client (magnet download -> download)
+void Connection_manager::release(Tcp_socket * const socket) noexcept {
+	assert(socket);
+	socket->disconnect(this);
+	forget_socket(socket, socket->peer_url());
+}
+
+void Connection_manager::forget_socket(Tcp_socket * const socket, const QUrl & peer_url) noexcept {
+	// the socket may be mid-destruction; only its address is used. forgetting the url lets a later tracker reply bring it back
+	known_peers_.remove(peer_url);
+
+	if(half_open_sockets_.remove(socket)) {
+		--global_half_open_cnt_;
+	}
+
+	if(handshaking_sockets_.remove(socket)) {
+		--global_handshaking_cnt_;
+	}
+
+	if(established_sockets_.remove(socket)) {
+		--global_connection_cnt_;
+	}
+
+	last_dled_byte_cnts_.remove(socket);
+	assert(global_connection_cnt_ >= 0 && global_half_open_cnt_ >= 0 && global_handshaking_cnt_ >= 0);
+
+	QTimer::singleShot(0, this, &Connection_manager::dial_candidates);
+}
+
+void Connection_manager::replace_poor_peer() noexcept {
+
+	if(candidates_.isEmpty() || can_accept()) {
+		return;
+	}
+
+	Tcp_socket * poorest_socket = nullptr;
+
+	for(auto * const socket : std::as_const(established_sockets_)) {
+		const auto dled_byte_delta = socket->downloaded_byte_count() - last_dled_byte_cnts_.value(socket);
+		last_dled_byte_cnts_[socket] = socket->downloaded_byte_count();
+
+		// peers that neither send us anything nor want anything from us
+		if(!dled_byte_delta && !socket->peer_interested && !poorest_socket) {
+			poorest_socket = socket;
+		}
+	}
+
+	if(poorest_socket) {
+		qDebug() << "replacing idle peer" << poorest_socket->peer_url();
+		poorest_socket->disconnectFromHost();
+	}
+}
\ No newline at end of file
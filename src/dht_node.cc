@@ -0,0 +1,744 @@
+#include "dht_node.h"
+#include "peer_listener.h"
+#include "util.h"
+
+#include <QCryptographicHash>
+#include <QNetworkDatagram>
+#include <QRandomGenerator>
+#include <QHostInfo>
+#include <QSettings>
+#include <numeric>
+#include <bit>
+
+Dht_node::Dht_node(QObject * const parent) : QObject(parent) {
+
+	if(!is_enabled()) {
+		return;
+	}
+
+	if(!udp_socket_.bind(QHostAddress::AnyIPv4, dht_port())) {
+		qDebug() << "could not bind the DHT socket on port" << dht_port() << udp_socket_.errorString();
+		return;
+	}
+
+	instance_ = this;
+	read_node_cache();
+
+	auto random_bytes = [](const qsizetype byte_cnt) {
+		QByteArray bytes(byte_cnt, '\0');
+		QRandomGenerator::system()->fillRange(reinterpret_cast<quint32 *>(bytes.data()), byte_cnt / static_cast<qsizetype>(sizeof(quint32)));
+		return bytes;
+	};
+
+	if(id_.size() != node_id_size) {
+		id_ = random_bytes(node_id_size);
+	}
+
+	secret_ = random_bytes(8);
+	previous_secret_ = secret_;
+
+	connect(&udp_socket_, &QUdpSocket::readyRead, this, &Dht_node::on_ready_read);
+	maintenance_timer_.callOnTimeout(this, &Dht_node::maintain);
+	announce_timer_.callOnTimeout(this, &Dht_node::announce_torrents);
+
+	timeout_timer_.callOnTimeout(this, [this] {
+		QList<QByteArray> expired_txn_ids;
+
+		for(auto query_itr = pending_queries_.cbegin(); query_itr != pending_queries_.cend(); ++query_itr) {
+			if(query_itr->sent_timer.hasExpired(std::chrono::milliseconds(query_timeout).count())) {
+				expired_txn_ids.push_back(query_itr.key());
+			}
+		}
+
+		std::ranges::for_each(expired_txn_ids, [this](const QByteArray & txn_id) {
+			on_query_failed(txn_id);
+		});
+	});
+
+	// tokens handed out stay valid for one rotation after their secret is replaced
+	secret_timer_.callOnTimeout(this, [this, random_bytes] {
+		previous_secret_ = std::exchange(secret_, random_bytes(8));
+	});
+
+	timeout_timer_.start(std::chrono::seconds(1));
+	maintenance_timer_.start(std::chrono::minutes(1));
+	announce_timer_.start(node_refresh_interval);
+	secret_timer_.start(std::chrono::minutes(5));
+
+	bootstrap();
+}
+
+Dht_node::~Dht_node() {
+
+	if(instance_ == this) {
+		write_node_cache();
+	}
+}
+
+std::uint16_t Dht_node::dht_port() noexcept {
+	QSettings settings;
+	settings.beginGroup("network");
+	return qvariant_cast<std::uint16_t>(settings.value("dht_port", default_dht_port));
+}
+
+bool Dht_node::is_enabled() noexcept {
+	QSettings settings;
+	settings.beginGroup("network");
+	return qvariant_cast<bool>(settings.value("enable_dht", true));
+}
+
+qsizetype Dht_node::node_count() const noexcept {
+	return std::accumulate(buckets_.cbegin(), buckets_.cend(), qsizetype{0}, [](const qsizetype node_cnt, const QList<Node> & bucket) {
+		return node_cnt + bucket.size();
+	});
+}
+
+void Dht_node::add_torrent(const QByteArray & info_sha1_hash) noexcept {
+	assert(info_sha1_hash.size() == node_id_size * 2);
+	const auto info_hash = QByteArray::fromHex(info_sha1_hash);
+
+	if(torrents_.contains(info_hash)) {
+		return;
+	}
+
+	torrents_.insert(info_hash);
+
+	// lookups before the bootstrap completes would find nothing; they are started once it does
+	if(bootstrapped_) {
+		start_lookup(info_hash, true, true);
+	}
+}
+
+void Dht_node::remove_torrent(const QByteArray & info_sha1_hash) noexcept {
+	torrents_.remove(QByteArray::fromHex(info_sha1_hash));
+}
+
+void Dht_node::add_node(const QHostAddress & address, const std::uint16_t port) noexcept {
+
+	if(port && address.protocol() == QAbstractSocket::NetworkLayerProtocol::IPv4Protocol) {
+		send_query(Query_Type::Ping, "2:id" + bencoded_string(id_), address, port);
+	}
+}
+
+QByteArray Dht_node::distance(const QByteArray & lhs, const QByteArray & rhs) noexcept {
+	assert(lhs.size() == node_id_size && rhs.size() == node_id_size);
+	QByteArray xor_distance(node_id_size, '\0');
+
+	for(qsizetype byte_idx = 0; byte_idx < node_id_size; ++byte_idx) {
+		xor_distance[byte_idx] = static_cast<char>(lhs[byte_idx] ^ rhs[byte_idx]);
+	}
+
+	return xor_distance;
+}
+
+QByteArray Dht_node::compact_endpoint(const QHostAddress & address, const std::uint16_t port) noexcept {
+	using util::conversion::convert_to_hex;
+	return QByteArray::fromHex(convert_to_hex(address.toIPv4Address()) + convert_to_hex(port));
+}
+
+QByteArray Dht_node::bencoded_string(const QByteArray & str) noexcept {
+	return QByteArray::number(str.size()) + ':' + str;
+}
+
+std::optional<QByteArray> Dht_node::extract_string(const bencode::dictionary & dict, const std::string & key) noexcept {
+
+	if(const auto value_itr = dict.find(key); value_itr != dict.end()) {
+		if(const auto * const value = std::any_cast<std::string>(&value_itr->second)) {
+			return QByteArray(value->data(), static_cast<qsizetype>(value->size()));
+		}
+	}
+
+	return {};
+}
+
+std::optional<std::int64_t> Dht_node::extract_integer(const bencode::dictionary & dict, const std::string & key) noexcept {
+
+	if(const auto value_itr = dict.find(key); value_itr != dict.end()) {
+		if(const auto * const value = std::any_cast<std::int64_t>(&value_itr->second)) {
+			return *value;
+		}
+	}
+
+	return {};
+}
+
+std::optional<bencode::dictionary> Dht_node::extract_dictionary(const bencode::dictionary & dict, const std::string & key) noexcept {
+
+	if(const auto value_itr = dict.find(key); value_itr != dict.end()) {
+		if(const auto * const value = std::any_cast<bencode::dictionary>(&value_itr->second)) {
+			return *value;
+		}
+	}
+
+	return {};
+}
+
+qsizetype Dht_node::bucket_index(const QByteArray & node_id) const noexcept {
+	const auto node_distance = distance(id_, node_id);
+
+	// nodes sharing a longer prefix with us land in higher buckets, so that the table is denser around our own id
+	for(qsizetype byte_idx = 0; byte_idx < node_id_size; ++byte_idx) {
+		if(const auto distance_byte = static_cast<std::uint8_t>(node_distance[byte_idx])) {
+			return byte_idx * 8 + std::countl_zero(distance_byte);
+		}
+	}
+
+	return bucket_cnt - 1;
+}
+
+QList<Dht_node::Node> Dht_node::closest_nodes(const QByteArray & target, const qsizetype node_cnt) const noexcept {
+	QMap<QByteArray, Node> sorted_nodes; // {distance to target,node}
+
+	for(const auto & bucket : buckets_) {
+		for(const auto & node : bucket) {
+			sorted_nodes.insert(distance(target, node.id), node);
+		}
+	}
+
+	return sorted_nodes.values().first(std::min(node_cnt, sorted_nodes.size()));
+}
+
+QByteArray Dht_node::compact_nodes(const QByteArray & target) const noexcept {
+	QByteArray nodes;
+
+	for(const auto & node : closest_nodes(target, bucket_size)) {
+		nodes += node.id + compact_endpoint(node.address, node.port);
+	}
+
+	return nodes;
+}
+
+QByteArray Dht_node::token(const QHostAddress & address, const QByteArray & secret) const noexcept {
+	constexpr auto token_size = 8;
+	return QCryptographicHash::hash(secret + address.toString().toLatin1(), QCryptographicHash::Sha1).first(token_size);
+}
+
+void Dht_node::on_ready_read() noexcept {
+
+	while(udp_socket_.hasPendingDatagrams()) {
+		const auto datagram = udp_socket_.receiveDatagram();
+		const auto address = datagram.senderAddress();
+		const auto port = static_cast<std::uint16_t>(datagram.senderPort());
+
+		try {
+			const auto message = bencode::parse_content(datagram.data());
+			const auto message_type = extract_string(message, "y");
+
+			if(message_type == "q") {
+				on_query_received(message, address, port);
+			} else if(message_type == "r") {
+				on_response_received(message, address, port);
+			} else if(const auto txn_id = extract_string(message, "t"); message_type == "e" && txn_id && pending_queries_.contains(*txn_id)) {
+				qDebug() << "DHT node replied with an error" << address << port;
+				on_query_failed(*txn_id);
+			}
+		} catch(const std::exception & exception) {
+			qDebug() << "invalid DHT message" << exception.what();
+		}
+	}
+}
+
+void Dht_node::on_query_received(const bencode::dictionary & message, const QHostAddress & address, const std::uint16_t port) noexcept {
+	const auto txn_id = extract_string(message, "t");
+	const auto query_name = extract_string(message, "q");
+	const auto arguments = extract_dictionary(message, "a");
+
+	if(!txn_id || !query_name || !arguments) {
+		return;
+	}
+
+	const auto node_id = extract_string(*arguments, "id");
+
+	if(!node_id || node_id->size() != node_id_size) {
+		return send_error(*txn_id, 203, "invalid node id", address, port);
+	}
+
+	// BEP 43 read-only nodes never answer queries, keep them out of the table
+	if(extract_integer(*arguments, "ro") != 1) {
+		on_node_seen(*node_id, address, port);
+	}
+
+	const auto id_response = "2:id" + bencoded_string(id_);
+
+	if(query_name == "ping") {
+		return send_response(*txn_id, id_response, address, port);
+	}
+
+	if(query_name == "find_node") {
+		const auto target = extract_string(*arguments, "target");
+
+		if(!target || target->size() != node_id_size) {
+			return send_error(*txn_id, 203, "invalid target", address, port);
+		}
+
+		return send_response(*txn_id, id_response + "5:nodes" + bencoded_string(compact_nodes(*target)), address, port);
+	}
+
+	if(query_name == "get_peers") {
+		const auto info_hash = extract_string(*arguments, "info_hash");
+
+		if(!info_hash || info_hash->size() != node_id_size) {
+			return send_error(*txn_id, 203, "invalid info_hash", address, port);
+		}
+
+		auto response = id_response + "5:nodes" + bencoded_string(compact_nodes(*info_hash)) + "5:token" + bencoded_string(token(address, secret_));
+
+		if(const auto peers_itr = stored_peers_.constFind(*info_hash); peers_itr != stored_peers_.cend() && !peers_itr->isEmpty()) {
+			QByteArray values;
+			qsizetype value_cnt = 0;
+
+			for(auto peer_itr = peers_itr->cbegin(); peer_itr != peers_itr->cend() && value_cnt < max_peer_value_cnt; ++peer_itr, ++value_cnt) {
+				values += bencoded_string(peer_itr.key());
+			}
+
+			response += "6:valuesl" + values + 'e';
+		}
+
+		return send_response(*txn_id, response, address, port);
+	}
+
+	if(query_name == "announce_peer") {
+		const auto info_hash = extract_string(*arguments, "info_hash");
+		const auto received_token = extract_string(*arguments, "token");
+		const auto peer_port = extract_integer(*arguments, "implied_port") == 1 ? std::optional<std::int64_t>(port) : extract_integer(*arguments, "port");
+
+		if(!info_hash || info_hash->size() != node_id_size || !peer_port || *peer_port <= 0 || *peer_port > std::numeric_limits<std::uint16_t>::max()) {
+			return send_error(*txn_id, 203, "invalid announce", address, port);
+		}
+
+		if(!received_token || (*received_token != token(address, secret_) && *received_token != token(address, previous_secret_))) {
+			return send_error(*txn_id, 203, "bad token", address, port);
+		}
+
+		if(!stored_peers_.contains(*info_hash) && stored_peers_.size() >= max_stored_torrent_cnt) {
+			return send_error(*txn_id, 202, "peer store is full", address, port);
+		}
+
+		if(auto & peers = stored_peers_[*info_hash]; peers.size() < max_stored_peer_cnt || peers.contains(compact_endpoint(address, static_cast<std::uint16_t>(*peer_port)))) {
+			peers[compact_endpoint(address, static_cast<std::uint16_t>(*peer_port))] = std::chrono::steady_clock::now();
+		}
+
+		return send_response(*txn_id, id_response, address, port);
+	}
+
+	send_error(*txn_id, 204, "method unknown", address, port);
+}
+
+void Dht_node::on_response_received(const bencode::dictionary & message, const QHostAddress & address, const std::uint16_t port) noexcept {
+	const auto txn_id = extract_string(message, "t");
+
+	if(!txn_id) {
+		return;
+	}
+
+	const auto query_itr = pending_queries_.constFind(*txn_id);
+
+	// replies have to come from where the query went, otherwise anyone could inject nodes into our lookups
+	if(query_itr == pending_queries_.cend() || query_itr->address != address || query_itr->port != port) {
+		return;
+	}
+
+	const auto response = extract_dictionary(message, "r");
+	const auto node_id = response ? extract_string(*response, "id") : std::nullopt;
+
+	// counted as a failed query, so that the lookup it belongs to moves on instead of waiting for a timeout that no longer comes
+	if(!node_id || node_id->size() != node_id_size) {
+		qDebug() << "DHT node sent a response without a valid id" << address << port;
+		return on_query_failed(*txn_id);
+	}
+
+	const auto query = *query_itr;
+	pending_queries_.erase(query_itr);
+
+	on_node_seen(*node_id, address, port);
+
+	const auto lookup_itr = lookups_.find(query.target);
+
+	if(query.target.isEmpty() || lookup_itr == lookups_.end()) {
+		return;
+	}
+
+	auto & lookup = *lookup_itr;
+	--lookup.in_flight_cnt;
+	assert(lookup.in_flight_cnt >= 0);
+
+	const auto received_token = extract_string(*response, "token").value_or(QByteArray{});
+
+	if(const auto node_itr = lookup.closest_nodes.find(distance(lookup.target, *node_id)); node_itr != lookup.closest_nodes.end()) {
+		node_itr->responded = true;
+		node_itr->token = received_token;
+	} else if(query.node_id.isEmpty()) { // a bootstrap node, whose id we just learned
+		lookup.closest_nodes.insert(distance(lookup.target, *node_id), Lookup_node{*node_id, address, received_token, port, true, true});
+	}
+
+	if(const auto nodes = extract_string(*response, "nodes")) {
+		constexpr auto compact_node_size = node_id_size + compact_endpoint_size;
+
+		for(qsizetype node_offset = 0; node_offset + compact_node_size <= nodes->size(); node_offset += compact_node_size) {
+			const auto found_node_id = nodes->sliced(node_offset, node_id_size);
+			const QHostAddress found_node_address(util::extract_integer<std::uint32_t>(*nodes, node_offset + node_id_size));
+			const auto found_node_port = util::extract_integer<std::uint16_t>(*nodes, node_offset + node_id_size + 4);
+
+			if(found_node_id == id_ || !found_node_port || found_node_address.isNull()) {
+				continue;
+			}
+
+			if(const auto found_node_distance = distance(lookup.target, found_node_id); !lookup.closest_nodes.contains(found_node_distance)) {
+				lookup.closest_nodes.insert(found_node_distance, Lookup_node{found_node_id, found_node_address, {}, found_node_port});
+			}
+		}
+
+		while(lookup.closest_nodes.size() > max_lookup_node_cnt) {
+			lookup.closest_nodes.erase(std::prev(lookup.closest_nodes.end()));
+		}
+	}
+
+	if(query.type == Query_Type::Get_Peers) {
+
+		if(const auto values_itr = response->find("values"); values_itr != response->end()) {
+			QList<QUrl> peer_urls;
+
+			if(const auto * const values = std::any_cast<bencode::list>(&values_itr->second)) {
+				for(const auto & value : *values) {
+					const auto * const compact_peer = std::any_cast<std::string>(&value);
+
+					if(!compact_peer || static_cast<qsizetype>(compact_peer->size()) != compact_endpoint_size) {
+						continue;
+					}
+
+					const QByteArray raw_peer(compact_peer->data(), compact_endpoint_size);
+
+					QUrl peer_url;
+					peer_url.setHost(QHostAddress(util::extract_integer<std::uint32_t>(raw_peer, 0)).toString());
+					peer_url.setPort(util::extract_integer<std::uint16_t>(raw_peer, 4));
+
+					if(peer_url.isValid() && peer_url.port() > 0) {
+						peer_urls.push_back(std::move(peer_url));
+					}
+				}
+			}
+
+			if(!peer_urls.isEmpty()) {
+				emit peers_found(lookup.target.toHex(), peer_urls);
+			}
+		}
+	}
+
+	continue_lookup(query.target);
+}
+
+void Dht_node::on_query_failed(const QByteArray & txn_id) noexcept {
+	const auto query_itr = pending_queries_.constFind(txn_id);
+
+	if(query_itr == pending_queries_.cend()) {
+		return;
+	}
+
+	const auto query = *query_itr;
+	pending_queries_.erase(query_itr);
+
+	if(!query.node_id.isEmpty()) {
+		auto & bucket = buckets_[static_cast<std::size_t>(bucket_index(query.node_id))];
+
+		if(const auto node_itr = std::ranges::find(bucket, query.node_id, &Node::id); node_itr != bucket.end() && ++node_itr->failed_query_cnt >= max_failed_query_cnt) {
+			bucket.erase(node_itr);
+		}
+	}
+
+	if(const auto lookup_itr = lookups_.find(query.target); !query.target.isEmpty() && lookup_itr != lookups_.end()) {
+		--lookup_itr->in_flight_cnt;
+		assert(lookup_itr->in_flight_cnt >= 0);
+
+		// unresponsive nodes must not hold a place among the closest ones
+		if(!query.node_id.isEmpty()) {
+			lookup_itr->closest_nodes.remove(distance(query.target, query.node_id));
+		}
+
+		continue_lookup(query.target);
+	}
+}
+
+void Dht_node::on_node_seen(const QByteArray & node_id, const QHostAddress & address, const std::uint16_t port) noexcept {
+
+	if(node_id.size() != node_id_size || node_id == id_ || !port || address.protocol() != QAbstractSocket::NetworkLayerProtocol::IPv4Protocol) {
+		return;
+	}
+
+	auto & bucket = buckets_[static_cast<std::size_t>(bucket_index(node_id))];
+
+	if(const auto node_itr = std::ranges::find(bucket, node_id, &Node::id); node_itr != bucket.end()) {
+
+		// a known id showing up from elsewhere is ignored, so that spoofed packets can't redirect it
+		if(node_itr->address == address && node_itr->port == port) {
+			node_itr->last_seen_timer.start();
+			node_itr->failed_query_cnt = 0;
+		}
+
+		return;
+	}
+
+	if(bucket.size() >= bucket_size) {
+		// long lived nodes are preferred over new ones; only questionable (silent for a while) ones make room
+		const auto questionable_node_itr = std::ranges::find_if(bucket, [](const Node & node) {
+			return !node.last_seen_timer.isValid() || node.last_seen_timer.hasExpired(std::chrono::milliseconds(node_refresh_interval).count());
+		});
+
+		if(questionable_node_itr == bucket.end()) {
+			return;
+		}
+
+		bucket.erase(questionable_node_itr);
+	}
+
+	Node node{node_id, address, {}, port};
+	node.last_seen_timer.start();
+	bucket.push_back(std::move(node));
+}
+
+void Dht_node::send_query(const Query_Type type, const QByteArray & arguments, const QHostAddress & address, const std::uint16_t port, const QByteArray & node_id,
+				  const QByteArray & target) noexcept {
+	using util::conversion::convert_to_hex;
+
+	constexpr std::array<std::string_view, 4> query_names{"ping", "find_node", "get_peers", "announce_peer"};
+	const auto txn_id = QByteArray::fromHex(convert_to_hex(txn_cnt_++));
+	const auto query_name = query_names[static_cast<std::size_t>(type)];
+
+	const auto query = "d1:ad" + arguments + "e1:q" + bencoded_string(QByteArray(query_name.data(), static_cast<qsizetype>(query_name.size()))) + "1:t" +
+				 bencoded_string(txn_id) + "1:y1:qe";
+
+	Pending_query pending_query{type, node_id, target, address, {}, port};
+	pending_query.sent_timer.start();
+	pending_queries_[txn_id] = std::move(pending_query);
+
+	udp_socket_.writeDatagram(query, address, port);
+}
+
+void Dht_node::send_response(const QByteArray & txn_id, const QByteArray & response, const QHostAddress & address, const std::uint16_t port) noexcept {
+	udp_socket_.writeDatagram("d1:rd" + response + "e1:t" + bencoded_string(txn_id) + "1:y1:re", address, port);
+}
+
+void Dht_node::send_error(const QByteArray & txn_id, const std::int32_t error_code, const QByteArray & error_msg, const QHostAddress & address,
+				  const std::uint16_t port) noexcept {
+	udp_socket_.writeDatagram("d1:eli" + QByteArray::number(error_code) + 'e' + bencoded_string(error_msg) + "e1:t" + bencoded_string(txn_id) + "1:y1:ee", address, port);
+}
+
+void Dht_node::bootstrap() noexcept {
+
+	if(lookups_.contains(id_)) {
+		return;
+	}
+
+	// finding ourselves fills the buckets around our id, the ones other nodes ask us about the most
+	start_lookup(id_, false, false);
+
+	if(!lookups_.contains(id_)) { // nothing to ask in the routing table (first run or a stale cache)
+		lookups_.insert(id_, Lookup{id_});
+	}
+
+	const auto bootstrap_nodes = [] {
+		QSettings settings;
+		settings.beginGroup("dht");
+		return qvariant_cast<QStringList>(settings.value("bootstrap_nodes", QStringList{"router.bittorrent.com:6881", "dht.transmissionbt.com:6881", "router.utorrent.com:6881"}));
+	}();
+
+	for(const auto & bootstrap_node : bootstrap_nodes) {
+		const auto port_separator_idx = bootstrap_node.lastIndexOf(':');
+		const auto port = port_separator_idx == -1 ? 0 : bootstrap_node.sliced(port_separator_idx + 1).toUShort();
+
+		if(!port) {
+			qDebug() << "invalid DHT bootstrap node" << bootstrap_node;
+			continue;
+		}
+
+		++lookups_[id_].in_flight_cnt;
+
+		QHostInfo::lookupHost(bootstrap_node.first(port_separator_idx), this, [this, port](const QHostInfo & host_info) {
+			const auto lookup_itr = lookups_.find(id_);
+
+			if(lookup_itr == lookups_.end()) {
+				return;
+			}
+
+			const auto addresses = host_info.addresses();
+
+			if(const auto address_itr = std::ranges::find(addresses, QAbstractSocket::NetworkLayerProtocol::IPv4Protocol, &QHostAddress::protocol); address_itr != addresses.cend()) {
+				// stays in flight until the node answers or times out
+				return send_query(Query_Type::Find_Node, "2:id" + bencoded_string(id_) + "6:target" + bencoded_string(id_), *address_itr, port, {}, id_);
+			}
+
+			--lookup_itr->in_flight_cnt;
+			continue_lookup(id_);
+		});
+	}
+
+	continue_lookup(id_);
+}
+
+void Dht_node::start_lookup(const QByteArray & target, const bool get_peers, const bool announce) noexcept {
+
+	if(lookups_.contains(target)) {
+		return;
+	}
+
+	Lookup lookup{target, {}, 0, get_peers, announce};
+
+	for(const auto & node : closest_nodes(target, max_lookup_node_cnt)) {
+		lookup.closest_nodes.insert(distance(target, node.id), Lookup_node{node.id, node.address, {}, node.port});
+	}
+
+	if(lookup.closest_nodes.isEmpty()) {
+		return;
+	}
+
+	lookups_.insert(target, std::move(lookup));
+	continue_lookup(target);
+}
+
+void Dht_node::continue_lookup(const QByteArray & target) noexcept {
+	const auto lookup_itr = lookups_.find(target);
+
+	if(lookup_itr == lookups_.end()) {
+		return;
+	}
+
+	auto & lookup = *lookup_itr;
+	qsizetype closest_node_idx = 0;
+
+	// keep alpha queries in flight towards the k closest nodes we know of, until all of them answered
+	for(auto node_itr = lookup.closest_nodes.begin(); node_itr != lookup.closest_nodes.end() && closest_node_idx < bucket_size && lookup.in_flight_cnt < lookup_parallelism;
+	    ++node_itr, ++closest_node_idx) {
+
+		if(node_itr->queried) {
+			continue;
+		}
+
+		node_itr->queried = true;
+		++lookup.in_flight_cnt;
+
+		const auto arguments = "2:id" + bencoded_string(id_) + (lookup.get_peers ? "9:info_hash" : "6:target") + bencoded_string(target);
+		send_query(lookup.get_peers ? Query_Type::Get_Peers : Query_Type::Find_Node, arguments, node_itr->address, node_itr->port, node_itr->id, target);
+	}
+
+	const auto has_unqueried_node = [&lookup] {
+		qsizetype node_idx = 0;
+
+		for(auto node_itr = lookup.closest_nodes.cbegin(); node_itr != lookup.closest_nodes.cend() && node_idx < bucket_size; ++node_itr, ++node_idx) {
+			if(!node_itr->queried) {
+				return true;
+			}
+		}
+
+		return false;
+	}();
+
+	if(!lookup.in_flight_cnt && !has_unqueried_node) {
+		const auto finished_lookup = lookups_.take(target);
+		finish_lookup(finished_lookup);
+	}
+}
+
+void Dht_node::finish_lookup(const Lookup & lookup) noexcept {
+
+	if(lookup.announce && torrents_.contains(lookup.target)) {
+		const auto announce_arguments_tail = "9:info_hash" + bencoded_string(lookup.target) + "4:porti" + QByteArray::number(Peer_listener::listen_port()) + 'e';
+		qsizetype announced_node_cnt = 0;
+
+		for(auto node_itr = lookup.closest_nodes.cbegin(); node_itr != lookup.closest_nodes.cend() && announced_node_cnt < bucket_size; ++node_itr) {
+
+			if(node_itr->responded && !node_itr->token.isEmpty()) {
+				const auto arguments = "2:id" + bencoded_string(id_) + "12:implied_porti0e" + announce_arguments_tail + "5:token" + bencoded_string(node_itr->token);
+				send_query(Query_Type::Announce_Peer, arguments, node_itr->address, node_itr->port, node_itr->id);
+				++announced_node_cnt;
+			}
+		}
+
+		qDebug() << "announced to" << announced_node_cnt << "DHT nodes" << lookup.target.toHex();
+	}
+
+	if(lookup.target == id_ && !bootstrapped_ && node_count()) {
+		qDebug() << "DHT bootstrapped with" << node_count() << "nodes";
+		bootstrapped_ = true;
+		announce_torrents();
+	}
+}
+
+void Dht_node::announce_torrents() noexcept {
+
+	for(const auto & info_hash : std::as_const(torrents_)) {
+		start_lookup(info_hash, true, true);
+	}
+}
+
+void Dht_node::maintain() noexcept {
+	const auto now = std::chrono::steady_clock::now();
+
+	for(auto torrent_itr = stored_peers_.begin(); torrent_itr != stored_peers_.end();) {
+		auto & peers = *torrent_itr;
+
+		for(auto peer_itr = peers.begin(); peer_itr != peers.end();) {
+			peer_itr = now - peer_itr.value() > stored_peer_ttl ? peers.erase(peer_itr) : std::next(peer_itr);
+		}
+
+		torrent_itr = peers.isEmpty() ? stored_peers_.erase(torrent_itr) : std::next(torrent_itr);
+	}
+
+	// questionable nodes get pinged, those that keep failing are dropped by on_query_failed
+	for(const auto & bucket : buckets_) {
+		for(const auto & node : bucket) {
+			if(!node.last_seen_timer.isValid() || node.last_seen_timer.hasExpired(std::chrono::milliseconds(node_refresh_interval).count())) {
+				send_query(Query_Type::Ping, "2:id" + bencoded_string(id_), node.address, node.port, node.id);
+			}
+		}
+	}
+
+	if(node_count() < bucket_size) {
+		bootstrapped_ = false;
+		bootstrap();
+	}
+
+	write_node_cache();
+}
+
+void Dht_node::read_node_cache() noexcept {
+	QSettings settings;
+	settings.beginGroup("dht");
+
+	id_ = QByteArray::fromHex(qvariant_cast<QByteArray>(settings.value("node_id")));
+
+	if(id_.size() != node_id_size) {
+		return; // the cached nodes were sorted into buckets relative to the old id
+	}
+
+	const auto cached_nodes = qvariant_cast<QByteArray>(settings.value("nodes"));
+	constexpr auto compact_node_size = node_id_size + compact_endpoint_size;
+
+	for(qsizetype node_offset = 0; node_offset + compact_node_size <= cached_nodes.size(); node_offset += compact_node_size) {
+		const auto node_id = cached_nodes.sliced(node_offset, node_id_size);
+		auto & bucket = buckets_[static_cast<std::size_t>(bucket_index(node_id))];
+
+		if(node_id != id_ && bucket.size() < bucket_size) {
+			const QHostAddress address(util::extract_integer<std::uint32_t>(cached_nodes, node_offset + node_id_size));
+			bucket.push_back(Node{node_id, address, {}, util::extract_integer<std::uint16_t>(cached_nodes, node_offset + node_id_size + 4)});
+		}
+	}
+
+	qDebug() << "restored" << node_count() << "DHT nodes";
+}
+
+void Dht_node::write_node_cache() const noexcept {
+	QByteArray cached_nodes;
+	qsizetype cached_node_cnt = 0;
+
+	for(const auto & bucket : buckets_) {
+		for(const auto & node : bucket) {
+			if(node.last_seen_timer.isValid() && cached_node_cnt++ < max_cached_node_cnt) {
+				cached_nodes += node.id + compact_endpoint(node.address, node.port);
+			}
+		}
+	}
+
+	QSettings settings;
+	settings.beginGroup("dht");
+	settings.setValue("node_id", id_.toHex());
+	settings.setValue("nodes", cached_nodes);
+}
\ No newline at end of file
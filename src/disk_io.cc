@@ -0,0 +1,333 @@
+#include "disk_io.h"
+#include "file_pool.h"
+
+#include <QCoreApplication>
+#include <QSocketNotifier>
+#include <QTimer>
+#include <QFile>
+
+#ifdef TORAPP_IO_URING
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+Disk_io::Disk_io() {
+#ifdef TORAPP_IO_URING
+	if(!init_ring()) {
+		return;
+	}
+
+	// owned by the application, the singleton outlives it
+	completion_notifier_ = new QSocketNotifier(event_fd_, QSocketNotifier::Read, QCoreApplication::instance());
+
+	QObject::connect(completion_notifier_, &QSocketNotifier::activated, completion_notifier_, [this] {
+		reap_completions();
+	});
+#endif
+}
+
+Disk_io::~Disk_io() {
+#ifdef TORAPP_IO_URING
+	if(ring_ready_) {
+		drain_ring(); // the kernel must be done with the buffers before they go
+		io_uring_queue_exit(&ring_);
+	}
+
+	delete completion_notifier_;
+
+	if(event_fd_ >= 0) {
+		close(event_fd_);
+	}
+#endif
+}
+
+Disk_io & Disk_io::instance() noexcept {
+	static Disk_io disk_io;
+	return disk_io;
+}
+
+void Disk_io::read(QList<Request> requests, QByteArray buffer, QObject * const context, Completion on_completed) noexcept {
+	assert(context);
+	submit({std::move(requests), std::move(buffer), context, std::move(on_completed), Operation::Read});
+}
+
+void Disk_io::write(QList<Request> requests, QByteArray buffer, QObject * const context, Completion on_completed) noexcept {
+	assert(context);
+	submit({std::move(requests), std::move(buffer), context, std::move(on_completed), Operation::Write});
+}
+
+// the owner was deleted, its file handles may be gone with it and nobody is waiting for the result
+bool Disk_io::is_abandoned(const Job & job) noexcept {
+	return !job.context;
+}
+
+bool Disk_io::submit_fallback(const QList<Request> & requests, const Operation operation) noexcept {
+	return std::ranges::all_of(requests, [operation](const Request & request) {
+		assert(request.byte_cnt > 0);
+
+		if(!request.file_handle) {
+			return false;
+		}
+
+		if(!File_pool::instance().acquire(request.file_handle, operation == Operation::Write) || !request.file_handle->seek(request.file_offset)) {
+			return false;
+		}
+
+		if(operation == Operation::Read) {
+			return request.file_handle->read(request.data, request.byte_cnt) == request.byte_cnt;
+		}
+
+		return request.file_handle->write(request.data, request.byte_cnt) == request.byte_cnt;
+	});
+}
+
+void Disk_io::complete(Job job, const bool succeeded) noexcept {
+
+	if(!job.context || !job.on_completed) {
+		return;
+	}
+
+	// posted so that the caller is never re-entered from read(), write() or a ring reset
+	QTimer::singleShot(0, job.context, [on_completed = std::move(job.on_completed), buffer = std::move(job.buffer), succeeded]() mutable {
+		on_completed(succeeded ? std::optional(std::move(buffer)) : std::nullopt);
+	});
+}
+
+void Disk_io::submit(Job job) noexcept {
+
+	if(is_abandoned(job)) {
+		return;
+	}
+#ifdef TORAPP_IO_URING
+	// a job that could never fit the ring takes the fallback path
+	if(ring_ready_ && job.requests.size() <= static_cast<qsizetype>(queue_depth)) {
+
+		if(!queued_jobs_.empty() || in_flight_sqe_cnt_ + job.requests.size() > static_cast<qsizetype>(queue_depth)) {
+			queued_jobs_.push_back(std::move(job));
+		} else {
+			submit_uring(std::move(job));
+		}
+
+		return;
+	}
+#endif
+	const auto succeeded = submit_fallback(job.requests, job.operation);
+	complete(std::move(job), succeeded);
+}
+
+#ifdef TORAPP_IO_URING
+
+bool Disk_io::init_ring() noexcept {
+	assert(!ring_ready_);
+
+	if(const auto init_result = io_uring_queue_init(queue_depth, &ring_, 0); init_result < 0) {
+		qDebug() << "io_uring unavailable, using the fallback storage path" << init_result;
+		return false;
+	}
+
+	if(event_fd_ < 0) {
+		event_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	}
+
+	if(event_fd_ < 0 || io_uring_register_eventfd(&ring_, event_fd_) < 0) {
+		qDebug() << "could not watch io_uring completions, using the fallback storage path";
+		io_uring_queue_exit(&ring_);
+		return false;
+	}
+
+	ring_ready_ = true;
+	return true;
+}
+
+void Disk_io::submit_uring(Job job) noexcept {
+	assert(ring_ready_);
+	assert(in_flight_sqe_cnt_ + job.requests.size() <= static_cast<qsizetype>(queue_depth));
+
+	const auto is_write = job.operation == Operation::Write;
+
+	assert(!is_abandoned(job));
+
+	for(const auto & request : std::as_const(job.requests)) {
+		assert(request.byte_cnt > 0);
+		const auto fd = request.file_handle && File_pool::instance().acquire(request.file_handle, is_write) ? dup(request.file_handle->handle()) : -1;
+
+		if(fd < 0) {
+			std::ranges::for_each(job.fds, [](const int fd) { close(fd); });
+			return complete(std::move(job), false);
+		}
+
+		job.fds.push_back(fd);
+	}
+
+	const auto job_id = next_job_id_++;
+	// a read has to see the blocks written before it, which may still be in flight
+	const auto drain_writes = !is_write && in_flight_write_cnt_;
+
+	for(qsizetype request_idx = 0; request_idx < job.requests.size(); ++request_idx) {
+		const auto & [file_handle, file_offset, data, byte_cnt] = job.requests[request_idx];
+		auto * const sqe = io_uring_get_sqe(&ring_);
+		assert(sqe);
+
+		const auto fd = job.fds[request_idx];
+		const auto byte_cnt_u = static_cast<std::uint32_t>(byte_cnt);
+		const auto file_offset_u = static_cast<std::uint64_t>(file_offset);
+
+		if(is_write) {
+			io_uring_prep_write(sqe, fd, data, byte_cnt_u, file_offset_u);
+		} else {
+			io_uring_prep_read(sqe, fd, data, byte_cnt_u, file_offset_u);
+		}
+
+		if(drain_writes) {
+			io_uring_sqe_set_flags(sqe, IOSQE_IO_DRAIN);
+		}
+
+		sqe->user_data = static_cast<std::uint64_t>(job_id) << 32 | static_cast<std::uint64_t>(request_idx);
+	}
+
+	const auto submitted_cnt = std::max(0, io_uring_submit(&ring_));
+	const auto requested_cnt = job.requests.size();
+
+	job.pending_cnt = submitted_cnt;
+	in_flight_sqe_cnt_ += submitted_cnt;
+	in_flight_write_cnt_ += is_write ? submitted_cnt : 0;
+
+	if(submitted_cnt == requested_cnt) {
+		in_flight_jobs_.insert(job_id, std::move(job));
+		return;
+	}
+
+	// the entries left in the submission queue would go out with the next job, only a fresh ring gets rid of them
+	qDebug() << "io_uring submission failed, resetting the ring" << submitted_cnt << requested_cnt;
+	job.failed = true;
+
+	if(job.pending_cnt) {
+		in_flight_jobs_.insert(job_id, std::move(job));
+	} else {
+		finish_job(std::move(job));
+	}
+
+	reset_ring();
+}
+
+void Disk_io::submit_queued_jobs() noexcept {
+
+	while(!queued_jobs_.empty()) {
+
+		if(is_abandoned(queued_jobs_.front())) {
+			queued_jobs_.pop_front();
+			continue;
+		}
+
+		if(!ring_ready_) {
+			auto job = std::move(queued_jobs_.front());
+			queued_jobs_.pop_front();
+
+			const auto succeeded = submit_fallback(job.requests, job.operation);
+			complete(std::move(job), succeeded);
+			continue;
+		}
+
+		if(in_flight_sqe_cnt_ + queued_jobs_.front().requests.size() > static_cast<qsizetype>(queue_depth)) {
+			return;
+		}
+
+		auto job = std::move(queued_jobs_.front());
+		queued_jobs_.pop_front();
+		submit_uring(std::move(job));
+	}
+}
+
+void Disk_io::on_completion_queued(const io_uring_cqe * const cqe) noexcept {
+	const auto user_data = cqe->user_data;
+	const auto job_id = static_cast<std::uint32_t>(user_data >> 32);
+	const auto request_idx = static_cast<qsizetype>(user_data & 0xffffffff);
+
+	const auto job_itr = in_flight_jobs_.find(job_id);
+	assert(job_itr != in_flight_jobs_.end());
+	assert(request_idx < job_itr->requests.size());
+
+	--in_flight_sqe_cnt_;
+	in_flight_write_cnt_ -= job_itr->operation == Operation::Write;
+	assert(in_flight_sqe_cnt_ >= 0 && in_flight_write_cnt_ >= 0);
+
+	if(cqe->res != job_itr->requests[request_idx].byte_cnt) {
+		job_itr->failed = true;
+	}
+
+	if(--job_itr->pending_cnt) {
+		return;
+	}
+
+	auto job = std::move(*job_itr);
+	in_flight_jobs_.erase(job_itr);
+	finish_job(std::move(job));
+}
+
+void Disk_io::finish_job(Job job) noexcept {
+	assert(!job.pending_cnt);
+	std::ranges::for_each(job.fds, [](const int fd) { close(fd); });
+
+	if(is_abandoned(job)) {
+		return;
+	}
+
+	// short or failed io, the fallback path redoes the whole job
+	const auto succeeded = !job.failed || submit_fallback(job.requests, job.operation);
+	complete(std::move(job), succeeded);
+}
+
+void Disk_io::reap_completions() noexcept {
+	eventfd_t completion_event_cnt = 0;
+	eventfd_read(event_fd_, &completion_event_cnt);
+
+	io_uring_cqe * cqe = nullptr;
+
+	while(ring_ready_ && io_uring_peek_cqe(&ring_, &cqe) == 0) {
+		on_completion_queued(cqe);
+		io_uring_cqe_seen(&ring_, cqe);
+	}
+
+	submit_queued_jobs();
+}
+
+void Disk_io::drain_ring() noexcept {
+
+	while(in_flight_sqe_cnt_) {
+		io_uring_cqe * cqe = nullptr;
+
+		if(const auto wait_result = io_uring_wait_cqe(&ring_, &cqe); wait_result == -EINTR || wait_result == -EAGAIN) {
+			continue;
+		} else if(wait_result < 0) {
+			qDebug() << "could not reap io_uring completions" << wait_result;
+			return;
+		}
+
+		on_completion_queued(cqe);
+		io_uring_cqe_seen(&ring_, cqe);
+	}
+}
+
+void Disk_io::reset_ring() noexcept {
+	assert(ring_ready_);
+	drain_ring();
+
+	// whatever the ring could not account for is redone on the fallback path
+	for(auto job_itr = in_flight_jobs_.begin(); job_itr != in_flight_jobs_.end(); job_itr = in_flight_jobs_.erase(job_itr)) {
+		job_itr->pending_cnt = 0;
+		job_itr->failed = true;
+		finish_job(std::move(*job_itr));
+	}
+
+	in_flight_sqe_cnt_ = in_flight_write_cnt_ = 0;
+	io_uring_queue_exit(&ring_);
+	ring_ready_ = false;
+
+	if(init_ring()) {
+		qDebug() << "io_uring ring reset";
+	}
+
+	submit_queued_jobs();
+}
+
+#endif
\ No newline at end of file
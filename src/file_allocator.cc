@@ -21,15 +21,14 @@ auto File_allocator::open_file_handles(const QString & dir_path, const bencode::
 	std::vector<std::unique_ptr<QFile>> temp_file_handles;
 	temp_file_handles.reserve(torrent_metadata.file_info.size());
 
-	for(const auto & [torrent_file_path, torrent_file_size] : torrent_metadata.file_info) {
-		QFileInfo file_info(dir, torrent_file_path.data());
-		dir.mkpath(file_info.absolutePath());
-
-		auto & file_handle = temp_file_handles.emplace_back(std::make_unique<QFile>(file_info.absoluteFilePath(), this));
+	if(!QFileInfo(dir.path()).isWritable()) {
+		return std::unexpected(Error::Permissions);
+	}
 
-		if(!file_handle->open(QFile::ReadWrite)) {
-			return std::unexpected(Error::Permissions);
-		}
+	for(const auto & [torrent_file_path, torrent_file_size] : torrent_metadata.file_info) {
+		// opened lazily through File_pool on first access
+		const QFileInfo file_info(dir, torrent_file_path.data());
+		temp_file_handles.emplace_back(std::make_unique<QFile>(file_info.absoluteFilePath(), this));
 	}
 
 	QList<QFile *> file_handles(static_cast<qsizetype>(temp_file_handles.size()));
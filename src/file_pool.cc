@@ -0,0 +1,96 @@
+#include "file_pool.h"
+
+#include <QSettings>
+#include <QFileInfo>
+#include <QFile>
+#include <QDir>
+
+File_pool::File_pool() {
+	QSettings settings;
+	settings.beginGroup("storage");
+	max_open_file_cnt_ = std::max<qsizetype>(1, qvariant_cast<qsizetype>(settings.value("max_open_file_count", default_max_open_file_cnt)));
+}
+
+File_pool & File_pool::instance() noexcept {
+	static File_pool file_pool;
+	return file_pool;
+}
+
+void File_pool::set_max_open_file_count(const qsizetype max_open_file_cnt) noexcept {
+	assert(max_open_file_cnt > 0);
+	max_open_file_cnt_ = max_open_file_cnt;
+
+	while(open_file_count() > max_open_file_cnt_) {
+		evict_least_recently_used();
+	}
+}
+
+bool File_pool::acquire(QFile * const file_handle, const bool create_if_missing) noexcept {
+	assert(file_handle);
+
+	if(const auto pool_itr = pooled_file_handles_.constFind(file_handle); pool_itr != pooled_file_handles_.cend()) {
+		lru_file_handles_.splice(lru_file_handles_.begin(), lru_file_handles_, *pool_itr);
+
+		if(file_handle->isOpen()) {
+			return true;
+		}
+
+		release(file_handle); // closed behind our back (e.g. QFile::remove)
+	}
+
+	if(!create_if_missing && !file_handle->exists()) {
+		return false;
+	}
+
+	if(const QFileInfo file_info(file_handle->fileName()); !QDir().mkpath(file_info.absolutePath())) {
+		qDebug() << "could not create directory for" << file_info.absoluteFilePath();
+		return false;
+	}
+
+	while(open_file_count() >= max_open_file_cnt_) {
+		evict_least_recently_used();
+	}
+
+	// unbuffered so that positional io submitted outside of QFile (Disk_io) never races a stale QFile buffer
+	if(!file_handle->open(QFile::ReadWrite | QFile::Unbuffered)) {
+		qDebug() << "could not open" << file_handle->fileName() << file_handle->errorString();
+		return false;
+	}
+
+	lru_file_handles_.push_front(file_handle);
+	pooled_file_handles_.insert(file_handle, lru_file_handles_.begin());
+
+	if(!file_handle->property("file_pool_tracked").toBool()) {
+		file_handle->setProperty("file_pool_tracked", true);
+
+		QObject::connect(file_handle, &QObject::destroyed, [](QObject * const destroyed_file_handle) {
+			auto & file_pool = instance();
+
+			if(const auto pool_itr = file_pool.pooled_file_handles_.constFind(destroyed_file_handle); pool_itr != file_pool.pooled_file_handles_.cend()) {
+				file_pool.lru_file_handles_.erase(*pool_itr);
+				file_pool.pooled_file_handles_.erase(pool_itr);
+			}
+		});
+	}
+
+	assert(open_file_count() <= max_open_file_cnt_);
+	return true;
+}
+
+void File_pool::release(QFile * const file_handle) noexcept {
+	assert(file_handle);
+
+	if(const auto pool_itr = pooled_file_handles_.constFind(file_handle); pool_itr != pooled_file_handles_.cend()) {
+		lru_file_handles_.erase(*pool_itr);
+		pooled_file_handles_.erase(pool_itr);
+	}
+
+	if(file_handle->isOpen()) {
+		file_handle->close();
+	}
+}
+
+void File_pool::evict_least_recently_used() noexcept {
+	assert(!lru_file_handles_.empty());
+	release(lru_file_handles_.back());
+}
\ No newline at end of file
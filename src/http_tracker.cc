@@ -0,0 +1,239 @@
+#include "http_tracker.h"
+
+#include <bencode_parser.h>
+#include <QNetworkRequest>
+#include <QHostAddress>
+
+Http_tracker::Http_tracker(QUrl announce_url, QNetworkAccessManager * const network_manager, QObject * const parent)
+    : Tracker(std::move(announce_url), parent),
+	network_manager_(network_manager) {
+	assert(network_manager_);
+}
+
+QUrl Http_tracker::append_query(const QUrl & url, const QByteArray & query) noexcept {
+	// private trackers keep their passkey in the query; the encoded form is kept as is so that the info hash bytes survive
+	auto encoded_url = url.toEncoded();
+	encoded_url += (url.hasQuery() ? '&' : '?') + query;
+	return QUrl::fromEncoded(encoded_url);
+}
+
+QUrl Http_tracker::scrape_url(const QUrl & announce_url) noexcept {
+	const QLatin1String announce_segment("announce");
+	auto path = announce_url.path(QUrl::FullyEncoded);
+	const auto last_segment_idx = path.lastIndexOf('/') + 1;
+
+	// BEP 48: only trackers whose announce path ends in a segment starting with "announce" support scrape
+	if(!path.sliced(last_segment_idx).startsWith(announce_segment)) {
+		return {};
+	}
+
+	path.replace(last_segment_idx, announce_segment.size(), QLatin1String("scrape"));
+
+	auto url = announce_url;
+	url.setPath(path, QUrl::StrictMode);
+	return url;
+}
+
+QByteArray Http_tracker::craft_announce_query(const Announce_parameters & parameters) const noexcept {
+	constexpr std::array<std::string_view, 4> event_names{"", "completed", "started", "stopped"};
+
+	auto announce_query = "info_hash=" + QByteArray::fromHex(parameters.info_sha1_hash).toPercentEncoding();
+	announce_query += "&peer_id=" + QByteArray::fromHex(parameters.peer_id).toPercentEncoding();
+	announce_query += "&port=" + QByteArray::number(parameters.listen_port);
+	announce_query += "&uploaded=" + QByteArray::number(parameters.uled_byte_cnt);
+	announce_query += "&downloaded=" + QByteArray::number(parameters.dled_byte_cnt);
+	announce_query += "&left=" + QByteArray::number(parameters.left_byte_cnt);
+	announce_query += "&compact=1";
+
+	if(parameters.num_want >= 0) {
+		announce_query += "&numwant=" + QByteArray::number(parameters.num_want);
+	}
+
+	if(parameters.event != Event::None) {
+		announce_query += "&event=" + QByteArray(event_names[static_cast<std::size_t>(parameters.event)].data());
+	}
+
+	if(!tracker_id_.isEmpty()) {
+		announce_query += "&trackerid=" + tracker_id_.toPercentEncoding();
+	}
+
+	return announce_query;
+}
+
+void Http_tracker::announce(const Announce_parameters & parameters) noexcept {
+
+	if(!network_manager_) {
+		return;
+	}
+
+	stop(); // superseded, e.g. a stop right after the start
+	stopping_ = parameters.event == Event::Stopped;
+
+	QNetworkRequest request(append_query(announce_url(), craft_announce_query(parameters)));
+	request.setTransferTimeout(static_cast<std::int32_t>(std::chrono::milliseconds(transfer_timeout).count()));
+
+	auto * const network_reply = network_manager_->get(request);
+	announce_reply_ = network_reply;
+
+	connect(network_reply, &QNetworkReply::finished, this, [this, network_reply] {
+		network_reply->deleteLater();
+		on_announce_finished(network_reply);
+	});
+}
+
+void Http_tracker::stop() noexcept {
+	Tracker::stop();
+
+	if(announce_reply_) {
+		announce_reply_->abort();
+	}
+}
+
+void Http_tracker::scrape(const QByteArray & info_sha1_hash) noexcept {
+	assert(info_sha1_hash.size() == 40);
+
+	if(!network_manager_) {
+		return;
+	}
+
+	const auto url = scrape_url(announce_url());
+
+	if(!url.isValid()) {
+		return;
+	}
+
+	const auto info_hash = QByteArray::fromHex(info_sha1_hash);
+
+	QNetworkRequest request(append_query(url, "info_hash=" + info_hash.toPercentEncoding()));
+	request.setTransferTimeout(static_cast<std::int32_t>(std::chrono::milliseconds(transfer_timeout).count()));
+
+	auto * const network_reply = network_manager_->get(request);
+
+	connect(network_reply, &QNetworkReply::finished, this, [this, network_reply, info_hash] {
+		network_reply->deleteLater();
+		on_scrape_finished(network_reply, info_hash);
+	});
+}
+
+void Http_tracker::on_announce_finished(QNetworkReply * const network_reply) noexcept {
+
+	if(network_reply->error() == QNetworkReply::OperationCanceledError) {
+		return;
+	}
+
+	if(stopping_) { // nothing more to announce until the download resumes
+		return;
+	}
+
+	if(network_reply->error() != QNetworkReply::NoError) {
+		qDebug() << "http tracker announce failed" << announce_url() << network_reply->errorString();
+		emit announce_failed(network_reply->errorString().toUtf8());
+		return;
+	}
+
+	try {
+		const auto reply_dict = bencode::parse_content(network_reply->readAll());
+
+		if(const auto failure_itr = reply_dict.find("failure reason"); failure_itr != reply_dict.end()) {
+			const auto failure_reason = std::any_cast<std::string>(failure_itr->second);
+			emit announce_failed(QByteArray(failure_reason.data(), static_cast<qsizetype>(failure_reason.size())));
+			return;
+		}
+
+		if(const auto warning_itr = reply_dict.find("warning message"); warning_itr != reply_dict.end()) {
+			qDebug() << "http tracker warning" << announce_url() << std::any_cast<std::string>(warning_itr->second).data();
+		}
+
+		if(const auto tracker_id_itr = reply_dict.find("tracker id"); tracker_id_itr != reply_dict.end()) {
+			const auto tracker_id = std::any_cast<std::string>(tracker_id_itr->second);
+			tracker_id_ = QByteArray(tracker_id.data(), static_cast<qsizetype>(tracker_id.size()));
+		}
+
+		auto extract_integer = [&reply_dict](const std::string & key) {
+			const auto value_itr = reply_dict.find(key);
+			return value_itr == reply_dict.end() ? 0 : static_cast<std::int32_t>(std::any_cast<std::int64_t>(value_itr->second));
+		};
+
+		Announce_reply announce_reply;
+		announce_reply.interval_time = extract_integer("interval");
+		announce_reply.min_interval_time = extract_integer("min interval");
+		announce_reply.seed_cnt = extract_integer("complete");
+		announce_reply.leecher_cnt = extract_integer("incomplete");
+
+		if(const auto peers_itr = reply_dict.find("peers"); peers_itr != reply_dict.end()) {
+
+			if(const auto * const compact_peers = std::any_cast<std::string>(&peers_itr->second)) {
+				announce_reply.peer_urls = extract_compact_peers(QByteArray(compact_peers->data(), static_cast<qsizetype>(compact_peers->size())), false);
+			} else if(const auto * const peer_dicts = std::any_cast<bencode::list>(&peers_itr->second)) { // trackers that ignore compact=1
+				for(const auto & peer : *peer_dicts) {
+					const auto peer_dict = std::any_cast<bencode::dictionary>(peer);
+					const auto ip_itr = peer_dict.find("ip");
+					const auto port_itr = peer_dict.find("port");
+
+					if(ip_itr == peer_dict.end() || port_itr == peer_dict.end()) {
+						continue;
+					}
+
+					const QHostAddress peer_address(QString::fromStdString(std::any_cast<std::string>(ip_itr->second)));
+
+					QUrl peer_url;
+					peer_url.setHost(peer_address.toString());
+					peer_url.setPort(static_cast<std::int32_t>(std::any_cast<std::int64_t>(port_itr->second)));
+
+					if(!peer_address.isNull() && peer_url.isValid()) {
+						announce_reply.peer_urls.push_back(std::move(peer_url));
+					}
+				}
+			}
+		}
+
+		if(const auto peers6_itr = reply_dict.find("peers6"); peers6_itr != reply_dict.end()) {
+			const auto compact_peers = std::any_cast<std::string>(peers6_itr->second);
+			announce_reply.peer_urls += extract_compact_peers(QByteArray(compact_peers.data(), static_cast<qsizetype>(compact_peers.size())), true);
+		}
+
+		start_interval_timer(std::chrono::seconds(std::max(announce_reply.interval_time, announce_reply.min_interval_time)));
+
+		emit announce_reply_received(announce_reply);
+		emit swarm_metadata_received({announce_reply.seed_cnt, scraped_completed_cnt_, announce_reply.leecher_cnt});
+	} catch(const std::exception & exception) {
+		qDebug() << "http tracker sent an invalid announce reply" << announce_url() << exception.what();
+		emit announce_failed(exception.what());
+	}
+}
+
+void Http_tracker::on_scrape_finished(QNetworkReply * const network_reply, const QByteArray & info_hash) noexcept {
+
+	if(network_reply->error() != QNetworkReply::NoError) {
+		qDebug() << "http tracker scrape failed" << announce_url() << network_reply->errorString();
+		return;
+	}
+
+	try {
+		const auto reply_dict = bencode::parse_content(network_reply->readAll());
+		const auto files_itr = reply_dict.find("files");
+
+		if(files_itr == reply_dict.end()) {
+			return;
+		}
+
+		const auto files_dict = std::any_cast<bencode::dictionary>(files_itr->second);
+		const auto file_itr = files_dict.find(info_hash.toStdString());
+
+		if(file_itr == files_dict.end()) {
+			return;
+		}
+
+		const auto file_dict = std::any_cast<bencode::dictionary>(file_itr->second);
+
+		auto extract_integer = [&file_dict](const std::string & key) {
+			const auto value_itr = file_dict.find(key);
+			return value_itr == file_dict.end() ? 0 : static_cast<std::int32_t>(std::any_cast<std::int64_t>(value_itr->second));
+		};
+
+		scraped_completed_cnt_ = extract_integer("downloaded");
+		emit swarm_metadata_received({extract_integer("complete"), scraped_completed_cnt_, extract_integer("incomplete")});
+	} catch(const std::exception & exception) {
+		qDebug() << "http tracker sent an invalid scrape reply" << announce_url() << exception.what();
+	}
+}
\ No newline at end of file
@@ -0,0 +1,169 @@
+#include "local_discovery.h"
+#include "peer_listener.h"
+
+#include <QNetworkDatagram>
+#include <QRandomGenerator>
+#include <QSettings>
+
+Local_discovery::Local_discovery(QObject * const parent) : QObject(parent) {
+
+	if(!is_enabled()) {
+		return;
+	}
+
+	// other clients on the machine listen on the same port
+	constexpr auto bind_mode = QUdpSocket::ShareAddress | QUdpSocket::ReuseAddressHint;
+
+	if(!ipv4_socket_.bind(QHostAddress::AnyIPv4, multicast_port, bind_mode) || !ipv4_socket_.joinMulticastGroup(ipv4_group)) {
+		qDebug() << "could not join the LSD multicast group" << ipv4_socket_.errorString();
+		return;
+	}
+
+	const auto ipv6_enabled = [] {
+		QSettings settings;
+		return qvariant_cast<bool>(settings.value("network/enable_ipv6", true));
+	}();
+
+	if(ipv6_enabled && (!ipv6_socket_.bind(QHostAddress::AnyIPv6, multicast_port, bind_mode) || !ipv6_socket_.joinMulticastGroup(ipv6_group))) {
+		qDebug() << "LSD runs over IPv4 only" << ipv6_socket_.errorString();
+		ipv6_socket_.close();
+	}
+
+	instance_ = this;
+	cookie_ = QByteArray::number(QRandomGenerator::global()->generate64(), 16);
+
+	connect(&ipv4_socket_, &QUdpSocket::readyRead, this, [this] {
+		on_ready_read(ipv4_socket_);
+	});
+
+	connect(&ipv6_socket_, &QUdpSocket::readyRead, this, [this] {
+		on_ready_read(ipv6_socket_);
+	});
+
+	announce_timer_.callOnTimeout(this, [this] {
+		announce(torrents_.keys());
+	});
+
+	announce_timer_.start(announce_interval);
+}
+
+bool Local_discovery::is_enabled() noexcept {
+	QSettings settings;
+	settings.beginGroup("network");
+	return qvariant_cast<bool>(settings.value("enable_lsd", true));
+}
+
+void Local_discovery::add_torrent(const QByteArray & info_sha1_hash) noexcept {
+	assert(info_sha1_hash.size() == 40);
+
+	// magnet links may carry uppercase hex, announces are matched in lowercase
+	const auto normalized_hash = info_sha1_hash.toLower();
+
+	if(!torrents_.contains(normalized_hash)) {
+		torrents_.insert(normalized_hash, QElapsedTimer());
+	}
+
+	announce({normalized_hash});
+}
+
+void Local_discovery::remove_torrent(const QByteArray & info_sha1_hash) noexcept {
+	torrents_.remove(info_sha1_hash.toLower());
+}
+
+QByteArray Local_discovery::craft_announce(const QByteArray & host, const QList<QByteArray> & info_sha1_hashes) const noexcept {
+	assert(!info_sha1_hashes.isEmpty());
+
+	auto announce = "BT-SEARCH * HTTP/1.1\r\nHost: " + host + "\r\nPort: " + QByteArray::number(Peer_listener::listen_port()) + "\r\n";
+
+	for(const auto & info_sha1_hash : info_sha1_hashes) {
+		announce += "Infohash: " + info_sha1_hash + "\r\n";
+	}
+
+	return announce + "cookie: " + cookie_ + "\r\n\r\n\r\n";
+}
+
+void Local_discovery::announce(const QList<QByteArray> & info_sha1_hashes) noexcept {
+	QList<QByteArray> due_hashes;
+
+	// a torrent that is removed and added again (pause, resume) does not flood the network
+	for(const auto & info_sha1_hash : info_sha1_hashes) {
+
+		if(const auto torrent_itr = torrents_.find(info_sha1_hash); torrent_itr != torrents_.end()) {
+
+			if(!torrent_itr->isValid() || torrent_itr->hasExpired(std::chrono::milliseconds(min_announce_gap).count())) {
+				torrent_itr->start();
+				due_hashes.push_back(info_sha1_hash);
+			}
+		}
+	}
+
+	const auto ipv4_host = ipv4_group.toString().toLatin1() + ':' + QByteArray::number(multicast_port);
+	const auto ipv6_host = '[' + ipv6_group.toString().toLatin1() + "]:" + QByteArray::number(multicast_port);
+
+	for(qsizetype beg_idx = 0; beg_idx < due_hashes.size(); beg_idx += max_announced_hash_cnt) {
+		const auto announced_hashes = due_hashes.mid(beg_idx, max_announced_hash_cnt);
+		ipv4_socket_.writeDatagram(craft_announce(ipv4_host, announced_hashes), ipv4_group, multicast_port);
+
+		if(ipv6_socket_.state() == QAbstractSocket::BoundState) {
+			ipv6_socket_.writeDatagram(craft_announce(ipv6_host, announced_hashes), ipv6_group, multicast_port);
+		}
+	}
+}
+
+void Local_discovery::on_ready_read(QUdpSocket & udp_socket) noexcept {
+
+	while(udp_socket.hasPendingDatagrams()) {
+		const auto datagram = udp_socket.receiveDatagram();
+		on_announce_received(datagram.data(), datagram.senderAddress());
+	}
+}
+
+void Local_discovery::on_announce_received(const QByteArray & announce, const QHostAddress & address) noexcept {
+	const auto lines = announce.split('\n'); // some clients end the lines without '\r'
+
+	if(lines.isEmpty() || !lines.front().trimmed().startsWith("BT-SEARCH * HTTP/1.1")) {
+		return;
+	}
+
+	std::uint16_t peer_port = 0;
+	QList<QByteArray> info_sha1_hashes;
+	QByteArray cookie;
+
+	for(const auto & line : lines.sliced(1)) {
+		const auto separator_idx = line.indexOf(':');
+
+		if(separator_idx == -1) {
+			continue;
+		}
+
+		const auto header_name = line.first(separator_idx).trimmed().toLower();
+		const auto header_value = line.sliced(separator_idx + 1).trimmed();
+
+		if(header_name == "port") {
+			peer_port = header_value.toUShort();
+		} else if(header_name == "infohash") {
+			info_sha1_hashes.push_back(header_value.toLower());
+		} else if(header_name == "cookie") {
+			cookie = header_value;
+		}
+	}
+
+	if(!peer_port || cookie == cookie_) { // invalid or our own, looped back
+		return;
+	}
+
+	bool is_ipv4_peer = false;
+	const auto peer_ipv4_address = address.toIPv4Address(&is_ipv4_peer);
+
+	QUrl peer_url;
+	peer_url.setHost((is_ipv4_peer ? QHostAddress(peer_ipv4_address) : address).toString());
+	peer_url.setPort(peer_port);
+
+	for(const auto & info_sha1_hash : std::as_const(info_sha1_hashes)) {
+
+		if(torrents_.contains(info_sha1_hash)) {
+			qDebug() << "LSD peer found" << peer_url << info_sha1_hash;
+			emit peers_found(info_sha1_hash, {peer_url});
+		}
+	}
+}
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "url_input_dialog.h"
 #include "download_tracker.h"
 #include "magnet_url_parser.h"
+#include "dht_node.h"
 #include "util.h"
 
 #include <bencode_parser.h>
@@ -149,9 +150,8 @@ void Main_window::add_top_actions() noexcept {
 				return;
 			}
 
-			if(torrent_metadata->tracker_urls.empty()) {
-				// todo: implement DHT protocol
-				qDebug() << "torrent requires DHT protocol. [not implemented yet]";
+			if(torrent_metadata->tracker_urls.empty() && !Dht_node::instance()) {
+				QMessageBox::critical(this, "DHT disabled", "Magnet url has no trackers and DHT is disabled in the settings.");
 				return;
 			}
 
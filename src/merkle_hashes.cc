@@ -0,0 +1,393 @@
+#include "merkle_hashes.h"
+
+#include <QCryptographicHash>
+#include <QDebug>
+#include <bit>
+
+Merkle_hashes::Merkle_hashes(const bencode::Metadata & torrent_metadata) noexcept
+    : piece_length_(torrent_metadata.piece_length) {
+
+	// v2 pieces are a power of two of at least one block
+	if(piece_length_ < block_size || !std::has_single_bit(static_cast<std::uint64_t>(piece_length_))) {
+		return;
+	}
+
+	QHash<QString, std::pair<std::int64_t, QByteArray>> v2_files; // {path,{byte_cnt,pieces_root}}
+
+	try {
+		const auto info_dict = bencode::parse_content(QByteArray(torrent_metadata.raw_info_dict.data(), static_cast<qsizetype>(torrent_metadata.raw_info_dict.size())));
+		const auto meta_version_itr = info_dict.find("meta version");
+		const auto file_tree_itr = info_dict.find("file tree");
+
+		if(meta_version_itr == info_dict.end() || std::any_cast<std::int64_t>(meta_version_itr->second) != 2 || file_tree_itr == info_dict.end()) {
+			return;
+		}
+
+		auto add_files = [&v2_files](auto add_files_callback, const bencode::dictionary & directory, const QString & dir_path) -> void {
+			for(const auto & [name, node] : directory) {
+				const auto node_dict = std::any_cast<bencode::dictionary>(node);
+
+				if(!name.empty()) {
+					const auto node_path = QString::fromStdString(name);
+					add_files_callback(add_files_callback, node_dict, dir_path.isEmpty() ? node_path : dir_path + '/' + node_path);
+					continue;
+				}
+
+				// an empty key holds the file the enclosing dictionary is named after. empty files have no root
+				const auto pieces_root_itr = node_dict.find("pieces root");
+				const auto pieces_root = pieces_root_itr == node_dict.end() ? std::string() : std::any_cast<std::string>(pieces_root_itr->second);
+				const auto byte_cnt = std::any_cast<std::int64_t>(node_dict.at("length"));
+
+				v2_files.insert(dir_path, {byte_cnt, QByteArray(pieces_root.data(), static_cast<qsizetype>(pieces_root.size()))});
+			}
+		};
+
+		add_files(add_files, std::any_cast<bencode::dictionary>(file_tree_itr->second), {});
+	} catch(const std::exception & exception) {
+		qDebug() << "invalid v2 file tree" << exception.what();
+		return;
+	}
+
+	auto v1_files = torrent_metadata.file_info;
+
+	if(torrent_metadata.single_file) {
+		v1_files = {{torrent_metadata.name, torrent_metadata.single_file_size}};
+	}
+
+	const auto max_piece_height = static_cast<std::int32_t>(std::bit_width(static_cast<std::uint64_t>(piece_length_ / block_size))) - 1;
+	std::int64_t file_beg_offset = 0;
+
+	// the v1 list of a hybrid torrent holds the same files plus the padding that aligns each of them to a piece
+	for(const auto & [file_path, file_size] : v1_files) {
+		const auto v2_file_itr = v2_files.constFind(QString::fromStdString(file_path));
+		const auto file_offset = std::exchange(file_beg_offset, file_beg_offset + static_cast<std::int64_t>(file_size));
+
+		if(v2_file_itr == v2_files.cend() || !file_size) {
+			continue;
+		}
+
+		const auto & [byte_cnt, pieces_root] = *v2_file_itr;
+
+		if(byte_cnt != static_cast<std::int64_t>(file_size) || pieces_root.size() != hash_byte_cnt || file_offset % piece_length_) {
+			qDebug() << "v2 file tree does not line up with the v1 files" << file_path.data();
+			files_.clear();
+			return;
+		}
+
+		const auto block_cnt = (byte_cnt + block_size - 1) / block_size;
+
+		File_tree file_tree;
+		file_tree.pieces_root = pieces_root;
+		file_tree.byte_cnt = byte_cnt;
+		file_tree.first_piece_idx = static_cast<std::int32_t>(file_offset / piece_length_);
+		file_tree.piece_cnt = static_cast<std::int32_t>((byte_cnt + piece_length_ - 1) / piece_length_);
+		file_tree.tree_height = static_cast<std::int32_t>(std::bit_width(std::bit_ceil(static_cast<std::uint64_t>(block_cnt)))) - 1;
+		file_tree.piece_height = std::min(file_tree.tree_height, max_piece_height);
+
+		files_.push_back(std::move(file_tree));
+
+		// files of a single piece have no piece layer, their root is the hash of that piece
+		if(files_.constLast().piece_cnt == 1) {
+			set_piece_layer(files_.last(), {pieces_root});
+		}
+	}
+}
+
+QByteArray Merkle_hashes::hash(const QByteArray & data) noexcept {
+	return QCryptographicHash::hash(data, QCryptographicHash::Algorithm::Sha256);
+}
+
+QByteArray Merkle_hashes::pad_hash(const std::int32_t layer) noexcept {
+	assert(layer >= 0);
+	static QList<QByteArray> pad_hashes{QByteArray(hash_byte_cnt, '\0')}; // root of an all padding subtree, by height
+
+	while(pad_hashes.size() <= layer) {
+		pad_hashes.push_back(hash(pad_hashes.constLast() + pad_hashes.constLast()));
+	}
+
+	return pad_hashes[layer];
+}
+
+QList<QByteArray> Merkle_hashes::parent_layer(const QList<QByteArray> & hashes, const std::int32_t layer) noexcept {
+	QList<QByteArray> parent_hashes;
+	parent_hashes.reserve((hashes.size() + 1) / 2);
+
+	for(qsizetype hash_idx = 0; hash_idx < hashes.size(); hash_idx += 2) {
+		parent_hashes.push_back(hash(hashes[hash_idx] + (hash_idx + 1 < hashes.size() ? hashes[hash_idx + 1] : pad_hash(layer))));
+	}
+
+	return parent_hashes;
+}
+
+QByteArray Merkle_hashes::subtree_root(QList<QByteArray> hashes, const std::int32_t base_layer, const std::int32_t height) noexcept {
+
+	for(auto layer = base_layer; layer < base_layer + height; ++layer) {
+		hashes = parent_layer(hashes, layer);
+	}
+
+	assert(hashes.size() <= 1);
+	return hashes.isEmpty() ? pad_hash(base_layer + height) : hashes.constFirst();
+}
+
+QList<QByteArray> Merkle_hashes::upper_layer(const File_tree & file_tree, const std::int32_t layer) noexcept {
+	assert(!file_tree.piece_layer.isEmpty());
+	assert(layer >= file_tree.piece_height && layer <= file_tree.tree_height);
+
+	auto hashes = file_tree.piece_layer;
+
+	for(auto parent_layer_idx = file_tree.piece_height; parent_layer_idx < layer; ++parent_layer_idx) {
+		hashes = parent_layer(hashes, parent_layer_idx);
+	}
+
+	return hashes;
+}
+
+void Merkle_hashes::set_piece_layer(File_tree & file_tree, QList<QByteArray> piece_layer) noexcept {
+	assert(piece_layer.size() == file_tree.piece_cnt);
+	file_tree.piece_layer = std::move(piece_layer);
+
+	if(file_tree.piece_height) {
+		return;
+	}
+
+	// pieces of one block are their own leaves
+	for(std::int32_t local_piece_idx = 0; local_piece_idx < file_tree.piece_cnt; ++local_piece_idx) {
+		block_hashes_.insert(file_tree.first_piece_idx + local_piece_idx, {file_tree.piece_layer[local_piece_idx]});
+	}
+}
+
+void Merkle_hashes::add_piece_layers(const QHash<QByteArray, QByteArray> & piece_layers) noexcept {
+
+	for(auto & file_tree : files_) {
+		const auto piece_layer_itr = piece_layers.constFind(file_tree.pieces_root);
+
+		if(!file_tree.piece_layer.isEmpty() || piece_layer_itr == piece_layers.cend() || piece_layer_itr->size() != file_tree.piece_cnt * hash_byte_cnt) {
+			continue;
+		}
+
+		QList<QByteArray> piece_layer;
+		piece_layer.reserve(file_tree.piece_cnt);
+
+		for(qsizetype hash_offset = 0; hash_offset < piece_layer_itr->size(); hash_offset += hash_byte_cnt) {
+			piece_layer.push_back(piece_layer_itr->sliced(hash_offset, hash_byte_cnt));
+		}
+
+		if(subtree_root(piece_layer, file_tree.piece_height, file_tree.tree_height - file_tree.piece_height) != file_tree.pieces_root) {
+			qDebug() << "piece layer does not match its pieces root";
+			continue;
+		}
+
+		set_piece_layer(file_tree, std::move(piece_layer));
+	}
+}
+
+auto Merkle_hashes::file_tree(const std::int32_t piece_idx) const noexcept -> const File_tree * {
+	auto file_tree_itr = std::ranges::upper_bound(files_, piece_idx, {}, &File_tree::first_piece_idx);
+
+	if(file_tree_itr == files_.cbegin()) {
+		return nullptr;
+	}
+
+	--file_tree_itr;
+	return piece_idx < file_tree_itr->first_piece_idx + file_tree_itr->piece_cnt ? &*file_tree_itr : nullptr;
+}
+
+auto Merkle_hashes::file_tree(const QByteArray & pieces_root) const noexcept -> const File_tree * {
+	const auto file_tree_itr = std::ranges::find(files_, pieces_root, &File_tree::pieces_root);
+	return file_tree_itr == files_.cend() ? nullptr : &*file_tree_itr;
+}
+
+std::int64_t Merkle_hashes::real_byte_count(const File_tree & file_tree, const std::int32_t piece_idx) const noexcept {
+	assert(piece_idx >= file_tree.first_piece_idx && piece_idx < file_tree.first_piece_idx + file_tree.piece_cnt);
+	return std::min(piece_length_, file_tree.byte_cnt - (piece_idx - file_tree.first_piece_idx) * piece_length_);
+}
+
+std::int32_t Merkle_hashes::real_block_count(const File_tree & file_tree, const std::int32_t piece_idx) const noexcept {
+	return static_cast<std::int32_t>((real_byte_count(file_tree, piece_idx) + block_size - 1) / block_size);
+}
+
+QList<QByteArray> Merkle_hashes::piece_block_hashes(const File_tree & file_tree, const std::int32_t piece_idx, const QByteArray & piece) const noexcept {
+	const auto real_byte_cnt = real_byte_count(file_tree, piece_idx);
+	assert(piece.size() >= real_byte_cnt);
+
+	QList<QByteArray> block_hashes;
+	block_hashes.reserve(real_block_count(file_tree, piece_idx));
+
+	for(std::int64_t block_offset = 0; block_offset < real_byte_cnt; block_offset += block_size) {
+		block_hashes.push_back(hash(piece.sliced(block_offset, std::min<std::int64_t>(block_size, real_byte_cnt - block_offset))));
+	}
+
+	return block_hashes;
+}
+
+auto Merkle_hashes::block_hash_request(const std::int32_t piece_idx) const noexcept -> std::optional<Hash_request> {
+	const auto * const file_tree = this->file_tree(piece_idx);
+
+	if(!file_tree || !file_tree->piece_height || block_hashes_.contains(piece_idx)) {
+		return {};
+	}
+
+	const auto local_piece_idx = piece_idx - file_tree->first_piece_idx;
+
+	// the leaves are checked against the piece layer once it is known, until then they come with the uncles up to the root
+	return Hash_request{
+	    file_tree->pieces_root,
+	    0,
+	    local_piece_idx << file_tree->piece_height,
+	    1 << file_tree->piece_height,
+	    file_tree->piece_layer.isEmpty() ? file_tree->tree_height - file_tree->piece_height : 0,
+	};
+}
+
+bool Merkle_hashes::on_hashes_received(const Hash_request & request, const QList<QByteArray> & hashes) noexcept {
+	const auto piece_idx = leaf_piece_index(request);
+
+	if(!piece_idx || hashes.size() < request.length) {
+		return false;
+	}
+
+	const auto & file_tree = *this->file_tree(*piece_idx);
+	const auto local_piece_idx = *piece_idx - file_tree.first_piece_idx;
+	auto subtree_hash = subtree_root(hashes.first(request.length), 0, file_tree.piece_height);
+
+	if(!file_tree.piece_layer.isEmpty()) {
+
+		if(subtree_hash != file_tree.piece_layer[local_piece_idx]) {
+			return false;
+		}
+	} else {
+		const auto uncle_hashes = hashes.sliced(request.length);
+
+		if(uncle_hashes.size() != file_tree.tree_height - file_tree.piece_height) {
+			return false;
+		}
+
+		for(auto node_idx = local_piece_idx; const auto & uncle_hash : uncle_hashes) {
+			subtree_hash = node_idx & 1 ? hash(uncle_hash + subtree_hash) : hash(subtree_hash + uncle_hash);
+			node_idx >>= 1;
+		}
+
+		if(subtree_hash != file_tree.pieces_root) {
+			return false;
+		}
+	}
+
+	block_hashes_.insert(*piece_idx, hashes.first(real_block_count(file_tree, *piece_idx)));
+	return true;
+}
+
+std::optional<bool> Merkle_hashes::verify_block(const std::int32_t piece_idx, const std::int32_t block_idx, const QByteArray & block) const noexcept {
+	const auto block_hashes_itr = block_hashes_.constFind(piece_idx);
+
+	// leaves not known yet, or the padding after the end of the file
+	if(block_hashes_itr == block_hashes_.cend() || block_idx >= block_hashes_itr->size()) {
+		return {};
+	}
+
+	const auto * const file_tree = this->file_tree(piece_idx);
+	assert(file_tree);
+
+	const auto block_offset = static_cast<std::int64_t>(block_idx) * block_size;
+	const auto data_byte_cnt = std::min<std::int64_t>(block.size(), real_byte_count(*file_tree, piece_idx) - block_offset);
+
+	return hash(block.first(data_byte_cnt)) == (*block_hashes_itr)[block_idx];
+}
+
+QList<std::int32_t> Merkle_hashes::duplicate_pieces(const std::int32_t piece_idx) const noexcept {
+	const auto * const file_tree = this->file_tree(piece_idx);
+
+	if(!file_tree) {
+		return {};
+	}
+
+	QList<std::int32_t> duplicate_piece_idxes;
+
+	// files with equal roots have equal contents
+	for(const auto & duplicate_file_tree : files_) {
+
+		if(&duplicate_file_tree != file_tree && duplicate_file_tree.pieces_root == file_tree->pieces_root) {
+			duplicate_piece_idxes.push_back(duplicate_file_tree.first_piece_idx + piece_idx - file_tree->first_piece_idx);
+		}
+	}
+
+	return duplicate_piece_idxes;
+}
+
+std::optional<std::int32_t> Merkle_hashes::leaf_piece_index(const Hash_request & request) const noexcept {
+	const auto * const file_tree = this->file_tree(request.pieces_root);
+
+	if(!file_tree || !file_tree->piece_height || request.base_layer || request.length != 1 << file_tree->piece_height || request.index % request.length) {
+		return {};
+	}
+
+	const auto local_piece_idx = request.index >> file_tree->piece_height;
+
+	if(local_piece_idx < 0 || local_piece_idx >= file_tree->piece_cnt) {
+		return {};
+	}
+
+	return file_tree->first_piece_idx + local_piece_idx;
+}
+
+std::optional<QList<QByteArray>> Merkle_hashes::requested_hashes(const Hash_request & request, const QByteArray & piece) const noexcept {
+	const auto * const file_tree = this->file_tree(request.pieces_root);
+
+	// the uncles are computed from the piece layer
+	if(!file_tree || file_tree->piece_layer.isEmpty()) {
+		return {};
+	}
+
+	if(request.length <= 0 || request.length > max_hash_cnt || !std::has_single_bit(static_cast<std::uint32_t>(request.length)) || request.index < 0 ||
+	   request.index % request.length || request.base_layer < 0 || request.proof_layer_cnt < 0) {
+		return {};
+	}
+
+	const auto subtree_height = static_cast<std::int32_t>(std::bit_width(static_cast<std::uint32_t>(request.length))) - 1;
+	const auto subtree_layer = request.base_layer + subtree_height;
+
+	if(subtree_layer > file_tree->tree_height || request.proof_layer_cnt > file_tree->tree_height - subtree_layer ||
+	   (static_cast<std::int64_t>(request.index) >> subtree_height) >= std::int64_t{1} << (file_tree->tree_height - subtree_layer)) {
+		return {};
+	}
+
+	QList<QByteArray> hashes;
+
+	if(request.base_layer < file_tree->piece_height) { // leaves are only served for whole pieces, hashed from the piece itself
+		const auto piece_idx = leaf_piece_index(request);
+
+		if(!piece_idx || piece.isEmpty()) {
+			return {};
+		}
+
+		hashes = piece_block_hashes(*file_tree, *piece_idx, piece);
+
+		while(hashes.size() < request.length) {
+			hashes.push_back(pad_hash(0));
+		}
+	} else {
+		const auto base_layer = upper_layer(*file_tree, request.base_layer);
+
+		for(auto hash_idx = request.index; hash_idx < request.index + request.length; ++hash_idx) {
+			hashes.push_back(hash_idx < base_layer.size() ? base_layer[hash_idx] : pad_hash(request.base_layer));
+		}
+	}
+
+	if(!request.proof_layer_cnt) {
+		return hashes;
+	}
+
+	assert(subtree_layer >= file_tree->piece_height);
+
+	// uncles of the subtree root and of its ancestors, bottom up
+	auto layer = upper_layer(*file_tree, subtree_layer);
+	auto node_idx = request.index >> subtree_height;
+
+	for(auto layer_idx = subtree_layer; layer_idx < subtree_layer + request.proof_layer_cnt; ++layer_idx) {
+		const auto uncle_idx = node_idx ^ 1;
+		hashes.push_back(uncle_idx < layer.size() ? layer[uncle_idx] : pad_hash(layer_idx));
+		layer = parent_layer(layer, layer_idx);
+		node_idx >>= 1;
+	}
+
+	return hashes;
+}
\ No newline at end of file
@@ -59,12 +59,13 @@ void Network_manager::download(util::Download_resources resources, bencode::Meta
 	}
 
 	auto [first, last] = std::ranges::remove_if(tracker_urls, [](const std::string & tracker_url) {
-		return QUrl(tracker_url.data()).scheme() != "udp";
+		return !Tracker::is_supported_url(QUrl(tracker_url.data()));
 	});
 
 	tracker_urls.erase(first, last);
 
-	if(!tracker_urls.empty()) {
+	// trackerless torrents get their peers from the DHT
+	if(!tracker_urls.empty() || Dht_node::instance()) {
 		[[maybe_unused]]
 		auto * const udp_client = new Udp_torrent_client(std::move(torrent_metadata), std::move(resources), std::move(info_sha1_hash), this);
 	} else {
@@ -74,16 +75,16 @@ void Network_manager::download(util::Download_resources resources, bencode::Meta
 			file_handle->deleteLater();
 		});
 
-		QMessageBox::critical(nullptr, "No support", "Torapp doesn't support TCP trackers yet :(");
+		QMessageBox::critical(nullptr, "No trackers", "Torrent has no supported trackers and DHT is disabled.");
 	}
 }
 
 void Network_manager::download(QString dl_path, magnet::Metadata torrent_metadata, Download_tracker * const tracker) noexcept {
 	assert(tracker);
-	assert(!torrent_metadata.tracker_urls.empty());
+	assert(!torrent_metadata.tracker_urls.empty() || Dht_node::instance());
 	assert(!dl_path.isEmpty());
 
 	auto * const udp_client = new Udp_torrent_client(std::move(torrent_metadata), {std::move(dl_path), {}, tracker}, this);
 
 	connect(udp_client, &Udp_torrent_client::new_download_requested, this, &Network_manager::new_download_requested);
-}
+}
\ No newline at end of file
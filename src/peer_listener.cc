@@ -0,0 +1,176 @@
+#include "peer_listener.h"
+#include "peer_wire_client.h"
+#include "utp_socket.h"
+
+#include <QSettings>
+#include <QPointer>
+
+Peer_listener::Peer_listener(QObject * const parent) : QTcpServer(parent) {
+	QSettings settings;
+	settings.beginGroup("network");
+
+	max_accepts_per_sec_ = std::max(1.0, qvariant_cast<double>(settings.value("max_accepts_per_second", 10)));
+	max_inbound_connection_cnt_ = std::max(0, qvariant_cast<std::int32_t>(settings.value("max_inbound_connections", 200)));
+	accept_token_cnt_ = max_accepts_per_sec_;
+	accept_timer_.start();
+
+	if(!listen(QHostAddress::Any, listen_port())) {
+		qDebug() << "could not listen for incoming peers on port" << listen_port() << errorString();
+	}
+
+	if(qvariant_cast<bool>(settings.value("enable_utp", true))) {
+
+		if(auto * const utp_multiplexer = new Utp_multiplexer(listen_port(), this); utp_multiplexer->is_bound()) {
+			utp_multiplexer_ = utp_multiplexer;
+
+			connect(utp_multiplexer, &Utp_multiplexer::incoming_connection, this, [this](Utp_socket * const socket) {
+				if(!can_accept()) {
+					socket->deleteLater();
+					return socket->abort();
+				}
+
+				socket->setParent(this);
+				accept_socket(socket);
+			});
+		} else {
+			delete utp_multiplexer;
+		}
+	}
+}
+
+void Peer_listener::register_client(const QByteArray & info_sha1_hash, Peer_wire_client * const peer_client) noexcept {
+	assert(info_sha1_hash.size() == 40);
+	assert(peer_client);
+	peer_clients_[info_sha1_hash] = peer_client;
+}
+
+void Peer_listener::unregister_client(const QByteArray & info_sha1_hash, const Peer_wire_client * const peer_client) noexcept {
+
+	// the magnet client of a torrent can be destroyed after the client that replaced it got registered
+	if(const auto client_itr = peer_clients_.constFind(info_sha1_hash); client_itr != peer_clients_.cend() && *client_itr == peer_client) {
+		peer_clients_.erase(client_itr);
+	}
+}
+
+void Peer_listener::hand_over_sockets(const QByteArray & info_sha1_hash, const QList<Tcp_socket *> & sockets) noexcept {
+	assert(info_sha1_hash.size() == 40);
+
+	for(auto * const socket : sockets) {
+		assert(socket->state() == Tcp_socket::SocketState::ConnectedState);
+		socket->setParent(nullptr); // outlives the magnet client. disconnected sockets delete themselves
+		handed_over_sockets_[info_sha1_hash].push_back(socket);
+
+		// the download could not be started
+		QTimer::singleShot(handover_timeout, socket, [socket, info_sha1_hash] {
+			const auto sockets_itr = handed_over_sockets_.find(info_sha1_hash);
+
+			if(sockets_itr != handed_over_sockets_.end() && sockets_itr->removeOne(socket)) {
+				socket->abort();
+				socket->deleteLater();
+
+				if(sockets_itr->isEmpty()) {
+					handed_over_sockets_.erase(sockets_itr);
+				}
+			}
+		});
+	}
+}
+
+QList<Tcp_socket *> Peer_listener::take_handed_over_sockets(const QByteArray & info_sha1_hash) noexcept {
+	QList<Tcp_socket *> sockets;
+
+	for(const auto & socket : handed_over_sockets_.take(info_sha1_hash)) {
+
+		if(socket) {
+			sockets.push_back(socket);
+		}
+	}
+
+	return sockets;
+}
+
+bool Peer_listener::consume_accept_token() noexcept {
+	const auto elapsed_sec = static_cast<double>(accept_timer_.restart()) / 1000;
+	accept_token_cnt_ = std::min(max_accepts_per_sec_, accept_token_cnt_ + elapsed_sec * max_accepts_per_sec_);
+
+	if(accept_token_cnt_ < 1) {
+		return false;
+	}
+
+	--accept_token_cnt_;
+	return true;
+}
+
+bool Peer_listener::can_accept() noexcept {
+	return inbound_connection_cnt_ < max_inbound_connection_cnt_ && consume_accept_token();
+}
+
+void Peer_listener::incomingConnection(const qintptr socket_descriptor) {
+
+	if(!can_accept()) {
+		QTcpSocket rejected_socket;
+		rejected_socket.setSocketDescriptor(socket_descriptor);
+		rejected_socket.abort();
+		return;
+	}
+
+	accept_socket(new Tcp_socket(socket_descriptor, this));
+}
+
+void Peer_listener::accept_socket(Tcp_socket * const socket) noexcept {
+	assert(socket->parent() == this);
+
+	++inbound_connection_cnt_;
+
+	// outlives the hand over to the torrent
+	connect(socket, &Tcp_socket::destroyed, [listener = QPointer(this)] {
+		if(listener) {
+			assert(listener->inbound_connection_cnt_ > 0);
+			--listener->inbound_connection_cnt_;
+		}
+	});
+
+	connect(socket, &Tcp_socket::readyRead, this, [this, socket] {
+		if(socket->state() != Tcp_socket::SocketState::ConnectedState) {
+			return;
+		}
+
+		try {
+			if(const auto handshake = socket->receive_packet()) {
+				on_handshake_received(socket, *handshake);
+			}
+		} catch(const std::exception & exception) {
+			qDebug() << exception.what();
+			socket->abort();
+		}
+	});
+
+	constexpr std::chrono::seconds handshake_timeout(10);
+
+	QTimer::singleShot(handshake_timeout, socket, [this, socket] {
+		if(socket->parent() == this) {
+			qDebug() << "incoming peer did not send a handshake in time";
+			socket->abort();
+		}
+	});
+}
+
+void Peer_listener::on_handshake_received(Tcp_socket * const socket, const QByteArray & handshake) noexcept {
+	constexpr auto expected_handshake_size = 68;
+	constexpr auto info_hash_offset = 28;
+	constexpr auto info_hash_size = 20;
+
+	if(handshake.size() != expected_handshake_size) {
+		return socket->abort();
+	}
+
+	const auto info_sha1_hash = handshake.sliced(info_hash_offset, info_hash_size).toHex();
+
+	if(const auto client_itr = peer_clients_.constFind(info_sha1_hash); client_itr != peer_clients_.cend()) {
+		disconnect(socket, nullptr, this, nullptr);
+		(*client_itr)->on_incoming_connection(socket, handshake);
+	} else {
+		qDebug() << "incoming peer asked for an unknown torrent" << info_sha1_hash;
+		socket->abort();
+	}
+}
\ No newline at end of file
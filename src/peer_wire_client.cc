@@ -1,7 +1,12 @@
 #include "peer_wire_client.h"
 #include "download_tracker.h"
 #include "tcp_socket.h"
+#include "utp_socket.h"
 #include "magnet_url_parser.h"
+#include "peer_listener.h"
+#include "dht_node.h"
+#include "disk_io.h"
+#include "piece_buffer_pool.h"
 
 #include <QCryptographicHash>
 #include <QMessageBox>
@@ -13,9 +18,10 @@
 
 Peer_wire_client::Peer_wire_client(bencode::Metadata torrent_metadata, util::Download_resources resources, QByteArray id, QByteArray info_sha1_hash)
     : properties_displayer_(torrent_metadata),
+	merkle_hashes_(torrent_metadata),
 	id_(std::move(id)),
 	info_sha1_hash_(std::move(info_sha1_hash)),
-	handshake_msg_(craft_handshake_message()),
+	handshake_msg_(craft_handshake_message(info_sha1_hash_)),
 	dl_path_(std::move(resources.dl_path)),
 	torrent_metadata_(std::move(torrent_metadata)),
 	tracker_(resources.tracker),
@@ -25,13 +31,32 @@ Peer_wire_client::Peer_wire_client(bencode::Metadata torrent_metadata, util::Dow
 	spare_piece_cnt_(total_piece_cnt_ % 8 ? 8 - total_piece_cnt_ % 8 : 0),
 	average_block_cnt_(static_cast<std::int32_t>(std::ceil(static_cast<double>(torrent_piece_size_) / max_block_size))),
 	has_metadata_(true),
-	peer_additive_bitfield_(total_piece_cnt_ + spare_piece_cnt_, 0),
-	pieces_(total_piece_cnt_) {
+	peer_additive_bitfield_(total_piece_cnt_ + spare_piece_cnt_, 0) {
 
 	assert(torrent_piece_size_ > 0);
 	assert(!info_sha1_hash_.isEmpty());
 	assert(!id_.isEmpty());
 
+	// served to magnet peers (BEP 9)
+	raw_metadata_ = QByteArray(torrent_metadata_.raw_info_dict.data(), static_cast<qsizetype>(torrent_metadata_.raw_info_dict.size()));
+	metadata_size_ = raw_metadata_.size();
+	total_metadata_piece_cnt_ = static_cast<std::int64_t>(std::ceil(static_cast<double>(metadata_size_) / static_cast<double>(max_block_size)));
+
+	try {
+		const auto info_dict = bencode::parse_content(raw_metadata_);
+		const auto private_itr = info_dict.find("private");
+		is_private_ = private_itr != info_dict.end() && std::any_cast<std::int64_t>(private_itr->second) == 1;
+	} catch(const std::exception & exception) {
+		qDebug() << exception.what();
+	}
+
+	// BEP 52 peers may address a hybrid torrent by its v2 info hash
+	if(!merkle_hashes_.is_empty()) {
+		constexpr auto truncated_hash_size = 20;
+		info_v2_hash_ = QCryptographicHash::hash(raw_metadata_, QCryptographicHash::Algorithm::Sha256).first(truncated_hash_size).toHex();
+		Peer_listener::register_client(info_v2_hash_, this);
+	}
+
 	file_handles_.resize(resources.file_handles.size());
 
 	std::ranges::transform(std::as_const(resources.file_handles), file_handles_.begin(), [this](auto * const file_handle) {
@@ -43,7 +68,15 @@ Peer_wire_client::Peer_wire_client(bencode::Metadata torrent_metadata, util::Dow
 	resources.file_handles.clear();
 	resources.file_handles.squeeze();
 
+	file_beg_offsets_.reserve(file_handles_.size());
+
+	for(qsizetype file_idx = 0, file_beg_offset = 0; file_idx < file_handles_.size(); file_beg_offset += file_size(file_idx++)) {
+		file_beg_offsets_.push_back(file_beg_offset);
+	}
+
 	properties_displayer_.setup_file_info_widget(torrent_metadata_, file_handles_);
+	Peer_listener::register_client(info_sha1_hash_, this);
+	configure_connection_manager();
 	configure_default_connections();
 	read_settings();
 	verify_existing_pieces();
@@ -53,10 +86,16 @@ Peer_wire_client::Peer_wire_client(magnet::Metadata torrent_metadata, util::Down
     : properties_displayer_(torrent_metadata),
 	id_(std::move(id)),
 	info_sha1_hash_(std::move(torrent_metadata.info_hash)),
-	handshake_msg_(craft_handshake_message()),
+	handshake_msg_(craft_handshake_message(info_sha1_hash_)),
 	dl_path_(std::move(resources.dl_path)),
 	tracker_(resources.tracker) {
 
+	Peer_listener::register_client(info_sha1_hash_, this);
+	configure_connection_manager();
+
+	metadata_timer_.callOnTimeout(this, &Peer_wire_client::send_metadata_requests);
+	metadata_timer_.start(std::chrono::seconds(1));
+
 	connect(this, &Peer_wire_client::metadata_received, [this, torrent_metadata = std::move(torrent_metadata)] {
 		assert(metadata_size_ > 0);
 		assert(raw_metadata_.size() == metadata_size_);
@@ -66,6 +105,26 @@ Peer_wire_client::Peer_wire_client(magnet::Metadata torrent_metadata, util::Down
 			qDebug() << "hash of received metadata doesn't match - metadata flushed";
 			metadata_field_.fill(false);
 			obtained_metadata_piece_cnt_ = 0;
+			metadata_requests_.clear();
+
+			// the bad piece can't be told apart, so none of its sources are asked again. a lone source is surely lying
+			const auto sources = std::exchange(metadata_piece_sources_, {}).values();
+
+			for(const auto & source : sources) {
+
+				if(!source) {
+					continue;
+				}
+
+				if(sources.count(source) == sources.size()) {
+					qDebug() << "peer served corrupt metadata" << source->peer_url();
+					source->abort();
+				} else {
+					source->peer_lacks_metadata = true;
+				}
+			}
+
+			send_metadata_requests();
 			return;
 		}
 
@@ -80,17 +139,68 @@ Peer_wire_client::Peer_wire_client(magnet::Metadata torrent_metadata, util::Down
 			torrent_metadata_.file_info.emplace_back(torrent_metadata_.name, torrent_metadata_.single_file_size);
 		}
 
+		if(torrent_metadata_.raw_info_dict.empty()) { // so that the download serves it on
+			torrent_metadata_.raw_info_dict = raw_metadata_.toStdString();
+		}
+
+		metadata_timer_.stop();
+
 		const auto & tracker_urls = torrent_metadata.tracker_urls;
 
 		std::ranges::transform(std::as_const(tracker_urls), std::back_inserter(torrent_metadata_.announce_url_list), [](const QUrl & tracker_url) {
 			return tracker_url.toString().toStdString();
 		});
 
+		Peer_listener::unregister_client(info_sha1_hash_, this);
+		hand_over_peers(); // the download started below takes them over once its files are verified
 		emit new_download_requested(std::move(dl_path_), std::move(torrent_metadata_), std::move(info_sha1_hash_));
 		emit tracker_->request_satisfied();
 	});
 }
 
+Peer_wire_client::~Peer_wire_client() {
+	Peer_listener::unregister_client(info_sha1_hash_, this);
+
+	// hands the budget back to the other torrents
+	for(const auto piece_idx : std::as_const(reserved_piece_idxes_)) {
+		Piece_buffer_pool::instance().cancel_reservation(piece_size(piece_idx));
+	}
+
+	for(auto & piece : active_pieces_) {
+		Piece_buffer_pool::instance().release(std::move(piece.data));
+	}
+
+	if(!info_v2_hash_.isEmpty()) {
+		Peer_listener::unregister_client(info_v2_hash_, this);
+	}
+}
+
+void Peer_wire_client::configure_connection_manager() noexcept {
+	connect(&connection_manager_, &Connection_manager::dial_requested, this, &Peer_wire_client::on_dial_requested);
+
+	connect(tracker_, &Download_tracker::download_paused, &connection_manager_, [&connection_manager_ = connection_manager_] {
+		connection_manager_.set_paused(true);
+	});
+
+	connect(tracker_, &Download_tracker::download_resumed, &connection_manager_, [&connection_manager_ = connection_manager_] {
+		connection_manager_.set_paused(false);
+	});
+
+	// BEP 27: private torrents get their peers from the trackers only
+	if(is_private_) {
+		return;
+	}
+
+	// ticks more often than min_pex_interval so that each peer gets its next message once its own interval has passed
+	pex_timer_.callOnTimeout(this, [this] {
+		for(auto * const socket : connection_manager_.established_sockets()) {
+			send_pex_message(socket);
+		}
+	});
+
+	pex_timer_.start(std::chrono::seconds(10));
+}
+
 void Peer_wire_client::configure_default_connections() noexcept {
 	connect(this, &Peer_wire_client::piece_verified, this, &Peer_wire_client::on_piece_verified);
 	connect(this, &Peer_wire_client::existing_pieces_verified, tracker_, &Download_tracker::on_verification_completed);
@@ -99,6 +209,15 @@ void Peer_wire_client::configure_default_connections() noexcept {
 	connect(tracker_, &Download_tracker::torrent_open_button_clicked, &properties_displayer_, &Torrent_properties_displayer::display_file_bar);
 	connect(&settings_timer_, &QTimer::timeout, this, &Peer_wire_client::write_settings);
 
+	connect(&settings_timer_, &QTimer::timeout, this, [this] {
+		Token_bucket::reload_global_rates();
+		read_rate_limits();
+
+		for(auto * const socket : connection_manager_.established_sockets()) {
+			apply_rate_limits(socket);
+		}
+	});
+
 	connect(tracker_, &Download_tracker::move_files_to_trash, this, [&file_handles_ = file_handles_]() {
 		std::ranges::for_each(std::as_const(file_handles_), [](const auto file_info) {
 			file_info.first->moveToTrash();
@@ -121,10 +240,33 @@ void Peer_wire_client::configure_default_connections() noexcept {
 	connect(this, &Peer_wire_client::existing_pieces_verified, [this] {
 		state_ = remaining_byte_count() ? State::Leecher : State::Seed;
 		settings_timer_.start(std::chrono::seconds(1));
+		choke_timer_.start(std::chrono::seconds(10));
+		take_over_peers();
+	});
+
+	connect(tracker_, &Download_tracker::download_paused, &choke_timer_, &QTimer::stop);
+
+	connect(tracker_, &Download_tracker::download_paused, this, [this] {
+		std::ranges::for_each(web_seeds_, &Web_seed::stop);
+		web_seed_piece_idxes_.clear();
+	});
+
+	connect(tracker_, &Download_tracker::download_resumed, this, [this] {
+		if(state_ != State::Verification) {
+			choke_timer_.start(std::chrono::seconds(10));
+		}
 	});
 
+	choke_timer_.callOnTimeout(this, &Peer_wire_client::run_choker);
+
 	request_timer_.callOnTimeout(this, [this] {
 		assert(session_uled_byte_cnt_ >= 0 && session_dled_byte_cnt_ >= 0);
+
+		if(target_piece_idxes_.isEmpty() && remaining_byte_count()) { // the memory budget may have freed up
+			fill_target_piece_indexes();
+		}
+
+		assign_web_seed_pieces();
 		send_requests();
 	});
 }
@@ -132,18 +274,161 @@ void Peer_wire_client::configure_default_connections() noexcept {
 void Peer_wire_client::connect_to_peers(const QList<QUrl> & peer_urls) noexcept {
 	assert(!peer_urls.isEmpty());
 	qDebug() << "peers sent from the tracker" << peer_urls.size();
+	connection_manager_.add_candidates(peer_urls);
+}
 
-	std::ranges::for_each(std::as_const(peer_urls), [this](const auto & peer_url) {
-		if(!active_peers_.contains(peer_url)) {
-			auto * const socket = new Tcp_socket(peer_url, torrent_piece_size_, this);
+void Peer_wire_client::connect_to_local_peers(const QList<QUrl> & peer_urls) noexcept {
+	assert(!peer_urls.isEmpty());
 
-			connect(socket, &Tcp_socket::connected, this, [this, socket] {
-				on_socket_connected(socket);
-			});
+	for(const auto & peer_url : peer_urls) {
+		local_peer_hosts_.insert(peer_url.host());
+	}
+
+	// dialed ahead of the tracker and DHT peers
+	connection_manager_.add_candidates(peer_urls, Connection_manager::Priority::High);
+}
+
+void Peer_wire_client::add_web_seeds(const QList<QUrl> & web_seed_urls, QNetworkAccessManager * const network_manager) noexcept {
+	assert(has_metadata_);
+	assert(network_manager);
+
+	for(const auto & web_seed_url : web_seed_urls) {
+		auto * const web_seed = new Web_seed(web_seed_url, torrent_metadata_, network_manager, this);
+		web_seeds_.push_back(web_seed);
+
+		connect(web_seed, &Web_seed::pieces_received, this, [this, web_seed](const std::int32_t first_piece_idx, const std::int32_t piece_cnt, const QByteArray & pieces) {
+			on_web_seed_pieces_received(web_seed, first_piece_idx, piece_cnt, pieces);
+		});
+
+		connect(web_seed, &Web_seed::fetch_failed, this, [this, web_seed](const std::int32_t first_piece_idx, const std::int32_t piece_cnt) {
+			for(auto piece_idx = first_piece_idx; piece_idx < first_piece_idx + piece_cnt; ++piece_idx) {
+				web_seed_piece_idxes_.remove(piece_idx);
+			}
+
+			on_web_seed_failed(web_seed);
+		});
+	}
+
+	qDebug() << "web seeds" << web_seed_urls;
+}
+
+void Peer_wire_client::add_piece_layers(const QHash<QByteArray, QByteArray> & piece_layers) noexcept {
+	merkle_hashes_.add_piece_layers(piece_layers);
+}
+
+void Peer_wire_client::hand_over_peers() noexcept {
+	assert(!has_metadata_);
+	QList<Tcp_socket *> sockets;
+
+	for(auto * const socket : QSet(connection_manager_.established_sockets())) {
+
+		if(socket->state() != Tcp_socket::SocketState::ConnectedState || !socket->handshake_done) {
+			continue;
+		}
+
+		socket->disconnect(this);
+		disconnect(this, nullptr, socket, nullptr);
+		disconnect(tracker_, nullptr, socket, nullptr);
+		connection_manager_.release(socket);
+		properties_displayer_.remove_peer(socket);
+		socket->set_rate_limits(nullptr, nullptr, 0, 0); // the buckets go away with this client
+		sockets.push_back(socket);
+	}
+
+	qDebug() << "handing over peers to the download" << sockets.size();
+	Peer_listener::hand_over_sockets(info_sha1_hash_, sockets);
+}
+
+void Peer_wire_client::take_over_peers() noexcept {
+	const auto sockets = Peer_listener::take_handed_over_sockets(info_sha1_hash_);
+
+	for(auto * const socket : sockets) {
+		assert(socket->handshake_done);
+
+		if(socket->state() != Tcp_socket::SocketState::ConnectedState || !connection_manager_.can_accept()) {
+			socket->abort();
+			socket->deleteLater();
+			continue;
+		}
+
+		socket->setParent(this);
+		connection_manager_.on_peer_accepted(socket);
+		attach_socket(socket);
+		on_peer_established(socket, true);
+
+		// what the peer told the magnet download (bitfield, haves, unchoke) is applied as if it arrived now
+		for(const auto & message : std::exchange(socket->deferred_messages, {})) {
+
+			if(socket->state() != Tcp_socket::SocketState::ConnectedState) {
+				break;
+			}
+
+			try {
+				on_peer_message_received(socket, message);
+			} catch(const std::exception & exception) {
+				qDebug() << exception.what();
+				socket->abort();
+			}
+		}
+
+		if(socket->state() == Tcp_socket::SocketState::ConnectedState && socket->bytesAvailable()) {
+			on_socket_ready_read(socket);
 		}
+	}
+
+	if(!sockets.isEmpty()) {
+		qDebug() << "took over peers of the magnet download" << sockets.size();
+	}
+}
+
+void Peer_wire_client::on_dial_requested(const QUrl & peer_url) noexcept {
+	auto * const utp_multiplexer = Peer_listener::utp_multiplexer();
+	auto * const socket = utp_multiplexer && connection_manager_.prefers_utp(peer_url) ? new Utp_socket(peer_url, utp_multiplexer, this) : new Tcp_socket(peer_url, this);
+	connection_manager_.on_dial_started(socket);
+
+	connect(socket, &Tcp_socket::connected, this, [this, socket] {
+		on_socket_connected(socket);
 	});
 }
 
+void Peer_wire_client::on_incoming_connection(Tcp_socket * const socket, const QByteArray & handshake) noexcept {
+	assert(socket->state() == Tcp_socket::SocketState::ConnectedState);
+
+	if(state_ == State::Verification && has_metadata_) {
+		qDebug() << "incoming peer dropped while verifying existing pieces";
+		return socket->abort();
+	}
+
+	if(!connection_manager_.can_accept()) {
+		qDebug() << "incoming peer dropped, connection limit reached";
+		return socket->abort();
+	}
+
+	socket->setParent(this);
+	connection_manager_.on_peer_accepted(socket);
+
+	{
+		constexpr auto info_hash_offset = 28;
+		constexpr auto info_hash_size = 20;
+
+		// a hybrid torrent is reachable through both of its info hashes, the peer is answered with the one it asked for
+		const auto is_v2_handshake = !info_v2_hash_.isEmpty() && handshake.sliced(info_hash_offset, info_hash_size).toHex() == info_v2_hash_;
+		socket->send_packet(is_v2_handshake ? craft_handshake_message(info_v2_hash_) : handshake_msg_);
+		attach_socket(socket);
+	}
+
+	try {
+		on_handshake_reply_received(socket, handshake);
+	} catch(const std::exception & exception) {
+		qDebug() << exception.what();
+		return socket->abort();
+	}
+
+	if(socket->state() == Tcp_socket::SocketState::ConnectedState && socket->bytesAvailable()) {
+		on_socket_ready_read(socket);
+	}
+}
+
 std::int32_t Peer_wire_client::piece_size(const std::int32_t piece_idx) const noexcept {
 	assert(is_valid_piece_index(piece_idx));
 	const auto piece_size = piece_idx == total_piece_cnt_ - 1 && total_byte_cnt_ % torrent_piece_size_ ? total_byte_cnt_ % torrent_piece_size_ : torrent_piece_size_;
@@ -207,13 +492,23 @@ void Peer_wire_client::fill_target_piece_indexes() noexcept {
 	assert(target_piece_idxes_.isEmpty());
 
 	const auto choose_min_freq_piece = dled_piece_cnt_ > 1;
+	constexpr auto max_target_piece_cnt = 2;
+
+	// finish pieces that already have blocks (possibly from before a restart) before opening new ones
+	for(auto piece_itr = active_pieces_.cbegin(); piece_itr != active_pieces_.cend() && target_piece_idxes_.size() < max_target_piece_cnt; ++piece_itr) {
+
+		if(!bitfield_[piece_itr.key()] && piece_itr->received_block_cnt) {
+			target_piece_idxes_.push_back(piece_itr.key());
+		}
+	}
 
-	for(constexpr auto max_target_piece_cnt = 2; target_piece_idxes_.size() < max_target_piece_cnt;) {
+	// stop opening new pieces once in-progress piece buffers hit the global memory budget
+	while(target_piece_idxes_.size() < max_target_piece_cnt) {
 		std::optional<std::int32_t> target_piece_idx;
 
 		for(std::int32_t piece_idx = 0; piece_idx < total_piece_cnt_; ++piece_idx) {
 
-			if(bitfield_[piece_idx] || target_piece_idxes_.contains(piece_idx)) {
+			if(bitfield_[piece_idx] || target_piece_idxes_.contains(piece_idx) || web_seed_piece_idxes_.contains(piece_idx)) {
 				continue;
 			}
 
@@ -236,10 +531,15 @@ void Peer_wire_client::fill_target_piece_indexes() noexcept {
 		assert(is_valid_piece_index(*target_piece_idx));
 		assert(!bitfield_[*target_piece_idx]);
 
+		// each pick holds its buffer's worth of the budget, otherwise one pass could pick past it
+		if(!Piece_buffer_pool::instance().reserve(piece_size(*target_piece_idx))) {
+			break;
+		}
+
+		reserved_piece_idxes_.insert(*target_piece_idx);
 		target_piece_idxes_.push_back(*target_piece_idx);
 	}
 
-	assert(!target_piece_idxes_.isEmpty());
 	qDebug() << "Updated target piece_idxes" << target_piece_idxes_ << peer_additive_bitfield_;
 }
 
@@ -253,12 +553,16 @@ void Peer_wire_client::verify_existing_pieces() noexcept {
 
 			if(bitfield_[piece_idx]) { // todo: let the user decide if only torapp-downloaded pieces should be verified
 
-				if(const auto piece = read_from_disk(piece_idx); piece && verify_piece_hash(*piece, piece_idx)) {
-					emit piece_verified(piece_idx);
-				} else {
-					qDebug() << piece_idx << "was changed on the disk";
-					bitfield_[piece_idx] = false;
-				}
+				return read_from_disk(piece_idx, [this, verify_piece_callback, piece_idx](const std::optional<QByteArray> piece) {
+					if(piece && verify_piece_hash(*piece, piece_idx)) {
+						emit piece_verified(piece_idx);
+					} else {
+						qDebug() << piece_idx << "was changed on the disk";
+						bitfield_[piece_idx] = false;
+					}
+
+					verify_piece_callback(verify_piece_callback, piece_idx + 1);
+				});
 			}
 
 			QTimer::singleShot(0, this, [verify_piece_callback, piece_idx] {
@@ -268,6 +572,7 @@ void Peer_wire_client::verify_existing_pieces() noexcept {
 			if(remaining_byte_count()) {
 				assert(dled_piece_cnt_ >= 0 && dled_piece_cnt_ < total_piece_cnt_);
 				tracker_->set_state(Download_tracker::State::Download);
+				fill_target_piece_indexes();
 				request_timer_.start(std::chrono::milliseconds(100));
 			}
 
@@ -287,7 +592,11 @@ void Peer_wire_client::verify_existing_pieces() noexcept {
 
 void Peer_wire_client::on_socket_connected(Tcp_socket * const socket) noexcept {
 	socket->send_packet(handshake_msg_);
+	attach_socket(socket);
+}
 
+void Peer_wire_client::attach_socket(Tcp_socket * const socket) noexcept {
+	apply_rate_limits(socket);
 	connect(tracker_, &Download_tracker::download_paused, socket, &Tcp_socket::disconnectFromHost);
 
 	connect(socket, &Tcp_socket::readyRead, this, [this, socket] {
@@ -303,18 +612,12 @@ void Peer_wire_client::on_socket_connected(Tcp_socket * const socket) noexcept {
 
 	connect(socket, &Tcp_socket::disconnected, this, [this, socket] {
 		if(socket->handshake_done) {
-			qDebug() << "peer disconnected after doing handshake :(" << "[ Active peers:" << active_peers_.size() << ']';
-
-			{
-				const auto peer_idx = active_peers_.indexOf(socket->peer_url());
-				assert(peer_idx != -1);
-				properties_displayer_.remove_peer(static_cast<std::int32_t>(peer_idx));
-				active_peers_.remove(peer_idx);
-			}
+			qDebug() << "peer disconnected after doing handshake :(" << "[ Active peers:" << connection_manager_.connection_count() << ']';
+			properties_displayer_.remove_peer(socket);
 
 			for(qsizetype piece_idx = 0; piece_idx < socket->peer_bitfield.size(); ++piece_idx) {
+				assert(peer_additive_bitfield_[piece_idx] >= socket->peer_bitfield[piece_idx]);
 				peer_additive_bitfield_[piece_idx] -= socket->peer_bitfield[piece_idx];
-				assert(peer_additive_bitfield_[piece_idx] >= 0);
 			}
 		}
 	});
@@ -330,6 +633,14 @@ void Peer_wire_client::on_socket_ready_read(Tcp_socket * const socket) noexcept
 		return;
 	}
 
+	if(!socket->can_receive()) {
+		return QTimer::singleShot(socket->receive_delay(), this, [this, socket, is_valid_socket] {
+			if(is_valid_socket()) {
+				on_socket_ready_read(socket);
+			}
+		});
+	}
+
 	try {
 		communicate_with_peer(socket);
 	} catch(const std::exception & exception) {
@@ -366,18 +677,39 @@ QByteArray Peer_wire_client::craft_have_message(const std::int32_t piece_idx) no
 	return have_msg + convert_to_hex(piece_idx);
 }
 
-QByteArray Peer_wire_client::craft_handshake_message() const noexcept {
+QByteArray Peer_wire_client::craft_handshake_message(const QByteArray & info_hash) const noexcept {
 
 	const static auto handshake_msg = [] {
 		constexpr std::int8_t pstrlen = 19;
 		static_assert(protocol_tag.size() == pstrlen);
-		return util::conversion::convert_to_hex(pstrlen) + QByteArray(protocol_tag.data()).toHex() + reserved_bytes.data();
+		return util::conversion::convert_to_hex(pstrlen) + QByteArray(protocol_tag.data()).toHex();
 	}();
 
-	assert(info_sha1_hash_.size() == 40);
+	assert(info_hash.size() == 40);
 	assert(id_.size() == 40);
 
-	return handshake_msg + info_sha1_hash_ + id_;
+	// hash messages are only of use for torrents with v2 hashes
+	const auto & handshake_reserved_bytes = merkle_hashes_.is_empty() ? reserved_bytes : v2_reserved_bytes;
+
+	return handshake_msg + handshake_reserved_bytes.data() + info_hash + id_;
+}
+
+QByteArray Peer_wire_client::craft_hash_message(const Message_Id msg_id, const Merkle_hashes::Hash_request & hash_request, const QList<QByteArray> & hashes) noexcept {
+	assert(msg_id == Message_Id::Hash_Request || msg_id == Message_Id::Hashes || msg_id == Message_Id::Hash_Reject);
+	assert(hash_request.pieces_root.size() == Merkle_hashes::hash_byte_cnt);
+
+	using util::conversion::convert_to_hex;
+
+	const auto hash_packet_size = hash_msg_header_size + static_cast<std::int32_t>(hashes.size()) * Merkle_hashes::hash_byte_cnt;
+
+	auto hash_msg = convert_to_hex(hash_packet_size) + convert_to_hex(static_cast<std::int8_t>(msg_id)) + hash_request.pieces_root.toHex();
+	hash_msg += convert_to_hex(hash_request.base_layer) + convert_to_hex(hash_request.index) + convert_to_hex(hash_request.length) + convert_to_hex(hash_request.proof_layer_cnt);
+
+	for(const auto & hash : hashes) {
+		hash_msg += hash.toHex();
+	}
+
+	return hash_msg;
 }
 
 QByteArray Peer_wire_client::craft_piece_message(const QByteArray & piece_data, const std::int32_t piece_idx, const std::int32_t piece_offset) noexcept {
@@ -451,9 +783,17 @@ std::optional<std::pair<QByteArray, QByteArray>> Peer_wire_client::verify_handsh
 			socket->fast_extension_enabled = true;
 		}
 
-		if(constexpr auto extension_protocol_bit_idx = 43; !has_metadata_ && peer_reserved_bits[extension_protocol_bit_idx]) {
+		if(constexpr auto extension_protocol_bit_idx = 43; peer_reserved_bits[extension_protocol_bit_idx]) {
 			socket->extension_protocol_enabled = true;
 		}
+
+		if(constexpr auto dht_bit_idx = 63; peer_reserved_bits[dht_bit_idx]) {
+			socket->dht_enabled = true;
+		}
+
+		if(constexpr auto v2_bit_idx = 59; peer_reserved_bits[v2_bit_idx]) {
+			socket->v2_enabled = true;
+		}
 	}
 
 	auto peer_info_hash = [&reply] {
@@ -477,17 +817,19 @@ void Peer_wire_client::send_block_requests(Tcp_socket * const socket, const std:
 	assert(socket->peer_bitfield[piece_idx]);
 	assert(!socket->peer_choked || socket->fast_extension_enabled);
 
+	send_block_hash_request(socket, piece_idx);
+
 	const auto total_block_cnt = piece_info(piece_idx).block_cnt;
 	constexpr auto max_duplicate_requests = 2;
 
 	auto send_block_request_impl = [this, piece_idx, total_block_cnt, socket](auto send_block_request_callback, const std::int32_t block_idx) -> void {
 		assert(block_idx >= 0 && block_idx <= total_block_cnt);
 
-		if(block_idx == total_block_cnt) {
+		if(block_idx == total_block_cnt || bitfield_[piece_idx]) {
 			return;
 		}
 
-		auto & [requested_blocks, received_blocks, piece_data, received_block_cnt] = pieces_[piece_idx];
+		auto & [requested_blocks, received_blocks, piece_data, received_block_cnt, restored] = active_pieces_[piece_idx];
 
 		if(requested_blocks.empty()) {
 			requested_blocks.resize(total_block_cnt, 0);
@@ -526,34 +868,35 @@ void Peer_wire_client::send_block_requests(Tcp_socket * const socket, const std:
 
 		++requested_blocks[block_idx];
 
-		const auto dec_connection = connect(socket, &Tcp_socket::disconnected, this, [&requested_blocks = requested_blocks, block_idx] {
-			if(!requested_blocks.empty()) {
-				assert(requested_blocks[block_idx] > 0);
-				--requested_blocks[block_idx];
+		// looked up on each use since the piece state is dropped once the piece completes
+		auto dec_requested_block = [this, piece_idx, block_idx] {
+			if(const auto piece_itr = active_pieces_.find(piece_idx); piece_itr != active_pieces_.end() && !piece_itr->requested_blocks.empty()) {
+				auto & block_request_cnt = piece_itr->requested_blocks[block_idx];
+				block_request_cnt = static_cast<std::int8_t>(std::max(0, block_request_cnt - 1));
 			}
-		});
+		};
+
+		const auto dec_connection = connect(socket, &Tcp_socket::disconnected, this, dec_requested_block);
 
 		connect(
 		    socket, &Tcp_socket::got_choked, this,
-		    [&requested_blocks = requested_blocks, socket, block_idx, dec_connection] {
+		    [socket, dec_requested_block, dec_connection] {
 			    assert(socket->peer_choked);
 
-			    if(socket->state() == Tcp_socket::SocketState::ConnectedState && !socket->fast_extension_enabled && !requested_blocks.empty()) {
-				    assert(requested_blocks[block_idx] > 0);
-				    --requested_blocks[block_idx];
+			    if(socket->state() == Tcp_socket::SocketState::ConnectedState && !socket->fast_extension_enabled) {
+				    dec_requested_block();
 				    disconnect(dec_connection);
 			    }
 		    },
 		    Qt::SingleShotConnection);
 
-		auto on_request_rejected = [=, &requested_blocks = requested_blocks, decremented = false](const auto & rejected_request_metadata) mutable {
-			if(decremented || requested_blocks.empty() || socket->state() != Tcp_socket::SocketState::ConnectedState) {
+		auto on_request_rejected = [socket, dec_requested_block, dec_connection, decremented = false](const auto & rejected_request_metadata) mutable {
+			if(decremented || socket->state() != Tcp_socket::SocketState::ConnectedState) {
 				return;
 			}
 
 			if(socket->rejected_requests.contains(rejected_request_metadata)) {
-				assert(requested_blocks[block_idx] > 0);
-				--requested_blocks[block_idx];
+				dec_requested_block();
 				decremented = true;
 				disconnect(dec_connection);
 			}
@@ -585,7 +928,11 @@ void Peer_wire_client::on_block_request_received(Tcp_socket * const socket, cons
 		return send_reject_message();
 	}
 
-	if((!socket->is_good_ratio() || (!socket->peer_interested || socket->am_choking)) && !socket->allowed_fast_set.contains(requested_piece_idx)) {
+	if((!socket->peer_interested || socket->am_choking) && !socket->allowed_fast_set.contains(requested_piece_idx)) {
+		return send_reject_message();
+	}
+
+	if(socket->super_seeded && !socket->super_seed_piece_idxes.contains(requested_piece_idx)) {
 		return send_reject_message();
 	}
 
@@ -596,32 +943,40 @@ void Peer_wire_client::on_block_request_received(Tcp_socket * const socket, cons
 		socket->add_uploaded_bytes(requested_byte_cnt);
 		tracker_->set_upload_byte_count(uled_byte_cnt_ += requested_byte_cnt);
 
-		socket->send_packet(craft_piece_message(piece_to_send.sliced(offset, requested_byte_cnt), piece_idx, offset));
+		socket->send_rate_limited_packet(craft_piece_message(piece_to_send.sliced(offset, requested_byte_cnt), piece_idx, offset));
 	};
 
-	if(!pieces_[requested_piece_idx].data.isEmpty()) {
+	if(const auto piece_itr = active_pieces_.constFind(requested_piece_idx); piece_itr != active_pieces_.cend() && !piece_itr->data.isEmpty()) {
 		qDebug() << "Sending piece" << requested_piece_idx << "from the buffer";
-		assert(verify_piece_hash(pieces_[requested_piece_idx].data, requested_piece_idx));
-		return send_piece(pieces_[requested_piece_idx].data);
+		assert(verify_piece_hash(piece_itr->data, requested_piece_idx));
+		return send_piece(piece_itr->data);
 	}
 
 	socket->send_packet(keep_alive_msg.data());
 
-	QTimer::singleShot(0, this, [this, socket = QPointer(socket), send_piece, send_reject_message, requested_piece_idx = requested_piece_idx] {
+	read_from_disk(requested_piece_idx, [this, socket = QPointer(socket), send_piece, send_reject_message, requested_piece_idx = requested_piece_idx](std::optional<QByteArray> piece) {
 		assert(bitfield_[requested_piece_idx]);
 
 		if(!socket || socket->state() != Tcp_socket::SocketState::ConnectedState) {
 			return;
 		}
 
-		if(!pieces_[requested_piece_idx].data.isEmpty()) {
+		// choked while the piece was read
+		if((!socket->peer_interested || socket->am_choking) && !socket->allowed_fast_set.contains(requested_piece_idx)) {
+			return send_reject_message();
+		}
+
+		// another request of the piece may have been read in the meantime
+		if(const auto piece_itr = active_pieces_.constFind(requested_piece_idx); piece_itr != active_pieces_.cend() && !piece_itr->data.isEmpty()) {
 			qDebug() << "Sending piece" << requested_piece_idx << "from the buffer";
-			return send_piece(pieces_[requested_piece_idx].data);
+			return send_piece(piece_itr->data);
 		}
 
-		if(auto piece = read_from_disk(requested_piece_idx); piece && verify_piece_hash(*piece, requested_piece_idx)) {
-			pieces_[requested_piece_idx].data = std::move(*piece);
-			send_piece(pieces_[requested_piece_idx].data);
+		if(piece && verify_piece_hash(*piece, requested_piece_idx)) {
+			// not pooled, the cache is dropped again shortly
+			auto & cached_piece_data = active_pieces_[requested_piece_idx].data;
+			cached_piece_data = std::move(*piece);
+			send_piece(cached_piece_data);
 
 			constexpr std::chrono::seconds piece_cleanup_timeout(15);
 
@@ -634,130 +989,92 @@ void Peer_wire_client::on_block_request_received(Tcp_socket * const socket, cons
 	});
 }
 
-std::optional<std::pair<qsizetype, qsizetype>> Peer_wire_client::beginning_file_handle_info(const std::int32_t piece_idx) const noexcept {
+auto Peer_wire_client::file_spans(const std::int32_t piece_idx, const std::int32_t piece_offset, const std::int64_t byte_cnt) const noexcept -> QList<File_span> {
 	assert(is_valid_piece_index(piece_idx));
+	assert(piece_offset >= 0 && byte_cnt > 0);
+	assert(file_beg_offsets_.size() == file_handles_.size());
 
-	for(qsizetype file_handle_idx = 0, file_size_sum = 0; file_handle_idx < file_handles_.size(); ++file_handle_idx) {
-		const auto file_size_sum_old = file_size_sum;
-		file_size_sum += file_size(file_handle_idx);
-
-		const auto end_piece_idx = static_cast<std::int32_t>(std::ceil(static_cast<double>(file_size_sum) / static_cast<double>(torrent_piece_size_))) - 1;
-
-		if(end_piece_idx >= piece_idx) {
-			const auto prev_offset_delta = file_size_sum_old % torrent_piece_size_ ? torrent_piece_size_ - file_size_sum_old % torrent_piece_size_ : 0;
-			assert((prev_offset_delta + file_size_sum_old) % torrent_piece_size_ == 0);
+	const auto beg_torrent_offset = piece_idx * torrent_piece_size_ + piece_offset;
 
-			const auto beg_piece_idx = file_size_sum_old / torrent_piece_size_ + static_cast<bool>(prev_offset_delta);
-			assert(piece_idx >= beg_piece_idx);
-
-			const auto prior_piece_cnt = piece_idx - beg_piece_idx;
-			assert(prior_piece_cnt >= 0);
-			const auto file_offset = prior_piece_cnt * torrent_piece_size_ + prev_offset_delta;
-
-			return std::make_pair(file_handle_idx, file_offset);
-		}
+	if(beg_torrent_offset + byte_cnt > total_byte_cnt_) {
+		return {};
 	}
 
-	return {};
-}
+	// last file beginning at or before the offset. zero sized files share their offset with the next one and are skipped below
+	auto file_handle_idx = std::ranges::upper_bound(file_beg_offsets_, beg_torrent_offset) - file_beg_offsets_.cbegin() - 1;
+	assert(file_handle_idx >= 0);
 
-bool Peer_wire_client::write_to_disk(const QByteArray & received_piece, const std::int32_t received_piece_idx) noexcept {
-	assert(received_piece.size() == piece_size(received_piece_idx));
-	assert(verify_piece_hash(received_piece, received_piece_idx));
+	QList<File_span> spans;
 
-	const auto file_handle_info = beginning_file_handle_info(received_piece_idx);
+	for(std::int64_t spanned_byte_cnt = 0; spanned_byte_cnt < byte_cnt; ++file_handle_idx) {
+		assert(file_handle_idx < file_handles_.size());
 
-	if(!file_handle_info) {
-		return false;
-	}
+		const auto file_offset = beg_torrent_offset + spanned_byte_cnt - file_beg_offsets_[file_handle_idx];
+		const auto span_byte_cnt = std::min(byte_cnt - spanned_byte_cnt, file_size(file_handle_idx) - file_offset);
 
-	const auto [beg_file_handle_idx, beg_file_offset] = *file_handle_info;
-	assert(beg_file_handle_idx < file_handles_.size());
+		if(span_byte_cnt <= 0) {
+			continue;
+		}
 
-	const auto beg_file_byte_cnt = file_size(beg_file_handle_idx) - beg_file_offset;
-	assert(beg_file_byte_cnt);
+		spans.push_back({file_handle_idx, file_offset, spanned_byte_cnt, span_byte_cnt});
+		spanned_byte_cnt += span_byte_cnt;
+	}
 
-	for(std::int64_t written_byte_cnt = 0, file_handle_idx = beg_file_handle_idx; written_byte_cnt < received_piece.size(); ++file_handle_idx) {
-		assert(file_handle_idx < file_handles_.size());
+	return spans;
+}
 
-		auto & [file_handle, file_dled_byte_cnt] = file_handles_[file_handle_idx];
-		file_handle->seek(written_byte_cnt ? 0 : beg_file_offset);
+void Peer_wire_client::write_to_disk(QByteArray data, const std::int32_t piece_idx, const std::int32_t piece_offset, std::function<void(bool)> on_written) noexcept {
+	assert(!data.isEmpty());
+	assert(piece_offset + data.size() <= piece_size(piece_idx));
 
-		const auto to_write_byte_cnt = std::min(received_piece.size() - written_byte_cnt, written_byte_cnt ? file_size(file_handle_idx) : beg_file_byte_cnt);
+	const auto spans = file_spans(piece_idx, piece_offset, data.size());
+	assert(!spans.isEmpty());
 
-		assert(to_write_byte_cnt > 0);
-		assert(file_handle->pos() + to_write_byte_cnt <= file_size(file_handle_idx));
+	QList<Disk_io::Request> write_requests(spans.size());
 
-		const auto newly_written_byte_cnt = file_handle->write(received_piece.sliced(written_byte_cnt, to_write_byte_cnt));
-		file_dled_byte_cnt += newly_written_byte_cnt;
-		assert(file_handle->pos() <= file_size(file_handle_idx));
+	std::ranges::transform(spans, write_requests.begin(), [this, &data](const File_span & span) {
+		// Disk_io only reads from the buffer when writing
+		return Disk_io::Request{file_handles_[span.file_handle_idx].first, span.file_offset, const_cast<char *>(data.constData()) + span.buffer_offset, span.byte_cnt};
+	});
 
-		if(newly_written_byte_cnt != to_write_byte_cnt) {
+	// the data is shared with Disk_io, not copied, until the write completes
+	Disk_io::instance().write(std::move(write_requests), std::move(data), this, [on_written = std::move(on_written)](const std::optional<QByteArray> & written_data) {
+		if(!written_data) {
 			qDebug() << "Could not write to file";
-			return false;
 		}
 
-		written_byte_cnt += newly_written_byte_cnt;
-		assert(written_byte_cnt <= received_piece.size());
-		file_handle->flush();
-	}
-
-	assert(read_from_disk(received_piece_idx));
-	assert(received_piece == read_from_disk(received_piece_idx));
-	return true;
+		on_written(written_data.has_value());
+	});
 }
 
-std::optional<QByteArray> Peer_wire_client::read_from_disk(const std::int32_t requested_piece_idx) noexcept {
+void Peer_wire_client::read_from_disk(const std::int32_t requested_piece_idx, std::function<void(std::optional<QByteArray>)> on_read) noexcept {
 	assert(is_valid_piece_index(requested_piece_idx));
 
-	const auto beg_file_handle_info = beginning_file_handle_info(requested_piece_idx);
-
-	if(!beg_file_handle_info) {
-		return {};
-	}
-
 	const auto requested_piece_size = piece_size(requested_piece_idx);
+	auto spans = file_spans(requested_piece_idx, 0, requested_piece_size);
+	assert(!spans.isEmpty());
 
-	QByteArray resultant_piece;
-	resultant_piece.reserve(requested_piece_size);
-
-	const auto [beg_file_handle_idx, beg_file_offset] = *beg_file_handle_info;
-	assert(beg_file_handle_idx < file_handles_.size());
-
-	const auto beg_file_byte_cnt = file_size(beg_file_handle_idx) - beg_file_offset;
-	assert(beg_file_byte_cnt > 0);
-
-	for(qsizetype file_handle_idx = beg_file_handle_idx; resultant_piece.size() < requested_piece_size; ++file_handle_idx) {
-
-		if(file_handle_idx == file_handles_.size()) {
-			return {};
-		}
-
-		auto & [file_handle, file_dled_byte_cnt] = file_handles_[file_handle_idx];
-		file_handle->seek(resultant_piece.size() ? 0 : beg_file_offset);
-
-		const auto to_read_byte_cnt = std::min(resultant_piece.size() ? file_size(file_handle_idx) : beg_file_byte_cnt, requested_piece_size - resultant_piece.size());
-		assert(to_read_byte_cnt > 0);
+	QByteArray resultant_piece(requested_piece_size, Qt::Uninitialized);
+	QList<Disk_io::Request> read_requests(spans.size());
 
-		const auto newly_read_bytes = file_handle->read(to_read_byte_cnt);
-
-		if(newly_read_bytes.size() != to_read_byte_cnt) {
-			return {};
-		}
+	std::ranges::transform(spans, read_requests.begin(), [this, &resultant_piece](const File_span & span) {
+		return Disk_io::Request{file_handles_[span.file_handle_idx].first, span.file_offset, resultant_piece.data() + span.buffer_offset, span.byte_cnt};
+	});
 
-		if(state_ == State::Verification) {
-			file_dled_byte_cnt += newly_read_bytes.size();
+	// read straight into the piece, which Disk_io hands back once every span is in
+	Disk_io::instance().read(std::move(read_requests), std::move(resultant_piece), this, [this, spans = std::move(spans), on_read = std::move(on_read)](std::optional<QByteArray> piece) {
+		if(piece && state_ == State::Verification) {
+			std::ranges::for_each(spans, [this](const File_span & span) {
+				file_handles_[span.file_handle_idx].second += span.byte_cnt;
+			});
 		}
 
-		resultant_piece += newly_read_bytes;
-	}
-
-	assert(resultant_piece.size() == requested_piece_size);
-	return resultant_piece;
+		on_read(std::move(piece));
+	});
 }
 
 bool Peer_wire_client::is_valid_reply(Tcp_socket * const socket, const QByteArray & reply, const Message_Id received_msg_id) noexcept {
-	constexpr auto max_msg_id = 20;
+	constexpr auto max_msg_id = 23;
 
 	if(static_cast<std::int32_t>(received_msg_id) > max_msg_id) {
 		qDebug() << "peer sent out of range id" << received_msg_id;
@@ -776,12 +1093,17 @@ bool Peer_wire_client::is_valid_reply(Tcp_socket * const socket, const QByteArra
 	    13, // request
 	    pseudo,
 	    13, // cancel
-	    pseudo, pseudo, pseudo, pseudo,
+	    3,  // port
+	    pseudo, pseudo, pseudo,
 	    5,  // suggest piece
 	    1,  // have all
 	    1,  // have none
 	    13, // reject reply
-	    5	  // allowed fast
+	    5,  // allowed fast
+	    pseudo, pseudo, pseudo,
+	    49, // hash request
+	    pseudo,
+	    49  // hash reject
 	};
 
 	switch(received_msg_id) {
@@ -801,6 +1123,15 @@ bool Peer_wire_client::is_valid_reply(Tcp_socket * const socket, const QByteArra
 			return reply.size() >= min_extended_msg_size;
 		}
 
+		case Message_Id::Hashes: {
+			return socket->v2_enabled && reply.size() >= hash_msg_header_size && (reply.size() - hash_msg_header_size) % Merkle_hashes::hash_byte_cnt == 0;
+		}
+
+		case Message_Id::Hash_Request:
+		case Message_Id::Hash_Reject: {
+			return socket->v2_enabled && reply.size() == expected_reply_sizes[static_cast<std::size_t>(received_msg_id)];
+		}
+
 		default: {
 			const auto expected_size = expected_reply_sizes[static_cast<std::size_t>(received_msg_id)];
 
@@ -825,19 +1156,84 @@ void Peer_wire_client::write_settings() const noexcept {
 	settings.beginGroup(QString(dl_path_).replace('/', '\x20'));
 	settings.setValue("bitfield", bitfield_);
 	settings.setValue("uploaded_byte_count", QVariant::fromValue(uled_byte_cnt_));
+
+	QVariantMap partial_pieces; // {piece_idx,received block bitmap}
+
+	for(auto piece_itr = active_pieces_.cbegin(); piece_itr != active_pieces_.cend(); ++piece_itr) {
+
+		if(piece_itr->received_block_cnt && !bitfield_[piece_itr.key()]) {
+			partial_pieces.insert(QString::number(piece_itr.key()), piece_itr->received_blocks);
+		}
+	}
+
+	settings.setValue("partial_pieces", partial_pieces);
+}
+
+// the limits may change while the torrent runs, so they are read again on every settings tick
+void Peer_wire_client::read_rate_limits() noexcept {
+	QSettings settings;
+	peer_upload_byte_rate_ = qvariant_cast<std::int64_t>(settings.value("network/max_peer_upload_rate", 0));
+	peer_download_byte_rate_ = qvariant_cast<std::int64_t>(settings.value("network/max_peer_download_rate", 0));
+	rate_limit_lan_peers_ = qvariant_cast<bool>(settings.value("network/rate_limit_lan_peers", false));
+
+	settings.beginGroup("torrent_downloads");
+	settings.beginGroup(QString(dl_path_).replace('/', '\x20'));
+
+	upload_bucket_.set_byte_rate(qvariant_cast<std::int64_t>(settings.value("max_upload_rate", 0)));
+	download_bucket_.set_byte_rate(qvariant_cast<std::int64_t>(settings.value("max_download_rate", 0)));
+}
+
+void Peer_wire_client::apply_rate_limits(Tcp_socket * const socket) noexcept {
+	assert(socket);
+
+	if(rate_limit_lan_peers_ || !(socket->is_lan_peer() || local_peer_hosts_.contains(socket->peer_url().host()))) {
+		socket->set_rate_limits(&upload_bucket_, &download_bucket_, peer_upload_byte_rate_, peer_download_byte_rate_);
+	} else {
+		socket->set_rate_limits(nullptr, nullptr, 0, 0);
+	}
 }
 
 void Peer_wire_client::read_settings() noexcept {
 	QSettings settings;
+	upload_slot_cnt_ = std::max(1, qvariant_cast<std::int32_t>(settings.value("network/upload_slots", upload_slot_cnt_)));
+	super_seeding_ = qvariant_cast<bool>(settings.value("network/super_seeding", false));
+
 	settings.beginGroup("torrent_downloads");
 	settings.beginGroup(QString(dl_path_).replace('/', '\x20'));
 
+	super_seeding_ = qvariant_cast<bool>(settings.value("super_seeding", super_seeding_)); // per torrent override
+	read_rate_limits();
+
 	bitfield_ = qvariant_cast<QBitArray>(settings.value("bitfield"));
 
 	if(bitfield_.isEmpty()) {
 		bitfield_.resize(total_piece_cnt_ + spare_piece_cnt_);
 	}
 
+	{
+		const auto partial_pieces = qvariant_cast<QVariantMap>(settings.value("partial_pieces"));
+
+		for(auto partial_piece_itr = partial_pieces.cbegin(); partial_piece_itr != partial_pieces.cend(); ++partial_piece_itr) {
+			bool converted = false;
+			const auto piece_idx = partial_piece_itr.key().toInt(&converted);
+			const auto received_blocks = qvariant_cast<QBitArray>(partial_piece_itr.value());
+
+			if(!converted || !is_valid_piece_index(piece_idx) || bitfield_[piece_idx] || received_blocks.size() != piece_info(piece_idx).block_cnt) {
+				continue;
+			}
+
+			if(received_blocks.count(true) == received_blocks.size()) { // completed right before the shutdown. let the verification judge it
+				bitfield_[piece_idx] = true;
+				continue;
+			}
+
+			auto & piece = active_pieces_[piece_idx];
+			piece.received_blocks = received_blocks;
+			piece.received_block_cnt = static_cast<std::int32_t>(received_blocks.count(true));
+			piece.restored = true;
+		}
+	}
+
 	uled_byte_cnt_ = qvariant_cast<std::int64_t>(settings.value("uploaded_byte_count"));
 
 	if(uled_byte_cnt_) {
@@ -875,17 +1271,11 @@ QSet<std::int32_t> Peer_wire_client::generate_allowed_fast_set(const std::uint32
 
 void Peer_wire_client::clear_piece(const std::int32_t piece_idx) noexcept {
 	assert(is_valid_piece_index(piece_idx));
-	auto & [requested_blocks, received_blocks, piece_data, received_block_cnt] = pieces_[piece_idx];
 
-	piece_data.clear();
-	piece_data.squeeze();
-
-	requested_blocks.clear();
-	requested_blocks.squeeze();
-
-	received_blocks.clear();
-
-	received_block_cnt = 0;
+	if(const auto piece_itr = active_pieces_.find(piece_idx); piece_itr != active_pieces_.end()) {
+		Piece_buffer_pool::instance().release(std::move(piece_itr->data));
+		active_pieces_.erase(piece_itr);
+	}
 }
 
 void Peer_wire_client::on_have_message_received(Tcp_socket * const socket, const std::int32_t peer_have_piece_idx) noexcept {
@@ -899,15 +1289,84 @@ void Peer_wire_client::on_have_message_received(Tcp_socket * const socket, const
 	if(!socket->peer_bitfield[peer_have_piece_idx]) {
 		socket->peer_bitfield[peer_have_piece_idx] = true;
 		++peer_additive_bitfield_[peer_have_piece_idx];
+		on_peer_pieces_announced(socket, false);
 	} else {
 		qDebug() << "Peer sent duplicate 'have' msg";
 		// ? consider as error?
 	}
 }
 
-void Peer_wire_client::on_bitfield_received(Tcp_socket * const socket) noexcept {
+void Peer_wire_client::on_peer_pieces_announced(Tcp_socket * const announcer, const bool is_bitfield) noexcept {
+	assert(!announcer->peer_bitfield.isEmpty());
 
-	for(qsizetype piece_idx = 0; piece_idx < bitfield_.size(); ++piece_idx) {
+	if(!is_super_seeding()) {
+		return;
+	}
+
+	// a revealed piece that reached another peer can be traded from there on, so its receiver learns of the next one
+	for(auto * const socket : connection_manager_.established_sockets()) {
+
+		if(socket != announcer && socket->super_seeded && socket->super_seed_piece_idx >= 0 && announcer->peer_bitfield[socket->super_seed_piece_idx]) {
+			reveal_super_seed_piece(socket);
+		}
+	}
+
+	if(!announcer->super_seeded) {
+		return;
+	}
+
+	const auto revealed_piece_idx = announcer->super_seed_piece_idx;
+
+	if(revealed_piece_idx >= 0 && !announcer->peer_bitfield[revealed_piece_idx]) {
+		return;
+	}
+
+	// the peer had the piece before we revealed it, or nobody connected could get it from the peer anyway
+	const auto is_wasted_reveal = is_bitfield || revealed_piece_idx < 0 || std::ranges::none_of(connection_manager_.established_sockets(), [announcer, revealed_piece_idx](const Tcp_socket * const socket) {
+		return socket != announcer && (socket->peer_bitfield.isEmpty() || !socket->peer_bitfield[revealed_piece_idx]);
+	});
+
+	if(is_wasted_reveal) {
+		reveal_super_seed_piece(announcer);
+	}
+}
+
+void Peer_wire_client::reveal_super_seed_piece(Tcp_socket * const socket) noexcept {
+	assert(is_super_seeding());
+	assert(socket->super_seeded);
+
+	std::optional<std::int32_t> reveal_piece_idx;
+
+	// the rarest piece the peer lacks, ties go to the piece revealed to the fewest peers so far
+	auto piece_rank = [this](const std::int32_t piece_idx) {
+		return std::make_pair(peer_additive_bitfield_[piece_idx], super_seed_reveal_cnts_.value(piece_idx, 0));
+	};
+
+	for(std::int32_t piece_idx = 0; piece_idx < total_piece_cnt_; ++piece_idx) {
+
+		if(socket->super_seed_piece_idxes.contains(piece_idx) || (!socket->peer_bitfield.isEmpty() && socket->peer_bitfield[piece_idx])) {
+			continue;
+		}
+
+		if(!reveal_piece_idx || piece_rank(piece_idx) < piece_rank(*reveal_piece_idx)) {
+			reveal_piece_idx = piece_idx;
+		}
+	}
+
+	if(!reveal_piece_idx) {
+		socket->super_seed_piece_idx = -1;
+		return;
+	}
+
+	socket->super_seed_piece_idx = *reveal_piece_idx;
+	socket->super_seed_piece_idxes.insert(*reveal_piece_idx);
+	++super_seed_reveal_cnts_[*reveal_piece_idx];
+	socket->send_packet(craft_have_message(*reveal_piece_idx));
+}
+
+void Peer_wire_client::on_bitfield_received(Tcp_socket * const socket) noexcept {
+
+	for(qsizetype piece_idx = 0; piece_idx < bitfield_.size(); ++piece_idx) {
 
 		if(piece_idx >= total_piece_cnt_ && socket->peer_bitfield[piece_idx]) {
 			qDebug() << "Spare bit was set";
@@ -924,32 +1383,178 @@ void Peer_wire_client::on_bitfield_received(Tcp_socket * const socket) noexcept
 }
 
 void Peer_wire_client::on_piece_downloaded(Piece & dled_piece, const std::int32_t dled_piece_idx) noexcept {
+	assert(!pending_write_cnts_.contains(dled_piece_idx));
 
-	if(verify_piece_hash(dled_piece.data, dled_piece_idx) && write_to_disk(dled_piece.data, dled_piece_idx)) {
-		qDebug() << "piece successfully downloaded" << dled_piece_idx;
-
-		emit piece_verified(dled_piece_idx);
+	if(!dled_piece.restored) {
+		return verify_downloaded_piece(dled_piece, dled_piece_idx);
+	}
 
-		session_dled_byte_cnt_ += piece_size(dled_piece_idx);
-		tracker_->set_ratio(session_uled_byte_cnt_ ? static_cast<double>(session_dled_byte_cnt_) / static_cast<double>(session_uled_byte_cnt_) : 0);
+	// some blocks only exist on the disk (received before the restart or without a buffer)
+	Piece_buffer_pool::instance().release(std::move(dled_piece.data));
 
-		if(const auto remove_idx = target_piece_idxes_.indexOf(dled_piece_idx); remove_idx != -1) {
-			target_piece_idxes_.removeAt(remove_idx);
+	read_from_disk(dled_piece_idx, [this, dled_piece_idx](std::optional<QByteArray> piece) {
+		const auto piece_itr = active_pieces_.find(dled_piece_idx);
 
-			if(target_piece_idxes_.isEmpty() && remaining_byte_count()) {
-				fill_target_piece_indexes();
-			}
+		// cleared or completed by someone else while being read
+		if(piece_itr == active_pieces_.end() || bitfield_[dled_piece_idx] || piece_itr->received_block_cnt != piece_info(dled_piece_idx).block_cnt) {
+			return;
 		}
 
+		piece_itr->data = piece ? std::move(*piece) : QByteArray();
+		verify_downloaded_piece(*piece_itr, dled_piece_idx);
+	});
+}
+
+void Peer_wire_client::verify_downloaded_piece(Piece & dled_piece, const std::int32_t dled_piece_idx) noexcept {
+
+	// every block was written to its final offset before the piece counted as downloaded
+	if(verify_piece_hash(dled_piece.data, dled_piece_idx)) {
+		qDebug() << "piece successfully downloaded" << dled_piece_idx;
+		on_piece_completed(dled_piece_idx);
+		complete_duplicate_pieces(dled_piece_idx, dled_piece.data);
+
 		QTimer::singleShot(std::chrono::seconds(5), this, [this, dled_piece_idx] {
 			clear_piece(dled_piece_idx);
 		});
+	} else if(drop_corrupt_blocks(dled_piece_idx, dled_piece)) {
+		qDebug() << "downloaded piece hash verification failed, refetching its corrupt blocks";
 	} else {
 		qDebug() << "downloaded piece hash verification failed";
 		clear_piece(dled_piece_idx);
 	}
 }
 
+void Peer_wire_client::on_piece_completed(const std::int32_t completed_piece_idx) noexcept {
+	assert(!bitfield_[completed_piece_idx]);
+
+	std::ranges::for_each(file_spans(completed_piece_idx, 0, piece_size(completed_piece_idx)), [this](const File_span & span) {
+		file_handles_[span.file_handle_idx].second += span.byte_cnt;
+	});
+
+	emit piece_verified(completed_piece_idx);
+
+	session_dled_byte_cnt_ += piece_size(completed_piece_idx);
+	tracker_->set_ratio(session_uled_byte_cnt_ ? static_cast<double>(session_dled_byte_cnt_) / static_cast<double>(session_uled_byte_cnt_) : 0);
+
+	if(reserved_piece_idxes_.remove(completed_piece_idx)) { // completed without a buffer (web seed, duplicate file)
+		Piece_buffer_pool::instance().cancel_reservation(piece_size(completed_piece_idx));
+	}
+
+	if(const auto remove_idx = target_piece_idxes_.indexOf(completed_piece_idx); remove_idx != -1) {
+		target_piece_idxes_.removeAt(remove_idx);
+
+		if(target_piece_idxes_.isEmpty() && remaining_byte_count()) {
+			fill_target_piece_indexes();
+		}
+	}
+}
+
+void Peer_wire_client::assign_web_seed_pieces() noexcept {
+
+	if(web_seeds_.isEmpty() || connection_manager_.is_paused() || !remaining_byte_count()) {
+		return;
+	}
+
+	// pieces the peers have not started on
+	auto is_assignable = [this](const std::int32_t piece_idx) {
+		const auto piece_itr = active_pieces_.constFind(piece_idx);
+		return !bitfield_[piece_idx] && !target_piece_idxes_.contains(piece_idx) && !web_seed_piece_idxes_.contains(piece_idx) &&
+		       (piece_itr == active_pieces_.cend() || !piece_itr->received_block_cnt);
+	};
+
+	std::int32_t piece_idx = 0;
+
+	for(auto * const web_seed : std::as_const(web_seeds_)) {
+
+		if(!web_seed->is_idle()) {
+			continue;
+		}
+
+		// the peers go for the rarest pieces, the mirrors take contiguous runs from the front so that each run is a few range requests
+		while(piece_idx < total_piece_cnt_ && !is_assignable(piece_idx)) {
+			++piece_idx;
+		}
+
+		if(piece_idx == total_piece_cnt_) {
+			return;
+		}
+
+		const auto first_piece_idx = piece_idx;
+		std::int64_t run_byte_cnt = 0;
+
+		do {
+			run_byte_cnt += piece_size(piece_idx);
+			web_seed_piece_idxes_.insert(piece_idx++);
+		} while(piece_idx < total_piece_cnt_ && run_byte_cnt + piece_size(piece_idx) <= max_web_seed_run_byte_cnt && is_assignable(piece_idx));
+
+		// the run is contiguous in the torrent, so it maps onto one byte range of each file it touches
+		const auto spans = file_spans(first_piece_idx, 0, run_byte_cnt);
+		assert(!spans.isEmpty());
+
+		QList<Web_seed::File_range> file_ranges(spans.size());
+
+		std::ranges::transform(spans, file_ranges.begin(), [](const File_span & span) {
+			return Web_seed::File_range{span.file_handle_idx, span.file_offset, span.byte_cnt};
+		});
+
+		web_seed->fetch(first_piece_idx, piece_idx - first_piece_idx, std::move(file_ranges));
+	}
+}
+
+void Peer_wire_client::on_web_seed_pieces_received(Web_seed * const web_seed, const std::int32_t first_piece_idx, const std::int32_t piece_cnt, const QByteArray & pieces) noexcept {
+	assert(is_valid_piece_index(first_piece_idx) && is_valid_piece_index(first_piece_idx + piece_cnt - 1));
+	bool has_corrupt_piece = false;
+	qsizetype piece_offset = 0;
+
+	for(auto piece_idx = first_piece_idx; piece_idx < first_piece_idx + piece_cnt; piece_offset += piece_size(piece_idx++)) {
+		web_seed_piece_idxes_.remove(piece_idx);
+
+		if(bitfield_[piece_idx]) {
+			continue;
+		}
+
+		assert(piece_offset + piece_size(piece_idx) <= pieces.size());
+		const auto piece = pieces.sliced(piece_offset, piece_size(piece_idx));
+
+		if(!verify_piece_hash(piece, piece_idx)) {
+			qDebug() << "web seed piece hash verification failed" << web_seed->url() << piece_idx;
+			has_corrupt_piece = true;
+			continue;
+		}
+
+		write_to_disk(piece, piece_idx, 0, [this, piece_idx, piece](const bool is_written) {
+			if(!is_written) {
+				qDebug() << "could not write web seed piece to the disk" << piece_idx;
+				return;
+			}
+
+			// the peers may have completed it while it was being written
+			if(bitfield_[piece_idx]) {
+				return;
+			}
+
+			qDebug() << "piece downloaded from web seed" << piece_idx;
+			clear_piece(piece_idx);
+			on_piece_completed(piece_idx);
+			complete_duplicate_pieces(piece_idx, piece);
+		});
+	}
+
+	if(has_corrupt_piece) {
+		web_seed->on_pieces_rejected();
+		on_web_seed_failed(web_seed);
+	}
+}
+
+void Peer_wire_client::on_web_seed_failed(Web_seed * const web_seed) noexcept {
+
+	if(web_seed->has_failed()) {
+		qDebug() << "web seed dropped" << web_seed->url();
+		web_seeds_.removeOne(web_seed);
+		web_seed->deleteLater();
+	}
+}
+
 void Peer_wire_client::on_block_received(Tcp_socket * const socket, const QByteArray & reply) noexcept {
 
 	const auto received_piece_idx = [&reply] {
@@ -989,11 +1594,20 @@ void Peer_wire_client::on_block_received(Tcp_socket * const socket, const QByteA
 
 	socket->add_downloaded_bytes(received_block.size());
 
-	assert(received_piece_idx < pieces_.size());
-	auto & [requested_blocks, received_blocks, piece_data, received_block_cnt] = pieces_[received_piece_idx];
+	if(bitfield_[received_piece_idx]) {
+		qDebug() << "already have the piece" << received_piece_idx;
+		return;
+	}
+
+	auto & [requested_blocks, received_blocks, piece_data, received_block_cnt, restored] = active_pieces_[received_piece_idx];
+
+	if(piece_data.isEmpty() && !restored) {
 
-	if(piece_data.isEmpty()) {
-		piece_data.resize(static_cast<qsizetype>(piece_size));
+		if(auto piece_buffer = Piece_buffer_pool::instance().acquire(piece_size, reserved_piece_idxes_.remove(received_piece_idx))) {
+			piece_data = std::move(*piece_buffer);
+		} else { // over the memory budget. the blocks still go to the disk and the piece is verified from there
+			restored = true;
+		}
 	}
 
 	if(received_blocks.isEmpty()) {
@@ -1007,21 +1621,71 @@ void Peer_wire_client::on_block_received(Tcp_socket * const socket, const QByteA
 
 	assert(received_block_idx >= 0 && received_block_idx < total_block_cnt);
 
-	received_blocks[received_block_idx] = true;
+	// with the leaves of the piece at hand a bad block is refetched on its own instead of failing the whole piece later
+	if(const auto is_valid_block = merkle_hashes_.verify_block(received_piece_idx, received_block_idx, received_block); is_valid_block && !*is_valid_block) {
+		qDebug() << "block failed merkle verification" << received_piece_idx << received_piece_offset;
+		socket->remove_request(received_packet_metadata);
 
-	assert(received_piece_offset + received_block.size() <= piece_data.size());
-	std::ranges::move(received_block, piece_data.begin() + received_piece_offset);
+		if(!requested_blocks.empty()) {
+			requested_blocks[received_block_idx] = static_cast<std::int8_t>(std::max(0, requested_blocks[received_block_idx] - 1));
+		}
 
-	if(++received_block_cnt == total_block_cnt) {
-		QTimer::singleShot(0, this, [this, received_piece_idx] {
-			on_piece_downloaded(pieces_[received_piece_idx], received_piece_idx);
-		});
+		return socket->on_peer_fault();
 	}
 
+	received_blocks[received_block_idx] = true;
+	++received_block_cnt;
 	assert(received_block_cnt <= total_block_cnt);
+
+	if(!piece_data.isEmpty()) {
+		assert(received_piece_offset + received_block.size() <= piece_data.size());
+		std::ranges::copy(received_block, piece_data.begin() + received_piece_offset);
+	}
+
+	// the piece counts as downloaded once the last of its block writes lands
+	++pending_write_cnts_[received_piece_idx];
+
+	write_to_disk(received_block, received_piece_idx, received_piece_offset, [this, received_piece_idx, received_block_idx](const bool is_written) {
+		on_block_written(received_piece_idx, received_block_idx, is_written);
+	});
+
 	emit valid_block_received(received_packet_metadata);
 }
 
+void Peer_wire_client::on_block_written(const std::int32_t piece_idx, const std::int32_t block_idx, const bool is_written) noexcept {
+	assert(pending_write_cnts_.value(piece_idx) > 0);
+
+	if(--pending_write_cnts_[piece_idx] == 0) {
+		pending_write_cnts_.remove(piece_idx);
+	}
+
+	const auto piece_itr = active_pieces_.find(piece_idx);
+
+	// cleared or completed while the block was being written
+	if(piece_itr == active_pieces_.end() || bitfield_[piece_idx]) {
+		return;
+	}
+
+	if(!is_written) {
+		qDebug() << "could not write block to the disk" << piece_idx << block_idx;
+
+		if(!piece_itr->received_blocks.isEmpty() && piece_itr->received_blocks[block_idx]) {
+			piece_itr->received_blocks[block_idx] = false;
+			--piece_itr->received_block_cnt;
+
+			if(!piece_itr->requested_blocks.empty()) {
+				piece_itr->requested_blocks[block_idx] = 0;
+			}
+		}
+
+		return;
+	}
+
+	if(!pending_write_cnts_.contains(piece_idx) && piece_itr->received_block_cnt == piece_info(piece_idx).block_cnt) {
+		on_piece_downloaded(*piece_itr, piece_idx);
+	}
+}
+
 void Peer_wire_client::on_allowed_fast_received(Tcp_socket * const socket, const std::int32_t allowed_piece_idx) noexcept {
 	assert(socket->fast_extension_enabled);
 	assert(!socket->peer_bitfield.isEmpty());
@@ -1056,6 +1720,140 @@ void Peer_wire_client::on_suggest_piece_received(Tcp_socket * const socket, cons
 	}
 }
 
+void Peer_wire_client::send_block_hash_request(Tcp_socket * const socket, const std::int32_t piece_idx) noexcept {
+
+	if(!socket->v2_enabled) {
+		return;
+	}
+
+	if(const auto request_itr = block_hash_requests_.constFind(piece_idx); request_itr != block_hash_requests_.cend()) {
+
+		if(!request_itr->hasExpired(std::chrono::milliseconds(block_hash_request_timeout).count())) {
+			return;
+		}
+	}
+
+	if(const auto hash_request = merkle_hashes_.block_hash_request(piece_idx)) {
+		block_hash_requests_[piece_idx].start();
+		socket->send_packet(craft_hash_message(Message_Id::Hash_Request, *hash_request));
+	}
+}
+
+void Peer_wire_client::on_hash_request_received(Tcp_socket * const socket, const QByteArray & reply) noexcept {
+	const auto hash_request = extract_hash_request(reply);
+
+	// leaves are hashed from the piece on the disk
+	if(const auto piece_idx = merkle_hashes_.leaf_piece_index(hash_request); piece_idx && state_ != State::Verification && bitfield_[*piece_idx]) {
+		return read_from_disk(*piece_idx, [this, socket = QPointer(socket), hash_request](const std::optional<QByteArray> & piece) {
+			if(socket && socket->state() == Tcp_socket::SocketState::ConnectedState) {
+				send_requested_hashes(socket, hash_request, piece.value_or(QByteArray()));
+			}
+		});
+	}
+
+	send_requested_hashes(socket, hash_request, {});
+}
+
+void Peer_wire_client::send_requested_hashes(Tcp_socket * const socket, const Merkle_hashes::Hash_request & hash_request, const QByteArray & piece) noexcept {
+
+	if(const auto hashes = merkle_hashes_.requested_hashes(hash_request, piece)) {
+		socket->send_packet(craft_hash_message(Message_Id::Hashes, hash_request, *hashes));
+	} else {
+		socket->send_packet(craft_hash_message(Message_Id::Hash_Reject, hash_request));
+	}
+}
+
+void Peer_wire_client::on_hashes_received(Tcp_socket * const socket, const QByteArray & reply) noexcept {
+	const auto hash_request = extract_hash_request(reply);
+	const auto piece_idx = merkle_hashes_.leaf_piece_index(hash_request);
+
+	if(!piece_idx || !block_hash_requests_.remove(*piece_idx)) {
+		qDebug() << "peer sent hashes that were not requested";
+		return socket->on_peer_fault();
+	}
+
+	QList<QByteArray> hashes;
+	hashes.reserve((reply.size() - hash_msg_header_size) / Merkle_hashes::hash_byte_cnt);
+
+	for(qsizetype hash_offset = hash_msg_header_size; hash_offset < reply.size(); hash_offset += Merkle_hashes::hash_byte_cnt) {
+		hashes.push_back(reply.sliced(hash_offset, Merkle_hashes::hash_byte_cnt));
+	}
+
+	if(!merkle_hashes_.on_hashes_received(hash_request, hashes)) {
+		qDebug() << "peer sent hashes that do not lead to the pieces root";
+		return socket->on_peer_fault();
+	}
+
+	// blocks that arrived before their leaves are judged now
+	if(const auto piece_itr = active_pieces_.find(*piece_idx); piece_itr != active_pieces_.end() && !piece_itr->data.isEmpty()) {
+		drop_corrupt_blocks(*piece_idx, *piece_itr);
+	}
+}
+
+bool Peer_wire_client::drop_corrupt_blocks(const std::int32_t piece_idx, Piece & piece) noexcept {
+
+	if(piece.data.isEmpty() || !merkle_hashes_.has_block_hashes(piece_idx)) {
+		return false;
+	}
+
+	bool dropped_block = false;
+
+	for(qsizetype block_idx = 0; block_idx < piece.received_blocks.size(); ++block_idx) {
+
+		if(!piece.received_blocks[block_idx]) {
+			continue;
+		}
+
+		const auto block_offset = static_cast<std::int32_t>(block_idx) * max_block_size;
+		const auto block = piece.data.sliced(block_offset, piece_info(piece_idx, block_offset).block_size);
+
+		if(const auto is_valid_block = merkle_hashes_.verify_block(piece_idx, static_cast<std::int32_t>(block_idx), block); !is_valid_block || *is_valid_block) {
+			continue;
+		}
+
+		piece.received_blocks[block_idx] = false;
+		--piece.received_block_cnt;
+
+		if(!piece.requested_blocks.empty()) {
+			piece.requested_blocks[block_idx] = 0;
+		}
+
+		dropped_block = true;
+	}
+
+	assert(piece.received_block_cnt >= 0);
+	return dropped_block;
+}
+
+void Peer_wire_client::complete_duplicate_pieces(const std::int32_t piece_idx, const QByteArray piece) noexcept {
+
+	// files with the same pieces root hold the same bytes, a piece of one of them completes the matching piece of the others
+	for(const auto duplicate_piece_idx : merkle_hashes_.duplicate_pieces(piece_idx)) {
+
+		if(!is_valid_piece_index(duplicate_piece_idx) || bitfield_[duplicate_piece_idx]) {
+			continue;
+		}
+
+		// only the last piece of the torrent lacks the padding after its file
+		auto duplicate_piece = piece.first(std::min<qsizetype>(piece.size(), piece_size(duplicate_piece_idx)));
+		duplicate_piece += QByteArray(piece_size(duplicate_piece_idx) - duplicate_piece.size(), '\0');
+
+		if(!verify_piece_hash(duplicate_piece, duplicate_piece_idx)) {
+			continue;
+		}
+
+		write_to_disk(duplicate_piece, duplicate_piece_idx, 0, [this, duplicate_piece_idx](const bool is_written) {
+			if(!is_written || bitfield_[duplicate_piece_idx]) {
+				return;
+			}
+
+			qDebug() << "piece completed from a duplicate file" << duplicate_piece_idx;
+			clear_piece(duplicate_piece_idx);
+			on_piece_completed(duplicate_piece_idx);
+		});
+	}
+}
+
 util::Packet_metadata Peer_wire_client::extract_packet_metadata(const QByteArray & reply) {
 	assert(reply.size() > 12);
 
@@ -1070,6 +1868,24 @@ util::Packet_metadata Peer_wire_client::extract_packet_metadata(const QByteArray
 	return {piece_idx, piece_offset, byte_cnt};
 }
 
+Merkle_hashes::Hash_request Peer_wire_client::extract_hash_request(const QByteArray & reply) noexcept {
+	assert(reply.size() >= hash_msg_header_size);
+
+	constexpr auto pieces_root_offset = 1;
+	constexpr auto base_layer_offset = pieces_root_offset + Merkle_hashes::hash_byte_cnt;
+	constexpr auto index_offset = base_layer_offset + 4;
+	constexpr auto length_offset = index_offset + 4;
+	constexpr auto proof_layer_cnt_offset = length_offset + 4;
+
+	return {
+	    reply.sliced(pieces_root_offset, Merkle_hashes::hash_byte_cnt),
+	    util::extract_integer<std::int32_t>(reply, base_layer_offset),
+	    util::extract_integer<std::int32_t>(reply, index_offset),
+	    util::extract_integer<std::int32_t>(reply, length_offset),
+	    util::extract_integer<std::int32_t>(reply, proof_layer_cnt_offset),
+	};
+}
+
 void Peer_wire_client::on_handshake_reply_received(Tcp_socket * const socket, const QByteArray & reply) {
 	assert(socket->state() == Tcp_socket::ConnectedState);
 	auto peer_info = verify_handshake_reply(socket, reply);
@@ -1081,33 +1897,39 @@ void Peer_wire_client::on_handshake_reply_received(Tcp_socket * const socket, co
 
 	auto & [peer_info_hash, peer_id] = *peer_info;
 
-	if(info_sha1_hash_ != peer_info_hash) {
+	if(info_sha1_hash_ != peer_info_hash && (info_v2_hash_.isEmpty() || info_v2_hash_ != peer_info_hash)) {
 		qDebug() << "peer info hash doesn't match" << info_sha1_hash_ << peer_info_hash;
 		return socket->abort();
 	}
 
 	socket->peer_id = std::move(peer_id);
 	socket->handshake_done = true;
+	on_peer_established(socket);
+}
 
-	active_peers_.emplace_back(socket->peer_url());
-	properties_displayer_.add_peer(socket);
-
-	if(!has_metadata_) {
+void Peer_wire_client::on_peer_established(Tcp_socket * const socket, const bool is_taken_over) noexcept {
+	assert(socket->handshake_done);
 
-		if(socket->extension_protocol_enabled) {
-			using util::conversion::convert_to_hex;
+	connection_manager_.on_peer_established(socket);
+	properties_displayer_.add_peer(socket);
 
-			const static auto extended_handshake = [] {
-				constexpr std::int32_t handshake_size = extended_handshake_dict.size() + 2;
-				constexpr std::int8_t ext_msg_id = 20;
-				constexpr std::int8_t handshake_msg_id = 0;
+	// bitfield and have all/none come before the extension handshake and port messages (BEP 3, BEP 6)
+	if(has_metadata_) {
+		send_piece_availability(socket, is_taken_over);
+	} else if(socket->fast_extension_enabled && !is_taken_over) {
+		// no pieces yet, the download taking the socket over follows up with haves
+		socket->send_packet(have_none_msg.data());
+	}
 
-				return convert_to_hex(handshake_size) + convert_to_hex(ext_msg_id) + convert_to_hex(handshake_msg_id) + QByteArray(extended_handshake_dict.data()).toHex();
-			}();
+	if(socket->extension_protocol_enabled) {
+		socket->send_packet(craft_extended_handshake());
+	}
 
-			socket->send_packet(extended_handshake);
-		}
+	if(socket->dht_enabled && Dht_node::instance()) {
+		socket->send_packet(port_msg_prefix.data() + util::conversion::convert_to_hex(Dht_node::dht_port()));
+	}
 
+	if(!has_metadata_) {
 		return;
 	}
 
@@ -1149,6 +1971,11 @@ void Peer_wire_client::on_handshake_reply_received(Tcp_socket * const socket, co
 		}
 	});
 
+	// no allowed fast set, it would tell the peer about pieces the others do not have yet
+	if(socket->super_seeded) {
+		return reveal_super_seed_piece(socket);
+	}
+
 	if(socket->fast_extension_enabled) {
 
 		QTimer::singleShot(0, this, [socket = QPointer(socket), total_piece_cnt_ = total_piece_cnt_] {
@@ -1156,15 +1983,28 @@ void Peer_wire_client::on_handshake_reply_received(Tcp_socket * const socket, co
 				return;
 			}
 
-			socket->allowed_fast_set = generate_allowed_fast_set(socket->peerAddress().toIPv4Address(), total_piece_cnt_);
+			bool is_ipv4_peer = false;
+			const auto peer_ipv4_address = QHostAddress(socket->peer_url().host()).toIPv4Address(&is_ipv4_peer);
+
+			if(!is_ipv4_peer) { // BEP 6 only defines the allowed fast set for IPv4 peers
+				return;
+			}
+
+			socket->allowed_fast_set = generate_allowed_fast_set(peer_ipv4_address, total_piece_cnt_);
 
 			std::ranges::for_each(std::as_const(socket->allowed_fast_set), [socket](const auto fast_piece_idx) {
 				socket->send_packet(craft_allowed_fast_message(fast_piece_idx));
 			});
 		});
 	}
+}
 
-	if(!dled_piece_cnt_) {
+void Peer_wire_client::send_piece_availability(Tcp_socket * const socket, const bool is_taken_over) noexcept {
+	assert(has_metadata_);
+
+	// no bitfield, it would tell the peer about pieces the others do not have yet
+	if(is_super_seeding() && !is_taken_over) {
+		socket->super_seeded = true;
 
 		if(socket->fast_extension_enabled) {
 			socket->send_packet(have_none_msg.data());
@@ -1173,12 +2013,27 @@ void Peer_wire_client::on_handshake_reply_received(Tcp_socket * const socket, co
 		return;
 	}
 
-	if(dled_piece_cnt_ == total_piece_cnt_ && socket->fast_extension_enabled) {
+	if(!dled_piece_cnt_) {
+
+		if(socket->fast_extension_enabled && !is_taken_over) {
+			socket->send_packet(have_none_msg.data());
+		}
+
+		return;
+	}
+
+	if(dled_piece_cnt_ == total_piece_cnt_ && socket->fast_extension_enabled && !is_taken_over) {
 		assert(!remaining_byte_count());
 		return socket->send_packet(have_all_msg.data());
 	}
 
-	if(constexpr auto max_have_msgs = 10; dled_piece_cnt_ <= max_have_msgs) {
+	// bitfield and have all/none may only follow the handshake directly, a peer taken over from the magnet download gets haves
+	if(constexpr auto max_have_msgs = 10; dled_piece_cnt_ <= max_have_msgs || is_taken_over) {
+
+		// a fast extension peer expects one of them before any have
+		if(socket->fast_extension_enabled && !is_taken_over) {
+			socket->send_packet(have_none_msg.data());
+		}
 
 		for(std::int32_t piece_idx = 0; piece_idx < total_piece_cnt_; ++piece_idx) {
 
@@ -1205,6 +2060,111 @@ QByteArray Peer_wire_client::craft_generic_message(const util::Packet_metadata p
 	return msg + convert_to_hex(packet_metadata.piece_idx) + convert_to_hex(packet_metadata.piece_offset) + convert_to_hex(packet_metadata.byte_cnt);
 }
 
+qsizetype Peer_wire_client::unchoked_peer_count() const noexcept {
+	return std::ranges::count_if(connection_manager_.established_sockets(), [](const Tcp_socket * const socket) {
+		return !socket->am_choking;
+	});
+}
+
+void Peer_wire_client::run_choker() noexcept {
+	assert(state_ != State::Verification);
+
+	// bytes each peer gave us (leeching) or took from us (seeding) since the last round
+	QHash<const Tcp_socket *, std::int64_t> round_byte_cnts;
+	QHash<const Tcp_socket *, std::int64_t> choke_byte_cnts; // replaces last_choke_byte_cnts_ so that gone sockets are dropped
+	QList<Tcp_socket *> interested_peers;
+
+	for(auto * const socket : connection_manager_.established_sockets()) {
+		const auto byte_cnt = state_ == State::Seed ? socket->uploaded_byte_count() : socket->downloaded_byte_count();
+		round_byte_cnts[socket] = byte_cnt - last_choke_byte_cnts_.value(socket, 0);
+		choke_byte_cnts[socket] = byte_cnt;
+
+		if(socket->peer_interested) {
+			interested_peers.push_back(socket);
+		}
+	}
+
+	last_choke_byte_cnts_ = std::move(choke_byte_cnts);
+
+	std::ranges::stable_sort(interested_peers, [&round_byte_cnts](const Tcp_socket * const lhs, const Tcp_socket * const rhs) {
+		return round_byte_cnts[lhs] > round_byte_cnts[rhs];
+	});
+
+	QSet<const Tcp_socket *> unchoked_peers;
+
+	for(qsizetype peer_idx = 0; peer_idx < std::min<qsizetype>(upload_slot_cnt_, interested_peers.size()); ++peer_idx) {
+		unchoked_peers.insert(interested_peers[peer_idx]);
+	}
+
+	{
+		constexpr auto optimistic_rotation_round_cnt = 3; // every 30 seconds
+		const auto rotate_optimistic_peer = choke_round_cnt_++ % optimistic_rotation_round_cnt == 0;
+
+		if(rotate_optimistic_peer || !optimistic_peer_ || !optimistic_peer_->peer_interested || unchoked_peers.contains(optimistic_peer_)) {
+			QList<Tcp_socket *> optimistic_candidates;
+
+			std::ranges::copy_if(std::as_const(interested_peers), std::back_inserter(optimistic_candidates), [&unchoked_peers](const Tcp_socket * const socket) {
+				return !unchoked_peers.contains(socket);
+			});
+
+			if(optimistic_candidates.isEmpty()) {
+				optimistic_peer_.clear();
+			} else {
+				static std::mt19937 random_generator(std::random_device{}());
+				std::uniform_int_distribution<qsizetype> idx_range(0, optimistic_candidates.size() - 1);
+				optimistic_peer_ = optimistic_candidates[idx_range(random_generator)];
+			}
+		}
+	}
+
+	if(optimistic_peer_) {
+		unchoked_peers.insert(optimistic_peer_);
+	}
+
+	for(auto * const socket : connection_manager_.established_sockets()) {
+
+		if(const auto should_unchoke = unchoked_peers.contains(socket); should_unchoke && socket->am_choking) {
+			socket->am_choking = false;
+			socket->send_packet(unchoke_msg.data());
+		} else if(!should_unchoke && !socket->am_choking) {
+			socket->am_choking = true;
+			socket->send_packet(choke_msg.data());
+			revoke_queued_pieces(socket);
+		}
+	}
+}
+
+// pieces still waiting for upload tokens are not sent after a choke, unless they are allowed fast (BEP 6)
+void Peer_wire_client::revoke_queued_pieces(Tcp_socket * const socket) noexcept {
+	using util::conversion::convert_to_hex;
+
+	// hex encoded: length prefix, message id, piece index, offset, block
+	constexpr auto msg_id_offset = 8;
+	constexpr auto piece_idx_offset = 10;
+	constexpr auto piece_offset_offset = 18;
+	constexpr auto block_offset = 26;
+
+	const auto revoked_pieces = socket->take_throttled_packets([socket](const QByteArray & packet) {
+		if(packet.size() < block_offset || packet.sliced(msg_id_offset, 2) != convert_to_hex(static_cast<std::int8_t>(Message_Id::Piece))) {
+			return false;
+		}
+
+		return !socket->allowed_fast_set.contains(util::extract_integer<std::int32_t>(QByteArray::fromHex(packet.sliced(piece_idx_offset, 8))));
+	});
+
+	if(!socket->fast_extension_enabled) {
+		return;
+	}
+
+	// the requests go unanswered otherwise
+	for(const auto & revoked_piece : revoked_pieces) {
+		const auto piece_idx = util::extract_integer<std::int32_t>(QByteArray::fromHex(revoked_piece.sliced(piece_idx_offset, 8)));
+		const auto piece_offset = util::extract_integer<std::int32_t>(QByteArray::fromHex(revoked_piece.sliced(piece_offset_offset, 8)));
+		const auto byte_cnt = static_cast<std::int32_t>((revoked_piece.size() - block_offset) / 2);
+		socket->send_packet(craft_generic_message<Message_Id::Reject_Request>({piece_idx, piece_offset, byte_cnt}));
+	}
+}
+
 void Peer_wire_client::communicate_with_peer(Tcp_socket * const socket) {
 	assert(socket);
 	assert(socket->bytesAvailable());
@@ -1219,27 +2179,39 @@ void Peer_wire_client::communicate_with_peer(Tcp_socket * const socket) {
 		return on_handshake_reply_received(socket, *reply);
 	}
 
-	const auto received_msg_id = [&reply = reply] {
+	on_peer_message_received(socket, *reply);
+}
+
+void Peer_wire_client::on_peer_message_received(Tcp_socket * const socket, const QByteArray & reply) {
+	assert(socket->handshake_done);
+
+	const auto received_msg_id = [&reply] {
 		constexpr auto msg_id_offset = 0;
-		return static_cast<Message_Id>(util::extract_integer<std::int8_t>(*reply, msg_id_offset));
+		return static_cast<Message_Id>(util::extract_integer<std::int8_t>(reply, msg_id_offset));
 	}();
 
-	if(!is_valid_reply(socket, *reply, received_msg_id)) {
-		qDebug() << "Invalid peer reply" << received_msg_id << *reply << reply->size();
+	if(!is_valid_reply(socket, reply, received_msg_id)) {
+		qDebug() << "Invalid peer reply" << received_msg_id << reply << reply.size();
 		return socket->abort();
 	}
 
-	qDebug() << received_msg_id << "[ Active peers:" << active_peers_.size() << ']';
+	qDebug() << received_msg_id << "[ Active peers:" << connection_manager_.connection_count() << ']';
 
 	constexpr auto msg_begin_offset = 1;
 
 	{
 		if(socket->extension_protocol_enabled && received_msg_id == Message_Id::Extended_Protocol) {
-			on_extension_message_received(socket, reply->sliced(msg_begin_offset) /* skip standard bit. '20' for extension protocol */);
+			on_extension_message_received(socket, reply.sliced(msg_begin_offset) /* skip standard bit. '20' for extension protocol */);
 		}
 	}
 
 	if(!has_metadata_) {
+
+		// availability and choke state are replayed by the download that takes the peer over
+		if(is_deferrable_message(received_msg_id) && socket->deferred_messages.size() < max_deferred_msg_cnt) {
+			socket->deferred_messages.push_back(reply);
+		}
+
 		return;
 	}
 
@@ -1277,7 +2249,8 @@ void Peer_wire_client::communicate_with_peer(Tcp_socket * const socket) {
 
 			socket->peer_interested = true;
 
-			if(socket->am_choking && socket->is_good_ratio()) {
+			// fill a free upload slot right away instead of waiting for the next choke round
+			if(socket->am_choking && unchoked_peer_count() < upload_slot_cnt_) {
 				socket->am_choking = false;
 				socket->send_packet(unchoke_msg.data());
 			}
@@ -1298,7 +2271,7 @@ void Peer_wire_client::communicate_with_peer(Tcp_socket * const socket) {
 
 		case Message_Id::Have: {
 			constexpr auto msg_offset = 1;
-			on_have_message_received(socket, util::extract_integer<std::int32_t>(*reply, msg_offset));
+			on_have_message_received(socket, util::extract_integer<std::int32_t>(reply, msg_offset));
 			break;
 		}
 
@@ -1309,19 +2282,20 @@ void Peer_wire_client::communicate_with_peer(Tcp_socket * const socket) {
 				break;
 			}
 
-			socket->peer_bitfield = util::conversion::convert_to_bits(reply->sliced(msg_begin_offset, reply->size() - 1));
+			socket->peer_bitfield = util::conversion::convert_to_bits(reply.sliced(msg_begin_offset, reply.size() - 1));
 			assert(socket->peer_bitfield.size() == bitfield_.size());
 			on_bitfield_received(socket);
+			on_peer_pieces_announced(socket, true);
 			break;
 		}
 
 		case Message_Id::Request: {
-			on_block_request_received(socket, *reply);
+			on_block_request_received(socket, reply);
 			break;
 		}
 
 		case Message_Id::Piece: {
-			on_block_received(socket, *reply);
+			on_block_received(socket, reply);
 			break;
 		}
 
@@ -1348,6 +2322,7 @@ void Peer_wire_client::communicate_with_peer(Tcp_socket * const socket) {
 
 			on_bitfield_received(socket);
 			on_bitfield_received(socket);
+			on_peer_pieces_announced(socket, true);
 			break;
 		}
 
@@ -1363,7 +2338,7 @@ void Peer_wire_client::communicate_with_peer(Tcp_socket * const socket) {
 		}
 
 		case Message_Id::Reject_Request: {
-			const auto rejected_request_metadata = extract_packet_metadata(*reply);
+			const auto rejected_request_metadata = extract_packet_metadata(reply);
 
 			if(socket->request_sent(rejected_request_metadata)) {
 				socket->rejected_requests.insert(rejected_request_metadata);
@@ -1376,12 +2351,21 @@ void Peer_wire_client::communicate_with_peer(Tcp_socket * const socket) {
 		}
 
 		case Message_Id::Allowed_Fast: {
-			on_allowed_fast_received(socket, util::extract_integer<std::int32_t>(*reply, msg_begin_offset));
+			on_allowed_fast_received(socket, util::extract_integer<std::int32_t>(reply, msg_begin_offset));
+			break;
+		}
+
+		case Message_Id::Port: {
+
+			if(auto * const dht_node = Dht_node::instance()) {
+				dht_node->add_node(QHostAddress(socket->peer_url().host()), util::extract_integer<std::uint16_t>(reply, msg_begin_offset));
+			}
+
 			break;
 		}
 
 		case Message_Id::Suggest_Piece: {
-			on_suggest_piece_received(socket, util::extract_integer<std::int32_t>(*reply, msg_begin_offset));
+			on_suggest_piece_received(socket, util::extract_integer<std::int32_t>(reply, msg_begin_offset));
 			break;
 		}
 
@@ -1389,6 +2373,25 @@ void Peer_wire_client::communicate_with_peer(Tcp_socket * const socket) {
 			// handled above - here for 'Wswitch'
 			break;
 		}
+
+		case Message_Id::Hash_Request: {
+			on_hash_request_received(socket, reply);
+			break;
+		}
+
+		case Message_Id::Hashes: {
+			on_hashes_received(socket, reply);
+			break;
+		}
+
+		case Message_Id::Hash_Reject: { // another peer is asked once the request times out
+
+			if(const auto piece_idx = merkle_hashes_.leaf_piece_index(extract_hash_request(reply))) {
+				block_hash_requests_.remove(*piece_idx);
+			}
+
+			break;
+		}
 	}
 }
 
@@ -1399,14 +2402,24 @@ void Peer_wire_client::on_extension_message_received(Tcp_socket * const socket,
 
 	switch(const auto msg_type = util::extract_integer<std::int8_t>(message); msg_type) {
 
-		case 0: {
+		case Extension_Id::Handshake: {
 			return on_extension_handshake_received(socket, message.sliced(1));
 		}
 
-		case 1: {
+		case Extension_Id::Ut_Metadata: {
 			return on_extension_metadata_message_received(socket, message.sliced(1));
 		}
 
+		case Extension_Id::Ut_Pex: {
+
+			if(is_private_) {
+				qDebug() << "dropping pex message of a private torrent";
+				return;
+			}
+
+			return on_extension_pex_message_received(socket, message.sliced(1));
+		}
+
 		default: {
 			qDebug() << "peer sent invalid extension msg type ids" << msg_type;
 			return socket->on_peer_fault();
@@ -1419,12 +2432,6 @@ void Peer_wire_client::on_extension_handshake_received(Tcp_socket * const socket
 	assert(!message.isEmpty());
 
 	const auto received_dict = bencode::parse_content(message);
-	const auto metadata_size_itr = received_dict.find("metadata_size");
-
-	if(metadata_size_itr == received_dict.end()) {
-		return socket->on_peer_fault();
-	}
-
 	const auto m_heading_itr = received_dict.find("m");
 
 	if(m_heading_itr == received_dict.end()) {
@@ -1433,15 +2440,40 @@ void Peer_wire_client::on_extension_handshake_received(Tcp_socket * const socket
 
 	const auto m_dict = std::any_cast<bencode::dictionary>(m_heading_itr->second);
 
-	if(const auto m_key_itr = m_dict.find("ut_metadata"); m_key_itr != m_dict.end()) {
-		socket->peer_ut_metadata_id = std::any_cast<std::int64_t>(m_key_itr->second);
+	auto extract_extension_id = [&m_dict](const std::string & extension_name) -> std::optional<std::int64_t> {
+		if(const auto m_key_itr = m_dict.find(extension_name); m_key_itr != m_dict.end()) {
+			// 0 means the peer disabled the extension
+			if(const auto extension_id = std::any_cast<std::int64_t>(m_key_itr->second); extension_id > 0 && extension_id <= std::numeric_limits<std::int8_t>::max()) {
+				return extension_id;
+			}
+		}
+
+		return {};
+	};
+
+	socket->peer_ut_metadata_id = extract_extension_id("ut_metadata").value_or(-1);
+	socket->peer_ut_pex_id = extract_extension_id("ut_pex").value_or(-1);
+
+	if(const auto listen_port_itr = received_dict.find("p"); listen_port_itr != received_dict.end()) {
 
-		if(socket->peer_ut_metadata_id <= 0 || socket->peer_ut_metadata_id > std::numeric_limits<std::int8_t>::max()) {
-			qDebug() << "peer sent invalid metadat id" << socket->peer_ut_metadata_id;
-			return socket->disconnectFromHost();
+		if(const auto listen_port = std::any_cast<std::int64_t>(listen_port_itr->second); listen_port > 0 && listen_port <= std::numeric_limits<std::uint16_t>::max()) {
+			socket->peer_listen_port = static_cast<std::uint16_t>(listen_port);
 		}
-	} else {
-		return socket->on_peer_fault();
+	}
+
+	if(socket->peer_ut_pex_id > 0 && !is_private_) {
+		send_pex_message(socket);
+	}
+
+	if(has_metadata_) {
+		return;
+	}
+
+	const auto metadata_size_itr = received_dict.find("metadata_size");
+
+	if(metadata_size_itr == received_dict.end() || socket->peer_ut_metadata_id < 0) {
+		qDebug() << "peer can't send the metadata";
+		return socket->disconnectFromHost();
 	}
 
 	if(metadata_size_ < 1) {
@@ -1460,7 +2492,81 @@ void Peer_wire_client::on_extension_handshake_received(Tcp_socket * const socket
 		metadata_field_.resize(total_metadata_piece_cnt_);
 	}
 
-	send_metadata_requests(socket);
+	send_metadata_requests();
+}
+
+void Peer_wire_client::on_extension_pex_message_received(Tcp_socket * const socket, const QByteArray & message) {
+	assert(socket);
+	assert(!message.isEmpty());
+
+	// peers are expected to send one message a minute at most. some slack is left for timer jitter
+	if(constexpr std::chrono::milliseconds min_pex_interval(std::chrono::seconds(45));
+	   socket->pex_receive_timer.isValid() && socket->pex_receive_timer.elapsed() < min_pex_interval.count()) {
+		qDebug() << "peer is flooding pex messages";
+		return socket->on_peer_fault();
+	}
+
+	socket->pex_receive_timer.start();
+
+	const auto received_dict = bencode::parse_content(message);
+
+	auto extract_peers = [&received_dict](const std::string & peers_key, const qsizetype ip_byte_cnt) {
+		QList<std::pair<QUrl, std::uint8_t>> peers; // {peer_url,flags}
+
+		const auto peers_itr = received_dict.find(peers_key);
+
+		if(peers_itr == received_dict.end()) {
+			return peers;
+		}
+
+		const auto * const compact_peers = std::any_cast<std::string>(&peers_itr->second);
+
+		if(!compact_peers) {
+			return peers;
+		}
+
+		const auto flags = [&received_dict, &peers_key] {
+			const auto flags_itr = received_dict.find(peers_key + ".f");
+			const auto * const raw_flags = flags_itr == received_dict.end() ? nullptr : std::any_cast<std::string>(&flags_itr->second);
+			return raw_flags ? QByteArray(raw_flags->data(), static_cast<qsizetype>(raw_flags->size())) : QByteArray{};
+		}();
+
+		const QByteArray raw_peers(compact_peers->data(), static_cast<qsizetype>(compact_peers->size()));
+		constexpr auto port_byte_cnt = 2;
+		const auto peer_url_byte_cnt = ip_byte_cnt + port_byte_cnt;
+
+		for(qsizetype idx = 0, peer_idx = 0; idx + peer_url_byte_cnt <= raw_peers.size() && peer_idx < max_pex_peer_cnt; idx += peer_url_byte_cnt, ++peer_idx) {
+			const auto peer_address = ip_byte_cnt == 16 ? QHostAddress(reinterpret_cast<const quint8 *>(raw_peers.constData() + idx))
+								  : QHostAddress(util::extract_integer<std::uint32_t>(raw_peers, idx));
+
+			QUrl peer_url;
+			peer_url.setHost(peer_address.toString());
+			peer_url.setPort(util::extract_integer<std::uint16_t>(raw_peers, idx + ip_byte_cnt));
+
+			if(peer_url.isValid() && peer_url.port() > 0) {
+				peers.emplace_back(std::move(peer_url), peer_idx < flags.size() ? static_cast<std::uint8_t>(flags[peer_idx]) : std::uint8_t{0});
+			}
+		}
+
+		return peers;
+	};
+
+	QList<QUrl> peer_urls;
+
+	for(const auto & [peer_url, flags] : extract_peers("added", 4) + extract_peers("added6", 16)) {
+		constexpr std::uint8_t supports_utp_flag = 0x04;
+
+		if(flags & supports_utp_flag) {
+			connection_manager_.mark_utp_capable(Connection_manager::normalized_peer_url(peer_url));
+		}
+
+		peer_urls.push_back(peer_url);
+	}
+
+	if(!peer_urls.isEmpty()) {
+		qDebug() << "peers sent through pex" << peer_urls.size();
+		connection_manager_.add_candidates(peer_urls);
+	}
 }
 
 void Peer_wire_client::on_extension_metadata_message_received(Tcp_socket * const socket, const QByteArray & message) {
@@ -1474,6 +2580,11 @@ void Peer_wire_client::on_extension_metadata_message_received(Tcp_socket * const
 		switch(msg_type) {
 
 			case Metadata_Id::Data: {
+
+				if(has_metadata_ || metadata_field_.isEmpty()) { // unsolicited
+					return;
+				}
+
 				const auto piece_itr = received_dict.find("piece");
 
 				if(piece_itr == received_dict.end()) {
@@ -1514,9 +2625,13 @@ void Peer_wire_client::on_extension_metadata_message_received(Tcp_socket * const
 				std::copy_n(message.data() + dict_begin_offset, received_dict_size, raw_metadata_.begin() + piece_idx * max_block_size);
 
 				metadata_field_[piece_idx] = true;
+				metadata_requests_.remove(piece_idx);
+				metadata_piece_sources_[piece_idx] = socket;
 
 				if(++obtained_metadata_piece_cnt_ == total_metadata_piece_cnt_) {
 					emit metadata_received();
+				} else {
+					send_metadata_requests();
 				}
 
 				assert(obtained_metadata_piece_cnt_ <= total_metadata_piece_cnt_);
@@ -1524,12 +2639,29 @@ void Peer_wire_client::on_extension_metadata_message_received(Tcp_socket * const
 			}
 
 			case Metadata_Id::Reject: {
-				return socket->disconnectFromHost(); // bad peer :(
+
+				if(has_metadata_) {
+					return;
+				}
+
+				// the peer has no metadata to give (or is throttling us). what it was asked for goes to the others
+				socket->peer_lacks_metadata = true;
+
+				for(auto request_itr = metadata_requests_.begin(); request_itr != metadata_requests_.end();) {
+					request_itr = request_itr->socket == socket ? metadata_requests_.erase(request_itr) : std::next(request_itr);
+				}
+
+				return send_metadata_requests();
 			}
 
 			case Metadata_Id::Request: {
-				// todo
-				break;
+				const auto piece_itr = received_dict.find("piece");
+
+				if(piece_itr == received_dict.end()) {
+					return socket->on_peer_fault();
+				}
+
+				return on_metadata_request_received(socket, std::any_cast<std::int64_t>(piece_itr->second));
 			}
 
 			default: {
@@ -1554,25 +2686,251 @@ bool Peer_wire_client::validate_metadata_piece_info(const std::int64_t piece_idx
 	return received_raw_dict_size == max_block_size;
 }
 
-void Peer_wire_client::send_metadata_requests(Tcp_socket * const socket) const noexcept {
+void Peer_wire_client::on_metadata_request_received(Tcp_socket * const socket, const std::int64_t metadata_piece_idx) noexcept {
 	assert(socket);
-	assert(socket->peer_ut_metadata_id > 0);
-	assert(socket->peer_ut_metadata_id <= std::numeric_limits<std::int8_t>::max());
-	static_assert(max_block_size);
+
+	if(socket->peer_ut_metadata_id <= 0) { // the reply could not be addressed
+		return;
+	}
+
+	const auto peer_ut_metadata_idx = static_cast<std::int8_t>(socket->peer_ut_metadata_id);
+
+	if(!has_metadata_ || raw_metadata_.isEmpty()) {
+		return socket->send_packet(craft_metadata_message(Metadata_Id::Reject, metadata_piece_idx, peer_ut_metadata_idx));
+	}
+
+	if(metadata_piece_idx < 0 || metadata_piece_idx >= total_metadata_piece_cnt_) {
+		qDebug() << "peer requested invalid metadata piece" << metadata_piece_idx;
+		return socket->on_peer_fault();
+	}
+
+	const auto block_offset = metadata_piece_idx * max_block_size;
+	const auto metadata_block = raw_metadata_.sliced(block_offset, std::min<qsizetype>(max_block_size, raw_metadata_.size() - block_offset));
+
+	// metadata counts against the upload limits like any other payload
+	socket->send_rate_limited_packet(craft_metadata_message(Metadata_Id::Data, metadata_piece_idx, peer_ut_metadata_idx, metadata_block));
+}
+
+void Peer_wire_client::send_metadata_requests() noexcept {
+
+	if(has_metadata_ || metadata_field_.isEmpty()) {
+		return;
+	}
+
+	// unanswered requests are dropped here and handed to another peer below
+	for(auto request_itr = metadata_requests_.begin(); request_itr != metadata_requests_.end();) {
+		const auto & [socket, request_timer] = *request_itr;
+
+		if(!socket || socket->state() != Tcp_socket::SocketState::ConnectedState) {
+			request_itr = metadata_requests_.erase(request_itr);
+		} else if(request_timer.hasExpired(std::chrono::milliseconds(metadata_request_timeout).count())) {
+			qDebug() << "metadata request timed out" << request_itr.key() << socket->peer_url();
+			++socket->metadata_timeout_cnt;
+			request_itr = metadata_requests_.erase(request_itr);
+		} else {
+			++request_itr;
+		}
+	}
+
+	auto pending_request_cnt = [this](const Tcp_socket * const socket) {
+		return std::count_if(metadata_requests_.cbegin(), metadata_requests_.cend(), [socket](const Metadata_request & metadata_request) {
+			return metadata_request.socket == socket;
+		});
+	};
+
+	// peers that let requests time out are asked last, the others share the pieces
+	auto request_rank = [&pending_request_cnt](const Tcp_socket * const socket) {
+		return std::make_pair(socket->metadata_timeout_cnt, pending_request_cnt(socket));
+	};
 
 	for(std::int64_t piece_idx = 0; piece_idx < total_metadata_piece_cnt_; ++piece_idx) {
-		socket->send_packet(craft_metadata_request(piece_idx, static_cast<std::int8_t>(socket->peer_ut_metadata_id)));
+
+		if(metadata_field_[piece_idx] || metadata_requests_.contains(piece_idx)) {
+			continue;
+		}
+
+		Tcp_socket * target_socket = nullptr;
+
+		for(auto * const socket : connection_manager_.established_sockets()) {
+
+			if(socket->peer_ut_metadata_id <= 0 || socket->peer_lacks_metadata || pending_request_cnt(socket) >= max_metadata_request_cnt) {
+				continue;
+			}
+
+			if(!target_socket || request_rank(socket) < request_rank(target_socket)) {
+				target_socket = socket;
+			}
+		}
+
+		if(!target_socket) {
+			return;
+		}
+
+		assert(target_socket->peer_ut_metadata_id <= std::numeric_limits<std::int8_t>::max());
+		target_socket->send_packet(craft_metadata_message(Metadata_Id::Request, piece_idx, static_cast<std::int8_t>(target_socket->peer_ut_metadata_id)));
+
+		auto & metadata_request = metadata_requests_[piece_idx];
+		metadata_request.socket = target_socket;
+		metadata_request.timer.start();
 	}
 }
 
-QByteArray Peer_wire_client::craft_metadata_request(const std::int64_t block_idx, const std::int8_t peer_ut_metadata_idx) noexcept {
+QByteArray Peer_wire_client::craft_metadata_message(const Metadata_Id msg_type, const std::int64_t block_idx, const std::int8_t peer_ut_metadata_idx, const QByteArray & metadata_block) const noexcept {
 	assert(block_idx >= 0);
 	assert(peer_ut_metadata_idx > 0);
+	assert(msg_type == Metadata_Id::Data || metadata_block.isEmpty());
 	using util::conversion::convert_to_hex;
 
-	const auto dictionary = "d8:msg_typei0e5:piecei" + QByteArray::number(block_idx) + "ee";
-	const auto request_size = static_cast<std::int32_t>(dictionary.size()) + 2;
+	auto dictionary = "d8:msg_typei" + QByteArray::number(msg_type) + "e5:piecei" + QByteArray::number(block_idx) + 'e';
+
+	if(msg_type == Metadata_Id::Data) {
+		dictionary += "10:total_sizei" + QByteArray::number(metadata_size_) + 'e';
+	}
+
+	// the metadata block follows the dictionary
+	const auto payload = dictionary + 'e' + metadata_block;
+	const auto msg_size = static_cast<std::int32_t>(payload.size()) + 2;
 	constexpr std::int8_t protocol_prefix = 20;
 
-	return convert_to_hex(request_size) + convert_to_hex(protocol_prefix) + convert_to_hex(peer_ut_metadata_idx) + dictionary.toHex();
+	return convert_to_hex(msg_size) + convert_to_hex(protocol_prefix) + convert_to_hex(peer_ut_metadata_idx) + payload.toHex();
 }
+
+QByteArray Peer_wire_client::craft_extended_handshake() const noexcept {
+	using util::conversion::convert_to_hex;
+
+	// advertises our listen port too so that peers that accepted us can pass us on through pex.
+	// metadata_size tells magnet peers that they can fetch the info dictionary from us
+	const auto metadata_size_entry = has_metadata_ && metadata_size_ ? "13:metadata_sizei" + QByteArray::number(metadata_size_) + 'e' : QByteArray();
+
+	// private torrents do not take part in pex (BEP 27)
+	const auto ut_pex_entry = is_private_ ? QByteArray() : "6:ut_pexi" + QByteArray::number(Extension_Id::Ut_Pex) + 'e';
+
+	const auto handshake_dict = "d1:md11:ut_metadatai" + QByteArray::number(Extension_Id::Ut_Metadata) + 'e' + ut_pex_entry + 'e' + metadata_size_entry + "1:pi" +
+				    QByteArray::number(Peer_listener::listen_port()) + "ee";
+
+	const auto handshake_size = static_cast<std::int32_t>(handshake_dict.size()) + 2;
+	constexpr std::int8_t ext_msg_id = 20;
+	constexpr std::int8_t handshake_msg_id = Extension_Id::Handshake;
+
+	return convert_to_hex(handshake_size) + convert_to_hex(ext_msg_id) + convert_to_hex(handshake_msg_id) + handshake_dict.toHex();
+}
+
+std::optional<QUrl> Peer_wire_client::pex_peer_url(const Tcp_socket * const socket) noexcept {
+	assert(socket);
+
+	if(socket->peer_listen_port) {
+		auto peer_url = socket->peer_url();
+		peer_url.setPort(socket->peer_listen_port);
+		return peer_url;
+	}
+
+	// the source port of an accepted connection is useless to others
+	if(socket->is_outgoing()) {
+		return socket->peer_url();
+	}
+
+	return {};
+}
+
+void Peer_wire_client::send_pex_message(Tcp_socket * const socket) noexcept {
+	assert(socket);
+	assert(!is_private_);
+
+	if(socket->peer_ut_pex_id <= 0 || socket->state() != Tcp_socket::SocketState::ConnectedState) {
+		return;
+	}
+
+	// the peer treats more than one message a minute as flooding
+	if(socket->pex_send_timer.isValid() && !socket->pex_send_timer.hasExpired(std::chrono::milliseconds(min_pex_interval).count())) {
+		return;
+	}
+
+	QHash<QUrl, std::uint8_t> connected_peers; // {peer_url,flags}
+
+	for(const auto * const peer : connection_manager_.established_sockets()) {
+		const auto peer_url = pex_peer_url(peer);
+
+		if(peer == socket || !peer_url) {
+			continue;
+		}
+
+		constexpr std::uint8_t seed_flag = 0x02;
+		constexpr std::uint8_t supports_utp_flag = 0x04;
+		constexpr std::uint8_t reachable_flag = 0x10;
+
+		const auto is_seed = has_metadata_ && !peer->peer_bitfield.isEmpty() && peer->peer_bitfield.count(true) == total_piece_cnt_;
+		const auto is_utp = qobject_cast<const Utp_socket *>(peer) != nullptr;
+
+		connected_peers[*peer_url] = static_cast<std::uint8_t>((is_seed ? seed_flag : 0) | (is_utp ? supports_utp_flag : 0) | (peer->is_outgoing() ? reachable_flag : 0));
+	}
+
+	using util::conversion::convert_to_hex;
+
+	// hex encoded compact {ip,port} lists, split by address family
+	QByteArray added_hex, added_flags_hex, added6_hex, added6_flags_hex, dropped_hex, dropped6_hex;
+
+	auto compact_peer_hex = [](const QUrl & peer_url, bool & is_ipv6) {
+		const QHostAddress peer_address(peer_url.host());
+		const auto peer_port = static_cast<std::uint16_t>(peer_url.port());
+		is_ipv6 = peer_address.protocol() == QAbstractSocket::NetworkLayerProtocol::IPv6Protocol;
+
+		if(is_ipv6) {
+			const auto ipv6_address = peer_address.toIPv6Address();
+			return QByteArray(reinterpret_cast<const char *>(ipv6_address.c), sizeof(ipv6_address.c)).toHex() + convert_to_hex(peer_port);
+		}
+
+		return convert_to_hex(peer_address.toIPv4Address()) + convert_to_hex(peer_port);
+	};
+
+	qsizetype added_cnt = 0;
+
+	for(auto peer_itr = connected_peers.cbegin(); peer_itr != connected_peers.cend() && added_cnt < max_pex_peer_cnt; ++peer_itr) {
+
+		if(socket->pex_advertised_peers.contains(peer_itr.key())) {
+			continue;
+		}
+
+		bool is_ipv6 = false;
+		const auto peer_hex = compact_peer_hex(peer_itr.key(), is_ipv6);
+
+		(is_ipv6 ? added6_hex : added_hex) += peer_hex;
+		(is_ipv6 ? added6_flags_hex : added_flags_hex) += convert_to_hex(peer_itr.value());
+		socket->pex_advertised_peers.insert(peer_itr.key());
+		++added_cnt;
+	}
+
+	qsizetype dropped_cnt = 0;
+
+	for(auto peer_itr = socket->pex_advertised_peers.begin(); peer_itr != socket->pex_advertised_peers.end() && dropped_cnt < max_pex_peer_cnt;) {
+
+		if(connected_peers.contains(*peer_itr)) {
+			++peer_itr;
+			continue;
+		}
+
+		bool is_ipv6 = false;
+		const auto peer_hex = compact_peer_hex(*peer_itr, is_ipv6);
+
+		(is_ipv6 ? dropped6_hex : dropped_hex) += peer_hex;
+		peer_itr = socket->pex_advertised_peers.erase(peer_itr);
+		++dropped_cnt;
+	}
+
+	if(!added_cnt && !dropped_cnt) {
+		return;
+	}
+
+	auto bencoded_string = [](const QByteArray & key, const QByteArray & value_hex) {
+		return QByteArray::number(key.size()).toHex() + QByteArray(":").toHex() + key.toHex() + QByteArray::number(value_hex.size() / 2).toHex() + QByteArray(":").toHex() + value_hex;
+	};
+
+	// keys in lexicographic order as bencode requires
+	const auto pex_dict_hex = QByteArray("d").toHex() + bencoded_string("added", added_hex) + bencoded_string("added.f", added_flags_hex) + bencoded_string("added6", added6_hex) +
+				  bencoded_string("added6.f", added6_flags_hex) + bencoded_string("dropped", dropped_hex) + bencoded_string("dropped6", dropped6_hex) + QByteArray("e").toHex();
+
+	const auto pex_msg_size = static_cast<std::int32_t>(pex_dict_hex.size() / 2) + 2;
+	constexpr std::int8_t ext_msg_id = 20;
+
+	socket->send_packet(convert_to_hex(pex_msg_size) + convert_to_hex(ext_msg_id) + convert_to_hex(static_cast<std::int8_t>(socket->peer_ut_pex_id)) + pex_dict_hex);
+	socket->pex_send_timer.start();
+}
\ No newline at end of file
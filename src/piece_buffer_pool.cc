@@ -0,0 +1,102 @@
+#include "piece_buffer_pool.h"
+
+#include <QSettings>
+
+Piece_buffer_pool::Piece_buffer_pool() {
+	QSettings settings;
+	settings.beginGroup("storage");
+	byte_budget_ = std::max<std::int64_t>(0, qvariant_cast<std::int64_t>(settings.value("piece_buffer_budget", default_byte_budget)));
+}
+
+Piece_buffer_pool & Piece_buffer_pool::instance() noexcept {
+	static Piece_buffer_pool piece_buffer_pool;
+	return piece_buffer_pool;
+}
+
+void Piece_buffer_pool::set_byte_budget(const std::int64_t byte_budget) noexcept {
+	assert(byte_budget >= 0);
+	byte_budget_ = byte_budget;
+	evict_free_buffers(0);
+}
+
+bool Piece_buffer_pool::reserve(const std::int64_t byte_cnt) noexcept {
+	assert(byte_cnt > 0);
+
+	if(!can_allocate(byte_cnt)) {
+		return false;
+	}
+
+	reserved_byte_cnt_ += byte_cnt;
+	return true;
+}
+
+void Piece_buffer_pool::cancel_reservation(const std::int64_t byte_cnt) noexcept {
+	reserved_byte_cnt_ -= byte_cnt;
+	assert(reserved_byte_cnt_ >= 0);
+}
+
+std::optional<QByteArray> Piece_buffer_pool::acquire(const qsizetype byte_cnt, const bool is_reserved) noexcept {
+	assert(byte_cnt > 0);
+
+	if(is_reserved) { // turns into lent bytes below
+		cancel_reservation(byte_cnt);
+	}
+
+	if(!can_allocate(byte_cnt)) {
+		return {};
+	}
+
+	QByteArray buffer;
+
+	if(auto free_itr = free_buffers_.find(byte_cnt); free_itr != free_buffers_.end() && !free_itr->isEmpty()) {
+		buffer = free_itr->takeLast();
+		free_byte_cnt_ -= buffer.capacity();
+	} else {
+		evict_free_buffers(byte_cnt);
+		buffer.resize(byte_cnt);
+	}
+
+	assert(buffer.size() == byte_cnt);
+
+	used_byte_cnt_ += buffer.capacity();
+	lent_buffers_.insert(buffer.constData(), buffer.capacity());
+
+	return buffer;
+}
+
+void Piece_buffer_pool::release(QByteArray && buffer) noexcept {
+	const auto lent_itr = lent_buffers_.constFind(buffer.constData());
+
+	if(buffer.isEmpty() || lent_itr == lent_buffers_.cend()) { // not handed out by the pool
+		buffer = QByteArray();
+		return;
+	}
+
+	used_byte_cnt_ -= *lent_itr;
+	lent_buffers_.erase(lent_itr);
+	assert(used_byte_cnt_ >= 0);
+
+	// keep at most the unused part of the budget around for reuse
+	if(!buffer.isDetached() || free_byte_cnt_ + used_byte_cnt_ + reserved_byte_cnt_ + buffer.capacity() > byte_budget_) {
+		buffer = QByteArray();
+		return;
+	}
+
+	const auto buffer_size = buffer.size();
+	free_byte_cnt_ += buffer.capacity();
+	free_buffers_[buffer_size].push_back(std::exchange(buffer, QByteArray()));
+}
+
+void Piece_buffer_pool::evict_free_buffers(const std::int64_t needed_byte_cnt) noexcept {
+
+	for(auto free_itr = free_buffers_.begin(); free_itr != free_buffers_.end() && free_byte_cnt_ + used_byte_cnt_ + reserved_byte_cnt_ + needed_byte_cnt > byte_budget_;) {
+
+		while(!free_itr->isEmpty() && free_byte_cnt_ + used_byte_cnt_ + reserved_byte_cnt_ + needed_byte_cnt > byte_budget_) {
+			free_byte_cnt_ -= free_itr->takeLast().capacity();
+		}
+
+		free_itr = free_itr->isEmpty() ? free_buffers_.erase(free_itr) : std::next(free_itr);
+	}
+
+	assert(free_byte_cnt_ >= 0);
+}
\ No newline at end of file
@@ -58,7 +58,14 @@ std::optional<QByteArray> Tcp_socket::receive_packet() noexcept {
 		buffer_data.reserve(*msg_size);
 	}
 
-	if(buffer_data += read(*msg_size - buffer_data.size()); buffer_data.size() == *msg_size) {
+	const auto prev_buffer_size = buffer_data.size();
+	buffer_data += read(*msg_size - buffer_data.size());
+
+	if(download_bucket_.is_limited()) {
+		download_bucket_.consume(buffer_data.size() - prev_buffer_size);
+	}
+
+	if(buffer_data.size() == *msg_size) {
 		assert(!buffer_data.isEmpty());
 		msg_size.reset();
 		return std::move(buffer_data);
@@ -80,6 +87,9 @@ void Tcp_socket::configure_default_connections() noexcept {
 		state() == SocketState::UnconnectedState ? deleteLater() : disconnectFromHost();
 	});
 
+	throttle_timer_.setSingleShot(true);
+	throttle_timer_.callOnTimeout(this, &Tcp_socket::send_throttled_packets);
+
 	request_timer.callOnTimeout(this, [this] {
 		if(pending_requests_.isEmpty()) {
 			return request_timer.stop();
@@ -90,4 +100,78 @@ void Tcp_socket::configure_default_connections() noexcept {
 		sent_requests_.insert(request_metadata);
 		pending_requests_.erase(pending_requests_.constBegin());
 	});
+}
+
+void Tcp_socket::send_rate_limited_packet(QByteArray packet) noexcept {
+	assert(!packet.isEmpty());
+
+	if(!upload_bucket_.is_limited()) {
+		return send_packet(packet);
+	}
+
+	throttled_packets_.push_back(std::move(packet));
+
+	if(!throttle_timer_.isActive()) {
+		send_throttled_packets();
+	}
+}
+
+QList<QByteArray> Tcp_socket::take_throttled_packets(const std::function<bool(const QByteArray &)> & predicate) noexcept {
+	QList<QByteArray> taken_packets;
+
+	for(auto packet_itr = throttled_packets_.begin(); packet_itr != throttled_packets_.end();) {
+
+		if(predicate(*packet_itr)) {
+			taken_packets.push_back(std::move(*packet_itr));
+			packet_itr = throttled_packets_.erase(packet_itr);
+		} else {
+			++packet_itr;
+		}
+	}
+
+	return taken_packets;
+}
+
+void Tcp_socket::send_throttled_packets() noexcept {
+
+	while(!throttled_packets_.isEmpty() && upload_bucket_.has_tokens()) {
+		const auto packet = throttled_packets_.takeFirst();
+		upload_bucket_.consume(packet.size() / 2); // hex encoded
+		send_packet(packet);
+	}
+
+	if(!throttled_packets_.isEmpty()) {
+		throttle_timer_.start(upload_bucket_.refill_delay());
+	}
+}
+
+void Tcp_socket::set_rate_limits(Token_bucket * const torrent_upload_bucket, Token_bucket * const torrent_download_bucket, const std::int64_t upload_byte_rate,
+					   const std::int64_t download_byte_rate) noexcept {
+	upload_bucket_.set_parent(torrent_upload_bucket);
+	download_bucket_.set_parent(torrent_download_bucket);
+	upload_bucket_.set_byte_rate(upload_byte_rate);
+	download_bucket_.set_byte_rate(download_byte_rate);
+
+	// a bounded read buffer makes the kernel shrink the receive window while we hold reads back
+	constexpr qint64 throttled_read_buffer_size = 1 << 16;
+	setReadBufferSize(download_bucket_.is_limited() ? throttled_read_buffer_size : 0);
+}
+
+bool Tcp_socket::is_lan_peer() const noexcept {
+	const QHostAddress peer_address(peer_url_.host());
+
+	if(peer_address.isLoopback() || peer_address.isLinkLocal()) {
+		return true;
+	}
+
+	const static QList<std::pair<QHostAddress, std::int32_t>> private_subnets{
+		QHostAddress::parseSubnet("10.0.0.0/8"),
+		QHostAddress::parseSubnet("172.16.0.0/12"),
+		QHostAddress::parseSubnet("192.168.0.0/16"),
+		QHostAddress::parseSubnet("fc00::/7"),
+	};
+
+	return std::ranges::any_of(private_subnets, [&peer_address](const auto & private_subnet) {
+		return peer_address.isInSubnet(private_subnet);
+	});
 }
\ No newline at end of file
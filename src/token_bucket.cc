@@ -0,0 +1,99 @@
+#include "token_bucket.h"
+
+#include <QSettings>
+#include <algorithm>
+#include <cmath>
+
+Token_bucket::Token_bucket(Token_bucket * const parent, const std::int64_t byte_rate) noexcept : parent_(parent) {
+	set_byte_rate(byte_rate);
+}
+
+Token_bucket & Token_bucket::global_upload() noexcept {
+	static Token_bucket global_upload_bucket(nullptr, [] {
+		QSettings settings;
+		return qvariant_cast<std::int64_t>(settings.value("network/max_upload_rate", 0));
+	}());
+
+	return global_upload_bucket;
+}
+
+Token_bucket & Token_bucket::global_download() noexcept {
+	static Token_bucket global_download_bucket(nullptr, [] {
+		QSettings settings;
+		return qvariant_cast<std::int64_t>(settings.value("network/max_download_rate", 0));
+	}());
+
+	return global_download_bucket;
+}
+
+void Token_bucket::reload_global_rates() noexcept {
+	QSettings settings;
+	global_upload().set_byte_rate(qvariant_cast<std::int64_t>(settings.value("network/max_upload_rate", 0)));
+	global_download().set_byte_rate(qvariant_cast<std::int64_t>(settings.value("network/max_download_rate", 0)));
+}
+
+void Token_bucket::set_byte_rate(std::int64_t byte_rate) noexcept {
+	byte_rate = std::max<std::int64_t>(0, byte_rate);
+
+	// reapplying the same rate must not hand out a fresh burst
+	if(byte_rate == byte_rate_ && byte_rate) {
+		return;
+	}
+
+	byte_rate_ = byte_rate;
+	token_cnt_ = static_cast<double>(std::max(byte_rate_, min_burst_byte_cnt));
+	last_refill_time_ = std::chrono::steady_clock::now();
+}
+
+void Token_bucket::refill() noexcept {
+	assert(byte_rate_);
+
+	const auto now = std::chrono::steady_clock::now();
+	const std::chrono::duration<double> elapsed_time = now - last_refill_time_;
+	const auto burst_byte_cnt = static_cast<double>(std::max(byte_rate_, min_burst_byte_cnt));
+
+	token_cnt_ = std::min(burst_byte_cnt, token_cnt_ + elapsed_time.count() * static_cast<double>(byte_rate_));
+	last_refill_time_ = now;
+}
+
+bool Token_bucket::has_tokens() noexcept {
+
+	if(byte_rate_) {
+		refill();
+
+		if(token_cnt_ <= 0) {
+			return false;
+		}
+	}
+
+	return !parent_ || parent_->has_tokens();
+}
+
+void Token_bucket::consume(const std::int64_t byte_cnt) noexcept {
+	assert(byte_cnt >= 0);
+
+	// may go into debt; has_tokens() then holds traffic back until the debt is paid off
+	if(byte_rate_) {
+		token_cnt_ -= static_cast<double>(byte_cnt);
+	}
+
+	if(parent_) {
+		parent_->consume(byte_cnt);
+	}
+}
+
+std::chrono::milliseconds Token_bucket::refill_delay() noexcept {
+	constexpr std::chrono::milliseconds min_refill_delay(10);
+	auto refill_delay = min_refill_delay;
+
+	if(byte_rate_) {
+		refill();
+
+		if(token_cnt_ <= 0) {
+			const auto debt_ms = std::ceil(-token_cnt_ * 1000 / static_cast<double>(byte_rate_)) + 1;
+			refill_delay = std::max(refill_delay, std::chrono::milliseconds(static_cast<std::int64_t>(debt_ms)));
+		}
+	}
+
+	return parent_ ? std::max(refill_delay, parent_->refill_delay()) : refill_delay;
+}
\ No newline at end of file
@@ -64,9 +64,13 @@ void Torrent_properties_displayer::display_file_bar() noexcept {
 	show();
 }
 
-void Torrent_properties_displayer::remove_peer(std::int32_t peer_row_idx) noexcept {
-	assert(peer_row_idx >= 0 && peer_row_idx < peer_table_.rowCount());
-	peer_table_.removeRow(peer_row_idx);
+void Torrent_properties_displayer::remove_peer(const Tcp_socket * const socket) noexcept {
+	const auto peer_row_idx = peer_rows_.indexOf(socket);
+	assert(peer_row_idx != -1);
+	assert(peer_rows_.size() == peer_table_.rowCount());
+
+	peer_rows_.remove(peer_row_idx);
+	peer_table_.removeRow(static_cast<std::int32_t>(peer_row_idx));
 }
 
 void Torrent_properties_displayer::setup_peer_table() noexcept {
@@ -147,6 +151,7 @@ void Torrent_properties_displayer::add_peer(const Tcp_socket * const socket) noe
 	assert(peer_table_.columnCount() == 4);
 
 	peer_table_.setRowCount((peer_table_.rowCount() + 1));
+	peer_rows_.push_back(socket);
 
 	auto get_cell_label_text = [](const auto byte_cnt, const auto conversion_fmt) {
 		const auto [converted_byte_cnt, suffix] = util::conversion::stringify_bytes(byte_cnt, conversion_fmt);
@@ -0,0 +1,31 @@
+#include "tracker.h"
+#include "util.h"
+
+#include <QHostAddress>
+
+QList<QUrl> Tracker::extract_compact_peers(const QByteArray & compact_peers, const bool ipv6_peers) {
+	QList<QUrl> peer_urls;
+
+	constexpr auto port_byte_cnt = 2;
+	const auto ip_byte_cnt = ipv6_peers ? 16 : 4;
+	const auto peer_url_byte_cnt = ip_byte_cnt + port_byte_cnt;
+
+	for(qsizetype idx = 0; idx + peer_url_byte_cnt <= compact_peers.size(); idx += peer_url_byte_cnt) {
+		const auto peer_address = ipv6_peers ? QHostAddress(reinterpret_cast<const quint8 *>(compact_peers.constData() + idx))
+						     : QHostAddress(util::extract_integer<std::uint32_t>(compact_peers, idx));
+
+		const auto peer_port = util::extract_integer<std::uint16_t>(compact_peers, idx + ip_byte_cnt);
+
+		QUrl url;
+		url.setHost(peer_address.toString());
+		url.setPort(peer_port);
+
+		if(url.isValid()) {
+			peer_urls.emplace_back(std::move(url));
+		} else {
+			qDebug() << "tracker sent invalid peer url";
+		}
+	}
+
+	return peer_urls;
+}
\ No newline at end of file
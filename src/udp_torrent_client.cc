@@ -2,19 +2,34 @@
 #include "peer_wire_client.h"
 #include "download_tracker.h"
 #include "magnet_url_parser.h"
+#include "peer_listener.h"
+#include "dht_node.h"
+#include "local_discovery.h"
+#include "http_tracker.h"
+#include "udp_tracker.h"
 
-#include <QBigEndianStorageType>
-#include <QNetworkDatagram>
 #include <QSettings>
 #include <QPointer>
+#include <cmath>
 
-Udp_torrent_client::Udp_torrent_client(bencode::Metadata torrent_metadata, util::Download_resources resources, QByteArray info_sha1_hash, QObject * const parent)
-    : QObject(parent),
+Udp_torrent_client::Udp_torrent_client(bencode::Metadata torrent_metadata, util::Download_resources resources, QByteArray info_sha1_hash,
+				       QNetworkAccessManager * const network_manager)
+    : QObject(network_manager),
 	torrent_metadata_(std::move(torrent_metadata)),
 	info_sha1_hash_(info_sha1_hash.isEmpty() ? calculate_info_sha1_hash(torrent_metadata_) : std::move(info_sha1_hash)),
 	peer_client_(torrent_metadata_, {resources.dl_path, std::move(resources.file_handles), resources.tracker}, id, info_sha1_hash_),
+	network_manager_(network_manager),
 	tracker_(resources.tracker) {
 	configure_default_connections();
+	set_tracker_tiers(extract_tracker_tiers(resources.dl_path, torrent_metadata_.announce_url_list));
+
+	if(const auto web_seed_urls = extract_web_seed_urls(resources.dl_path); network_manager_ && !web_seed_urls.isEmpty()) {
+		peer_client_.add_web_seeds(web_seed_urls, network_manager_);
+	}
+
+	if(const auto piece_layers = extract_piece_layers(resources.dl_path); !piece_layers.isEmpty()) {
+		peer_client_.add_piece_layers(piece_layers);
+	}
 
 	connect(&peer_client_, &Peer_wire_client::existing_pieces_verified, this, [this, dl_path = std::move(resources.dl_path)]() mutable {
 		auto restored_dl_paused = [&dl_path] {
@@ -25,371 +40,612 @@ Udp_torrent_client::Udp_torrent_client(bencode::Metadata torrent_metadata, util:
 		}();
 
 		if(!restored_dl_paused) {
-			send_connect_request();
+			start_peer_discovery();
 		} else {
 			connect(
 			    tracker_, &Download_tracker::download_resumed, this,
 			    [this] {
-				    send_connect_request();
+				    start_peer_discovery();
 			    },
 			    Qt::SingleShotConnection);
 		}
 	});
 }
 
-Udp_torrent_client::Udp_torrent_client(magnet::Metadata torrent_metadata, util::Download_resources resources, QObject * const parent)
-    : QObject(parent),
+Udp_torrent_client::Udp_torrent_client(magnet::Metadata torrent_metadata, util::Download_resources resources, QNetworkAccessManager * const network_manager)
+    : QObject(network_manager),
 	info_sha1_hash_(torrent_metadata.info_hash),
 	peer_client_(torrent_metadata, {std::move(resources.dl_path), {}, resources.tracker}, id),
+	network_manager_(network_manager),
 	tracker_(resources.tracker) {
 	assert(resources.file_handles.isEmpty());
 	assert(tracker_);
 	configure_default_connections();
 
-	std::ranges::for_each(torrent_metadata.tracker_urls, [this](const auto & tracker_url) {
-		assert(tracker_url.isValid());
+	QList<QList<QUrl>> tracker_tiers;
 
-		auto * const socket = new Udp_socket(tracker_url, craft_connect_request(), this);
+	// magnet links carry no tiers, every tracker is a tier of its own
+	std::ranges::for_each(torrent_metadata.tracker_urls, [&tracker_tiers](const auto & tracker_url) {
+		assert(tracker_url.isValid());
 
-		connect(socket, &Udp_socket::readyRead, this, [this, socket] {
-			on_socket_ready_read(socket);
-		});
+		if(Tracker::is_supported_url(tracker_url)) {
+			tracker_tiers.push_back({tracker_url});
+		}
 	});
+
+	set_tracker_tiers(std::move(tracker_tiers));
+	start_peer_discovery();
 }
 
-void Udp_torrent_client::configure_default_connections() noexcept {
+Udp_torrent_client::~Udp_torrent_client() {
 
-	connect(this, &Udp_torrent_client::announce_reply_received, [&peer_client_ = peer_client_, &event_ = event_](const Announce_reply & reply) {
-		event_ = Event::Started;
+	if(auto * const dht_node = Dht_node::instance()) {
+		dht_node->remove_torrent(info_sha1_hash_);
+	}
 
-		if(!reply.peer_urls.empty()) {
-			peer_client_.connect_to_peers(reply.peer_urls);
-		}
-	});
+	if(auto * const local_discovery = Local_discovery::instance()) {
+		local_discovery->remove_torrent(info_sha1_hash_);
+	}
+}
 
-	connect(tracker_, &Download_tracker::request_satisfied, this, &Udp_torrent_client::deleteLater);
-	connect(&peer_client_, &Peer_wire_client::new_download_requested, this, &Udp_torrent_client::new_download_requested);
+void Udp_torrent_client::start_peer_discovery() noexcept {
+	peer_discovery_started_ = true;
+	race_trackers();
+	schedule_scrape();
+	peer_demand_timer_.start();
+
+	// BEP 27: private torrents get their peers from the trackers only
+	const auto is_private = peer_client_.is_private();
+
+	if(auto * const dht_node = Dht_node::instance(); dht_node && !is_private) {
+		dht_node->add_torrent(info_sha1_hash_);
+	}
+
+	if(auto * const local_discovery = Local_discovery::instance(); local_discovery && !is_private) {
+		local_discovery->add_torrent(info_sha1_hash_);
+	}
 }
 
-void Udp_torrent_client::on_socket_ready_read(Udp_socket * const socket) noexcept {
+QList<QList<QUrl>> Udp_torrent_client::extract_tracker_tiers(QString dl_path, const std::vector<std::string> & announce_url_list) noexcept {
+	QList<QList<QUrl>> tracker_tiers;
 
-	auto is_valid_socket = [socket = QPointer(socket)] {
-		return socket && socket->state() == Udp_socket::SocketState::ConnectedState && socket->hasPendingDatagrams();
+	auto contains_tracker = [&tracker_tiers](const QUrl & tracker_url) {
+		return std::ranges::any_of(tracker_tiers, [&tracker_url](const QList<QUrl> & tracker_tier) {
+			return tracker_tier.contains(tracker_url);
+		});
 	};
 
-	if(!is_valid_socket()) {
-		return;
-	}
+	// bencode::Metadata flattens the announce-list, the tiers are read back from the stored torrent file
+	const auto torrent_content = stored_torrent_content(std::move(dl_path));
 
 	try {
-		communicate_with_tracker(socket);
+		const auto torrent_dict = torrent_content.isEmpty() ? bencode::dictionary{} : bencode::parse_content(torrent_content);
+		const auto announce_list_itr = torrent_dict.find("announce-list");
+		const auto * const raw_tiers = announce_list_itr == torrent_dict.end() ? nullptr : std::any_cast<bencode::list>(&announce_list_itr->second);
+
+		for(const auto & raw_tier : raw_tiers ? *raw_tiers : bencode::list{}) {
+			const auto * const raw_tier_urls = std::any_cast<bencode::list>(&raw_tier);
+
+			if(!raw_tier_urls) {
+				continue;
+			}
+
+			QList<QUrl> tracker_tier;
+
+			for(const auto & raw_tier_url : *raw_tier_urls) {
+				const auto * const tier_url = std::any_cast<std::string>(&raw_tier_url);
+
+				if(QUrl tracker_url(tier_url ? QString::fromStdString(*tier_url) : QString()); Tracker::is_supported_url(tracker_url) && !contains_tracker(tracker_url)) {
+					tracker_tier.push_back(std::move(tracker_url));
+				}
+			}
+
+			if(!tracker_tier.isEmpty()) {
+				tracker_tiers.push_back(std::move(tracker_tier));
+			}
+		}
 	} catch(const std::exception & exception) {
 		qDebug() << exception.what();
-		return socket->abort();
 	}
 
-	QTimer::singleShot(0, this, [this, socket, is_valid_socket] {
-		if(is_valid_socket()) {
-			communicate_with_tracker(socket);
+	// single tracker torrents (or the main announce url missing from the announce-list) get a tier of their own, tried last
+	for(const auto & raw_tracker_url : announce_url_list) {
+
+		if(const QUrl tracker_url(raw_tracker_url.data()); !contains_tracker(tracker_url)) {
+			tracker_tiers.push_back({tracker_url});
 		}
-	});
+	}
+
+	return tracker_tiers;
 }
 
-void Udp_torrent_client::send_connect_request(const qsizetype tracker_url_idx) noexcept {
-	assert(tracker_url_idx >= 0 && tracker_url_idx < static_cast<qsizetype>(torrent_metadata_.announce_url_list.size()));
+QList<QUrl> Udp_torrent_client::extract_web_seed_urls(QString dl_path) noexcept {
+	const auto torrent_content = stored_torrent_content(std::move(dl_path));
+	QList<QUrl> web_seed_urls;
+
+	auto add_web_seed_url = [&web_seed_urls](const std::any & raw_url) {
+		const auto * const url = std::any_cast<std::string>(&raw_url);
 
-	if(!connect_requests_sent_) {
-		connect_requests_sent_ = true;
+		const QUrl web_seed_url(url ? QString::fromStdString(*url) : QString());
+		const auto scheme = web_seed_url.scheme();
+
+		if(web_seed_url.isValid() && (scheme == "http" || scheme == "https") && !web_seed_urls.contains(web_seed_url)) {
+			web_seed_urls.push_back(web_seed_url);
+		}
+	};
+
+	try {
+		const auto torrent_dict = torrent_content.isEmpty() ? bencode::dictionary{} : bencode::parse_content(torrent_content);
+
+		// BEP 19 allows a single url in place of the list
+		if(const auto url_list_itr = torrent_dict.find("url-list"); url_list_itr != torrent_dict.end()) {
+
+			if(const auto * const raw_urls = std::any_cast<bencode::list>(&url_list_itr->second)) {
+				std::ranges::for_each(*raw_urls, add_web_seed_url);
+			} else {
+				add_web_seed_url(url_list_itr->second);
+			}
+		}
+	} catch(const std::exception & exception) {
+		qDebug() << exception.what();
 	}
 
-	const auto & tracker_url = torrent_metadata_.announce_url_list[static_cast<std::size_t>(tracker_url_idx)];
-	auto * const socket = new Udp_socket(QUrl(tracker_url.data()), craft_connect_request(), this);
+	return web_seed_urls;
+}
 
-	connect(socket, &Udp_socket::readyRead, this, [this, socket] {
-		on_socket_ready_read(socket);
-	});
+QHash<QByteArray, QByteArray> Udp_torrent_client::extract_piece_layers(QString dl_path) noexcept {
+	const auto torrent_content = stored_torrent_content(std::move(dl_path));
+	QHash<QByteArray, QByteArray> piece_layers; // {pieces_root,concatenated piece hashes}
 
-	if(tracker_url_idx + 1 < static_cast<qsizetype>(torrent_metadata_.announce_url_list.size())) {
+	try {
+		const auto torrent_dict = torrent_content.isEmpty() ? bencode::dictionary{} : bencode::parse_content(torrent_content);
 
-		QTimer::singleShot(0, this, [this, tracker_url_idx] {
-			send_connect_request(tracker_url_idx + 1);
-		});
+		// BEP 52 keeps the piece layers outside of the info dictionary, magnet downloads get them from the peers instead
+		if(const auto piece_layers_itr = torrent_dict.find("piece layers"); piece_layers_itr != torrent_dict.end()) {
+
+			for(const auto & [pieces_root, raw_piece_layer] : std::any_cast<bencode::dictionary>(piece_layers_itr->second)) {
+				const auto piece_layer = std::any_cast<std::string>(raw_piece_layer);
+				piece_layers.insert(QByteArray(pieces_root.data(), static_cast<qsizetype>(pieces_root.size())), QByteArray(piece_layer.data(), static_cast<qsizetype>(piece_layer.size())));
+			}
+		}
+	} catch(const std::exception & exception) {
+		qDebug() << exception.what();
 	}
+
+	return piece_layers;
 }
 
-QByteArray Udp_torrent_client::calculate_info_sha1_hash(const bencode::Metadata & torrent_metadata) noexcept {
-	const auto raw_info_size = static_cast<qsizetype>(torrent_metadata.raw_info_dict.size());
-	return QCryptographicHash::hash(QByteArray(torrent_metadata.raw_info_dict.data(), raw_info_size), QCryptographicHash::Sha1).toHex();
+QByteArray Udp_torrent_client::stored_torrent_content(QString dl_path) noexcept {
+	QSettings settings;
+	util::begin_setting_group<bencode::Metadata>(settings);
+	settings.beginGroup(dl_path.replace('/', '\x20'));
+	return qvariant_cast<QByteArray>(settings.value("download_metadata"));
 }
 
-bool Udp_torrent_client::verify_txn_id(const QByteArray & reply, const std::int32_t sent_txn_id) {
-	constexpr auto txn_id_offset = 4;
-	const auto received_txn_id = util::extract_integer<std::int32_t>(reply, txn_id_offset);
-	return sent_txn_id == received_txn_id;
+std::int32_t Udp_torrent_client::tracker_failure_count(const QUrl & tracker_url) noexcept {
+	QSettings settings;
+	settings.beginGroup("tracker_health");
+	return qvariant_cast<std::int32_t>(settings.value(tracker_url.toString().replace('/', '\x20'), 0));
 }
 
-std::optional<QByteArray> Udp_torrent_client::extract_tracker_error(const QByteArray & reply, const std::int32_t sent_txn_id) {
-	constexpr auto error_offset = 8;
-	return verify_txn_id(reply, sent_txn_id) ? reply.sliced(error_offset) : std::optional<QByteArray>{};
+void Udp_torrent_client::set_tracker_failure_count(const QUrl & tracker_url, const std::int32_t failure_cnt) noexcept {
+	QSettings settings;
+	settings.beginGroup("tracker_health");
+
+	if(const auto key = tracker_url.toString().replace('/', '\x20'); failure_cnt) {
+		settings.setValue(key, failure_cnt);
+	} else {
+		settings.remove(key);
+	}
 }
 
-std::optional<std::int64_t> Udp_torrent_client::extract_connect_reply(const QByteArray & reply, const std::int32_t sent_txn_id) {
-	constexpr auto connection_id_offset = 8;
-	return verify_txn_id(reply, sent_txn_id) ? util::extract_integer<std::int64_t>(reply, connection_id_offset) : std::optional<std::int64_t>{};
+void Udp_torrent_client::set_tracker_tiers(QList<QList<QUrl>> tracker_tiers) noexcept {
+	tracker_tiers_ = std::move(tracker_tiers);
+
+	// BEP 12 shuffles each tier; trackers that kept failing in earlier sessions sink to its end
+	std::ranges::for_each(tracker_tiers_, [](QList<QUrl> & tracker_tier) {
+		QHash<QUrl, std::int32_t> failure_cnts;
+
+		std::ranges::for_each(tracker_tier, [&failure_cnts](const QUrl & tracker_url) {
+			failure_cnts[tracker_url] = tracker_failure_count(tracker_url);
+		});
+
+		std::ranges::shuffle(tracker_tier, random_generator);
+
+		std::ranges::stable_sort(tracker_tier, {}, [&failure_cnts](const QUrl & tracker_url) {
+			return failure_cnts[tracker_url];
+		});
+	});
 }
 
-QByteArray Udp_torrent_client::craft_connect_request() noexcept {
-	using util::conversion::convert_to_hex;
+Udp_torrent_client::Peer_Demand Udp_torrent_client::peer_demand() const noexcept {
+	const auto & connection_manager = peer_client_.connection_manager();
+	const auto max_peer_cnt = connection_manager.max_connection_count();
+	const auto peer_cnt = connection_manager.connection_count() + connection_manager.half_open_count();
 
-	const static auto connect_request = [] {
-		constexpr auto protocol_constant = 0x41727101980;
-		return convert_to_hex(protocol_constant) + convert_to_hex(static_cast<std::int32_t>(Action_Code::Connect));
-	}();
+	if(peer_cnt >= max_peer_cnt * 3 / 4) {
+		return Peer_Demand::Saturated;
+	}
+
+	// queued candidates get dialed anyway, only a dry queue means the swarm ran out on us
+	if(peer_cnt < max_peer_cnt / 4 && !connection_manager.candidate_count()) {
+		return Peer_Demand::Starving;
+	}
 
-	const auto txn_id = random_id_range(random_generator);
-	return connect_request + convert_to_hex(txn_id);
+	return Peer_Demand::Normal;
 }
 
-QByteArray Udp_torrent_client::craft_announce_request(const std::int64_t tracker_connection_id) const noexcept {
-	using util::conversion::convert_to_hex;
+Tracker::Announce_parameters Udp_torrent_client::announce_parameters(const Tracker::Event event) const noexcept {
 
-	auto announce_request = convert_to_hex(tracker_connection_id);
-	constexpr auto fin_announce_request_size = 196;
-	announce_request.reserve(fin_announce_request_size);
+	const auto num_want = [this, event] {
+		constexpr auto default_num_want = -1;
+
+		if(event == Tracker::Event::Stopped) {
+			return 0;
+		}
+
+		switch(peer_demand()) {
+			case Peer_Demand::Starving: {
+				return max_num_want;
+			}
+
+			case Peer_Demand::Normal: {
+				return default_num_want;
+			}
 
-	announce_request += convert_to_hex(static_cast<std::int32_t>(Action_Code::Announce));
+			case Peer_Demand::Saturated: {
+				return 0;
+			}
 
-	announce_request += [] {
-		const auto txn_id = random_id_range(random_generator);
-		return convert_to_hex(txn_id);
+			default: {
+				std::unreachable();
+			}
+		}
 	}();
 
-	announce_request += info_sha1_hash_;
-	announce_request += id;
+	return {info_sha1_hash_,
+		  id,
+		  peer_client_.downloaded_byte_count(),
+		  peer_client_.remaining_byte_count(),
+		  peer_client_.uploaded_byte_count(),
+		  event,
+		  num_want,
+		  Peer_listener::listen_port()};
+}
 
-	announce_request += convert_to_hex(peer_client_.downloaded_byte_count());
-	announce_request += convert_to_hex(peer_client_.remaining_byte_count());
-	announce_request += convert_to_hex(peer_client_.uploaded_byte_count());
+Tracker * Udp_torrent_client::find_or_create_tracker(const QUrl & tracker_url) noexcept {
 
-	announce_request += convert_to_hex(static_cast<std::int32_t>(event_));
+	if(const auto tracker_itr = trackers_.constFind(tracker_url); tracker_itr != trackers_.cend()) {
+		return *tracker_itr;
+	}
 
-	announce_request += [] {
-		constexpr auto default_ip_address = 0;
-		return convert_to_hex(default_ip_address);
-	}();
+	Tracker * tracker = nullptr;
 
-	announce_request += [] {
-		const auto random_peer_key = random_id_range(random_generator);
-		return convert_to_hex(random_peer_key);
-	}();
+	if(tracker_url.scheme() == "udp") {
+		tracker = new Udp_tracker(tracker_url, this);
+	} else if(network_manager_) {
+		tracker = new Http_tracker(tracker_url, network_manager_, this);
+	} else {
+		return nullptr;
+	}
 
-	announce_request += [] {
-		constexpr auto default_num_want = -1;
-		return convert_to_hex(default_num_want);
-	}();
+	trackers_[tracker_url] = tracker;
 
-	announce_request += [] {
-		constexpr std::uint16_t default_port = 6889;
-		return convert_to_hex(default_port);
-	}();
+	connect(tracker, &Tracker::announce_reply_received, this, [this, tracker_url](const Tracker::Announce_reply & announce_reply) {
+		on_tracker_replied(tracker_url, announce_reply);
+	});
+
+	connect(tracker, &Tracker::announce_failed, this, [this, tracker_url](const QByteArray & error) {
+		qDebug() << "tracker announce failed" << tracker_url << error;
+		emit error_received(error);
+		on_tracker_failed(tracker_url);
+	});
 
-	assert(announce_request.size() == fin_announce_request_size);
-	return announce_request;
+	connect(tracker, &Tracker::announce_due, this, [this, tracker_url] {
+		if(!paused_ && tracker_url == active_tracker_url_) {
+			announce_to(tracker_url, Tracker::Event::None);
+		}
+	});
+
+	connect(tracker, &Tracker::swarm_metadata_received, this, &Udp_torrent_client::swarm_metadata_received);
+
+	return tracker;
 }
 
-QByteArray Udp_torrent_client::craft_scrape_request(const std::int64_t tracker_connection_id) const noexcept {
-	using util::conversion::convert_to_hex;
+void Udp_torrent_client::announce_to(const QUrl & tracker_url, const Tracker::Event event) noexcept {
+	auto * const tracker = find_or_create_tracker(tracker_url);
+
+	if(!tracker) {
+		return;
+	}
 
-	auto scrape_request = convert_to_hex(tracker_connection_id);
-	constexpr auto fin_scrape_request_size = 72;
-	scrape_request.reserve(fin_scrape_request_size);
+	tracker->announce(announce_parameters(event));
 
-	scrape_request += convert_to_hex(static_cast<std::int32_t>(Action_Code::Scrape));
+	if(event == Tracker::Event::Stopped) {
+		return;
+	}
 
-	scrape_request += [] {
-		const auto txn_id = random_id_range(random_generator);
-		return convert_to_hex(txn_id);
-	}();
+	if(tracker_url == active_tracker_url_) {
+		last_announce_timer_.start();
+	}
 
-	scrape_request += info_sha1_hash_;
+	pending_trackers_[tracker_url].start();
 
-	assert(scrape_request.size() == fin_scrape_request_size);
-	return scrape_request;
+	if(!tracker_timeout_timer_.isActive()) {
+		tracker_timeout_timer_.start();
+	}
 }
 
-std::optional<Udp_torrent_client::Announce_reply> Udp_torrent_client::extract_announce_reply(const QByteArray & reply, const std::int32_t sent_txn_id) {
+void Udp_torrent_client::race_trackers() noexcept {
 
-	if(!verify_txn_id(reply, sent_txn_id)) {
-		return {};
+	if(paused_ || !pending_trackers_.isEmpty() || !active_tracker_url_.isEmpty()) {
+		return;
 	}
 
-	const auto interval_time = [&reply] {
-		constexpr auto interval_offset = 8;
-		return util::extract_integer<std::int32_t>(reply, interval_offset);
-	}();
+	QList<QUrl> racing_tracker_urls;
 
-	const auto leecher_cnt = [&reply] {
-		constexpr auto leechers_offset = 12;
-		return util::extract_integer<std::int32_t>(reply, leechers_offset);
-	}();
+	// the head of every tier first, then the runners-up. the first to answer becomes the tracker we stay with
+	for(qsizetype tier_url_idx = 0; racing_tracker_urls.size() < max_racing_tracker_cnt; ++tier_url_idx) {
+		bool tier_url_left = false;
 
-	const auto seed_cnt = [&reply] {
-		constexpr auto seeders_offset = 16;
-		return util::extract_integer<std::int32_t>(reply, seeders_offset);
-	}();
+		for(const auto & tracker_tier : tracker_tiers_) {
 
-	auto peer_urls = [&reply] {
-		QList<QUrl> peer_urls_ret;
+			if(tier_url_idx < tracker_tier.size() && racing_tracker_urls.size() < max_racing_tracker_cnt) {
+				tier_url_left = true;
+				racing_tracker_urls.push_back(tracker_tier[tier_url_idx]);
+			}
+		}
 
-		constexpr auto peers_ip_offset = 20;
-		constexpr auto peer_url_byte_cnt = 6;
+		if(!tier_url_left) {
+			break;
+		}
+	}
 
-		for(qsizetype idx = peers_ip_offset; idx < reply.size(); idx += peer_url_byte_cnt) {
-			constexpr auto ip_byte_cnt = 4;
+	std::ranges::for_each(racing_tracker_urls, [this](const QUrl & tracker_url) {
+		announce_to(tracker_url, started_trackers_.contains(tracker_url) ? Tracker::Event::None : Tracker::Event::Started);
+	});
+}
 
-			const auto peer_ip = util::extract_integer<std::uint32_t>(reply, idx);
-			const auto peer_port = util::extract_integer<std::uint16_t>(reply, idx + ip_byte_cnt);
+void Udp_torrent_client::announce_to_next_tracker() noexcept {
 
-			QUrl url;
-			url.setHost(QHostAddress(peer_ip).toString());
-			url.setPort(peer_port);
+	for(const auto & tracker_tier : tracker_tiers_) {
 
-			if(url.isValid()) {
-				peer_urls_ret.emplace_back(std::move(url));
-			} else {
-				qDebug() << "tracker sent invalid peer url";
+		for(const auto & tracker_url : tracker_tier) {
+
+			if(!failed_trackers_.contains(tracker_url)) {
+				return announce_to(tracker_url, started_trackers_.contains(tracker_url) ? Tracker::Event::None : Tracker::Event::Started);
 			}
 		}
+	}
 
-		assert(!peer_urls_ret.isEmpty());
-		return peer_urls_ret;
-	}();
+	// every tracker failed, start over once the backoff elapses
+	constexpr auto protocol_constant = 15;
+	constexpr auto max_backoff_factor = 6;
 
-	return Announce_reply{std::move(peer_urls), interval_time, leecher_cnt, seed_cnt};
+	failed_trackers_.clear();
+	tracker_retry_timer_.start(std::chrono::seconds(protocol_constant * static_cast<std::int32_t>(std::exp2(std::min(tracker_retry_cnt_++, max_backoff_factor)))));
 }
 
-std::optional<Udp_torrent_client::Swarm_metadata> Udp_torrent_client::extract_scrape_reply(const QByteArray & reply, const std::int32_t sent_txn_id) {
+void Udp_torrent_client::stop_trackers() noexcept {
+	tracker_timeout_timer_.stop();
+	tracker_retry_timer_.stop();
 
-	if(!verify_txn_id(reply, sent_txn_id)) {
-		return {};
+	std::ranges::for_each(pending_trackers_.keys(), [this](const QUrl & tracker_url) {
+		trackers_[tracker_url]->stop();
+	});
+
+	pending_trackers_.clear();
+	failed_trackers_.clear();
+	started_trackers_.clear();
+
+	if(!active_tracker_url_.isEmpty()) {
+		announce_to(active_tracker_url_, Tracker::Event::Stopped);
+		active_tracker_url_.clear();
 	}
+}
 
-	const auto seed_cnt = [&reply] {
-		constexpr auto seed_cnt_offset = 8;
-		return util::extract_integer<std::int32_t>(reply, seed_cnt_offset);
-	}();
+void Udp_torrent_client::schedule_scrape() noexcept {
+	// every torrent scrapes on the same wall clock boundaries, so the udp endpoint batches them into a few packets
+	const auto time_since_epoch = std::chrono::system_clock::now().time_since_epoch();
+	scrape_timer_.start(std::chrono::ceil<std::chrono::milliseconds>(scrape_interval - time_since_epoch % scrape_interval));
+}
 
-	const auto completed_cnt = [&reply] {
-		constexpr auto dl_cnt_offset = 12;
-		return util::extract_integer<std::int32_t>(reply, dl_cnt_offset);
-	}();
+void Udp_torrent_client::schedule_announce(const Tracker::Announce_reply & announce_reply) noexcept {
+	assert(!active_tracker_url_.isEmpty());
 
-	const auto leecher_cnt = [&reply] {
-		constexpr auto leecher_cnt_offset = 16;
-		return util::extract_integer<std::int32_t>(reply, leecher_cnt_offset);
-	}();
+	const auto interval_time = announce_reply.interval_time > 0 ? std::chrono::seconds(announce_reply.interval_time) : Tracker::default_interval_time;
+
+	min_reannounce_gap_ = announce_reply.min_interval_time > 0 ? std::chrono::seconds(announce_reply.min_interval_time)
+									   : std::min<std::chrono::seconds>(min_announce_gap, interval_time);
+
+	// starving torrents come back as early as the tracker allows, well connected ones leave it alone for longer
+	switch(peer_demand()) {
+		case Peer_Demand::Starving: {
+			return trackers_[active_tracker_url_]->reschedule_announce(min_reannounce_gap_);
+		}
+
+		case Peer_Demand::Normal: {
+			return;
+		}
 
-	return Swarm_metadata{seed_cnt, completed_cnt, leecher_cnt};
+		case Peer_Demand::Saturated: {
+			return trackers_[active_tracker_url_]->reschedule_announce(interval_time * 3 / 2);
+		}
+
+		default: {
+			std::unreachable();
+		}
+	}
 }
 
-void Udp_torrent_client::communicate_with_tracker(Udp_socket * const socket) {
-	assert(socket->state() == Udp_socket::SocketState::ConnectedState);
-	assert(socket->hasPendingDatagrams());
+void Udp_torrent_client::on_tracker_replied(const QUrl & tracker_url, const Tracker::Announce_reply & announce_reply) noexcept {
 
-	const auto reply = socket->receiveDatagram().data();
-	const auto tracker_action = static_cast<Action_Code>(util::extract_integer<std::int32_t>(reply, 0));
+	if(paused_) {
+		return;
+	}
 
-	qDebug() << tracker_action << reply.size();
+	// udp trackers answer once per address family, only the first reply settles the announce
+	if(pending_trackers_.remove(tracker_url)) {
+		set_tracker_failure_count(tracker_url, 0);
+		started_trackers_.insert(tracker_url);
+		failed_trackers_.clear();
+		tracker_retry_cnt_ = 0;
 
-	switch(tracker_action) {
+		if(active_tracker_url_.isEmpty()) {
+			active_tracker_url_ = tracker_url;
+			trackers_[tracker_url]->scrape(info_sha1_hash_);
 
-		case Action_Code::Connect: {
-			const auto connection_id = extract_connect_reply(reply, socket->transaction_id());
+			// BEP 12: a tracker that answers moves to the front of its tier
+			for(auto & tracker_tier : tracker_tiers_) {
 
-			if(!connection_id) {
-				qDebug() << "Invalid connect reply from tracker";
-				return socket->abort();
+				if(const auto tracker_idx = tracker_tier.indexOf(tracker_url); tracker_idx > 0) {
+					tracker_tier.move(tracker_idx, 0);
+				}
 			}
+			last_announce_timer_.start();
+		} else if(tracker_url != active_tracker_url_) { // lost the race, its peers are still welcome
+			trackers_[tracker_url]->stop();
+		}
 
-			socket->set_requests(craft_announce_request(*connection_id), craft_scrape_request(*connection_id));
-			socket->send_initial_request(socket->announce_request(), Udp_socket::State::Announce);
+		if(tracker_url == active_tracker_url_) {
+			schedule_announce(announce_reply);
+		}
+	}
 
-			auto update_event_and_request = [this, socket = QPointer(socket), connection_id](const Event event) {
-				assert(connection_id);
+	if(pending_trackers_.isEmpty()) {
+		tracker_timeout_timer_.stop();
+	}
 
-				if(event_ == event) {
-					return;
-				}
+	QSet<QUrl> seen_peer_urls;
+	Tracker::Announce_reply merged_reply = announce_reply;
+	merged_reply.peer_urls.clear();
 
-				event_ = event;
+	std::ranges::for_each(announce_reply.peer_urls, [&seen_peer_urls, &merged_reply](const QUrl & peer_url) {
+		if(auto normalized_url = Connection_manager::normalized_peer_url(peer_url); normalized_url.isValid() && !seen_peer_urls.contains(normalized_url)) {
+			seen_peer_urls.insert(normalized_url);
+			merged_reply.peer_urls.push_back(std::move(normalized_url));
+		}
+	});
 
-				if(!socket) {
-					return;
-				}
+	emit announce_reply_received(merged_reply);
+}
 
-				socket->set_requests(craft_announce_request(*connection_id), craft_scrape_request(*connection_id));
+void Udp_torrent_client::on_tracker_failed(const QUrl & tracker_url) noexcept {
 
-				if(event_ != Event::Stopped) {
-					QTimer::singleShot(0, socket, [socket] {
-						socket->send_initial_request(socket->announce_request(), Udp_socket::State::Announce);
-					});
-				}
-			};
+	// e.g. the stopped announce of a pause or a tracker that already lost the race
+	if(paused_ || !pending_trackers_.remove(tracker_url)) {
+		return;
+	}
 
-			connect(tracker_, &Download_tracker::download_resumed, this, [update_event_and_request] {
-				update_event_and_request(Event::Started);
-			});
+	trackers_[tracker_url]->stop();
+	set_tracker_failure_count(tracker_url, std::min(tracker_failure_count(tracker_url) + 1, max_tracker_failure_cnt));
+	failed_trackers_.insert(tracker_url);
 
-			connect(tracker_, &Download_tracker::download_paused, this, [update_event_and_request] {
-				update_event_and_request(Event::Stopped);
-			});
+	if(tracker_url == active_tracker_url_) {
+		active_tracker_url_.clear();
+	}
 
-			connect(&peer_client_, &Peer_wire_client::download_finished, this, [update_event_and_request] {
-				update_event_and_request(Event::Completed);
-			});
+	if(pending_trackers_.isEmpty()) {
+		tracker_timeout_timer_.stop();
 
-			return;
+		if(active_tracker_url_.isEmpty()) {
+			announce_to_next_tracker();
 		}
+	}
+}
 
-		case Action_Code::Announce: {
+void Udp_torrent_client::configure_default_connections() noexcept {
 
-			if(const auto announce_reply = extract_announce_reply(reply, socket->transaction_id())) {
-				socket->start_interval_timer(std::chrono::seconds(announce_reply->interval_time));
-				emit announce_reply_received(*announce_reply);
-			} else {
-				qDebug() << "Invalid announce resposne";
-				socket->abort();
+	connect(this, &Udp_torrent_client::announce_reply_received, [&peer_client_ = peer_client_](const Tracker::Announce_reply & reply) {
+		if(!reply.peer_urls.empty()) {
+			peer_client_.connect_to_peers(reply.peer_urls);
+		}
+	});
+
+	if(auto * const dht_node = Dht_node::instance()) {
+
+		// the node reports lowercase hex, magnet links may carry uppercase
+		connect(dht_node, &Dht_node::peers_found, this, [this](const QByteArray & info_sha1_hash, const QList<QUrl> & peer_urls) {
+			if(info_sha1_hash.compare(info_sha1_hash_, Qt::CaseInsensitive) == 0) {
+				peer_client_.connect_to_peers(peer_urls);
 			}
+		});
+	}
 
-			return;
-		}
+	if(auto * const local_discovery = Local_discovery::instance()) {
 
-		case Action_Code::Scrape: {
+		connect(local_discovery, &Local_discovery::peers_found, this, [this](const QByteArray & info_sha1_hash, const QList<QUrl> & peer_urls) {
+			if(info_sha1_hash.compare(info_sha1_hash_, Qt::CaseInsensitive) == 0) {
+				peer_client_.connect_to_local_peers(peer_urls);
+			}
+		});
+	}
 
-			if(const auto scrape_reply = extract_scrape_reply(reply, socket->transaction_id())) {
-				emit swarm_metadata_received(*scrape_reply);
-			} else {
-				qDebug() << "Invalid scrape reply";
-				socket->abort();
+	tracker_timeout_timer_.setInterval(std::chrono::seconds(5));
+	tracker_retry_timer_.setSingleShot(true);
+
+	tracker_timeout_timer_.callOnTimeout(this, [this] {
+		QList<QUrl> timed_out_tracker_urls;
+
+		for(auto pending_itr = pending_trackers_.cbegin(); pending_itr != pending_trackers_.cend(); ++pending_itr) {
+
+			if(pending_itr->hasExpired(std::chrono::milliseconds(tracker_reply_timeout).count())) {
+				timed_out_tracker_urls.push_back(pending_itr.key());
 			}
+		}
 
-			return;
+		std::ranges::for_each(timed_out_tracker_urls, [this](const QUrl & tracker_url) {
+			on_tracker_failed(tracker_url);
+		});
+	});
+
+	tracker_retry_timer_.callOnTimeout(this, &Udp_torrent_client::race_trackers);
+	scrape_timer_.setSingleShot(true);
+
+	scrape_timer_.callOnTimeout(this, [this] {
+		if(!paused_ && !active_tracker_url_.isEmpty()) {
+			trackers_[active_tracker_url_]->scrape(info_sha1_hash_);
 		}
 
-		case Action_Code::Error: {
+		schedule_scrape();
+	});
 
-			if(const auto tracker_error = extract_tracker_error(reply, socket->transaction_id())) {
-				emit error_received(*tracker_error);
-			} else {
-				qDebug() << "tracker can't even send the error without errors";
-				socket->abort();
-			}
+	peer_demand_timer_.setInterval(std::chrono::seconds(30));
 
-			return;
+	// peers dropping off between announces
+	peer_demand_timer_.callOnTimeout(this, [this] {
+		const auto can_reannounce = last_announce_timer_.isValid() && last_announce_timer_.hasExpired(std::chrono::milliseconds(min_reannounce_gap_).count());
+
+		if(!paused_ && !active_tracker_url_.isEmpty() && !pending_trackers_.contains(active_tracker_url_) && can_reannounce &&
+		   peer_demand() == Peer_Demand::Starving) {
+			announce_to(active_tracker_url_, Tracker::Event::None);
 		}
+	});
 
-		default: {
-			std::unreachable();
+	connect(tracker_, &Download_tracker::download_paused, this, [this] {
+		paused_ = true;
+		stop_trackers();
+	});
+
+	connect(tracker_, &Download_tracker::download_resumed, this, [this] {
+		paused_ = false;
+
+		if(peer_discovery_started_) {
+			race_trackers();
 		}
-	}
+	});
+
+	connect(&peer_client_, &Peer_wire_client::download_finished, this, [this] {
+		if(!paused_ && !active_tracker_url_.isEmpty()) {
+			announce_to(active_tracker_url_, Tracker::Event::Completed);
+		}
+	});
+
+	connect(tracker_, &Download_tracker::request_satisfied, this, &Udp_torrent_client::deleteLater);
+	connect(&peer_client_, &Peer_wire_client::new_download_requested, this, &Udp_torrent_client::new_download_requested);
+}
+
+QByteArray Udp_torrent_client::calculate_info_sha1_hash(const bencode::Metadata & torrent_metadata) noexcept {
+	const auto raw_info_size = static_cast<qsizetype>(torrent_metadata.raw_info_dict.size());
+	return QCryptographicHash::hash(QByteArray(torrent_metadata.raw_info_dict.data(), raw_info_size), QCryptographicHash::Sha1).toHex();
 }
\ No newline at end of file
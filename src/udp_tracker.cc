@@ -0,0 +1,249 @@
+#include "udp_tracker.h"
+#include "udp_tracker_endpoint.h"
+#include "util.h"
+
+#include <QSettings>
+
+Udp_tracker::Udp_tracker(QUrl announce_url, QObject * const parent) : Tracker(std::move(announce_url), parent) {
+	assert(this->announce_url().scheme() == "udp");
+}
+
+Udp_tracker::~Udp_tracker() {
+	stop();
+}
+
+void Udp_tracker::announce(const Announce_parameters & parameters) noexcept {
+	assert(parameters.info_sha1_hash.size() == 40);
+	assert(parameters.peer_id.size() == 40);
+
+	Tracker::stop();
+
+	if(auto * const endpoint = Udp_tracker_endpoint::instance()) { // superseded, e.g. a stop right after the start
+		endpoint->cancel_requests(this);
+	}
+
+	announce_parameters_ = parameters;
+	announce_pending_ = true;
+
+	resolve_then([this] {
+		auto * const endpoint = Udp_tracker_endpoint::instance();
+
+		if(!endpoint) {
+			return fail_announce("udp tracker socket is unavailable");
+		}
+
+		pending_reply_cnt_ = addresses_.size();
+
+		std::ranges::for_each(addresses_, [this, endpoint](const QHostAddress & address) {
+			auto craft_request = [this](const std::int64_t connection_id) {
+				return craft_announce_request(connection_id);
+			};
+
+			auto on_reply = [this, ipv6_peers = address.protocol() == QAbstractSocket::IPv6Protocol](const std::optional<QByteArray> & reply) {
+				on_announce_reply(reply, ipv6_peers);
+			};
+
+			endpoint->send_request(address, static_cast<std::uint16_t>(announce_url().port()), this, std::move(craft_request), std::move(on_reply));
+		});
+	});
+}
+
+void Udp_tracker::scrape(const QByteArray & info_sha1_hash) noexcept {
+	assert(info_sha1_hash.size() == 40);
+
+	resolve_then([this, info_sha1_hash] {
+		auto * const endpoint = Udp_tracker_endpoint::instance();
+
+		if(!endpoint) {
+			return;
+		}
+
+		endpoint->cancel_requests(&scrape_context_);
+
+		// the swarm is the same from either family
+		endpoint->queue_scrape(addresses_.front(), static_cast<std::uint16_t>(announce_url().port()), &scrape_context_, info_sha1_hash,
+					     [this](const std::optional<QByteArray> & torrent_stats) {
+						     if(const auto swarm_metadata = torrent_stats ? extract_scrape_reply(*torrent_stats) : std::nullopt) {
+							     emit swarm_metadata_received(*swarm_metadata);
+						     }
+					     });
+	});
+}
+
+void Udp_tracker::stop() noexcept {
+	Tracker::stop();
+	announce_pending_ = false;
+
+	if(auto * const endpoint = Udp_tracker_endpoint::instance()) {
+		endpoint->cancel_requests(this);
+		endpoint->cancel_requests(&scrape_context_);
+	}
+}
+
+void Udp_tracker::resolve_then(std::function<void()> on_resolved) noexcept {
+
+	if(!addresses_.isEmpty()) {
+		return on_resolved();
+	}
+
+	QHostInfo::lookupHost(announce_url().host(), this, [this, on_resolved = std::move(on_resolved)](const QHostInfo & host_info) {
+		const auto ipv6_enabled = [] {
+			QSettings settings;
+			return qvariant_cast<bool>(settings.value("network/enable_ipv6", true));
+		}();
+
+		addresses_.clear();
+
+		for(const auto protocol : ipv6_enabled ? QList{QAbstractSocket::IPv4Protocol, QAbstractSocket::IPv6Protocol} : QList{QAbstractSocket::IPv4Protocol}) {
+			const auto address_itr = std::ranges::find_if(host_info.addresses(), [protocol](const QHostAddress & address) {
+				return address.protocol() == protocol;
+			});
+
+			if(address_itr != host_info.addresses().cend()) {
+				addresses_.push_back(*address_itr);
+			}
+		}
+
+		if(addresses_.isEmpty()) {
+			return fail_announce("could not resolve the tracker");
+		}
+
+		on_resolved();
+	});
+}
+
+void Udp_tracker::fail_announce(const QByteArray & error) noexcept {
+
+	if(announce_pending_) {
+		announce_pending_ = false;
+		emit announce_failed(error);
+	}
+}
+
+void Udp_tracker::on_announce_reply(const std::optional<QByteArray> & reply, const bool ipv6_peers) noexcept {
+	--pending_reply_cnt_;
+
+	if(reply && util::extract_integer<std::int32_t>(*reply, 0) == static_cast<std::int32_t>(Action_Code::Error)) {
+		constexpr auto error_offset = 8;
+		return fail_announce(reply->sliced(error_offset));
+	}
+
+	const auto announce_reply = reply ? extract_announce_reply(*reply, ipv6_peers) : std::nullopt;
+
+	if(!announce_reply) {
+
+		// the other family may still come through
+		if(pending_reply_cnt_ <= 0) {
+			addresses_.clear(); // the tracker may have moved
+			fail_announce("tracker did not answer");
+		}
+
+		return;
+	}
+
+	announce_pending_ = false;
+
+	if(announce_parameters_.event == Event::Stopped) { // nothing more to announce until the download resumes
+		return;
+	}
+
+	start_interval_timer(std::chrono::seconds(announce_reply->interval_time));
+	emit announce_reply_received(*announce_reply);
+}
+
+QByteArray Udp_tracker::craft_announce_request(const std::int64_t tracker_connection_id) const noexcept {
+	using util::conversion::convert_to_hex;
+
+	auto announce_request = convert_to_hex(tracker_connection_id);
+	constexpr auto fin_announce_request_size = 196;
+	announce_request.reserve(fin_announce_request_size);
+
+	announce_request += convert_to_hex(static_cast<std::int32_t>(Action_Code::Announce));
+
+	announce_request += [] {
+		constexpr auto txn_id_placeholder = 0; // assigned by the endpoint
+		return convert_to_hex(txn_id_placeholder);
+	}();
+
+	announce_request += announce_parameters_.info_sha1_hash;
+	announce_request += announce_parameters_.peer_id;
+
+	announce_request += convert_to_hex(announce_parameters_.dled_byte_cnt);
+	announce_request += convert_to_hex(announce_parameters_.left_byte_cnt);
+	announce_request += convert_to_hex(announce_parameters_.uled_byte_cnt);
+
+	announce_request += convert_to_hex(static_cast<std::int32_t>(announce_parameters_.event));
+
+	announce_request += [] {
+		constexpr auto default_ip_address = 0;
+		return convert_to_hex(default_ip_address);
+	}();
+
+	announce_request += [] {
+		const auto random_peer_key = random_id_range(random_generator);
+		return convert_to_hex(random_peer_key);
+	}();
+
+	announce_request += convert_to_hex(announce_parameters_.num_want);
+
+	announce_request += convert_to_hex(announce_parameters_.listen_port);
+
+	assert(announce_request.size() == fin_announce_request_size);
+	return announce_request;
+}
+
+std::optional<Tracker::Announce_reply> Udp_tracker::extract_announce_reply(const QByteArray & reply, const bool ipv6_peers) {
+	constexpr auto min_announce_reply_size = 20;
+
+	if(reply.size() < min_announce_reply_size || util::extract_integer<std::int32_t>(reply, 0) != static_cast<std::int32_t>(Action_Code::Announce)) {
+		return {};
+	}
+
+	const auto interval_time = [&reply] {
+		constexpr auto interval_offset = 8;
+		return util::extract_integer<std::int32_t>(reply, interval_offset);
+	}();
+
+	const auto leecher_cnt = [&reply] {
+		constexpr auto leechers_offset = 12;
+		return util::extract_integer<std::int32_t>(reply, leechers_offset);
+	}();
+
+	const auto seed_cnt = [&reply] {
+		constexpr auto seeders_offset = 16;
+		return util::extract_integer<std::int32_t>(reply, seeders_offset);
+	}();
+
+	auto peer_urls = [&reply, ipv6_peers] {
+		constexpr auto peers_ip_offset = 20;
+		return extract_compact_peers(reply.sliced(peers_ip_offset), ipv6_peers);
+	}();
+
+	constexpr auto min_interval_time = 0; // not part of BEP 15
+	return Announce_reply{std::move(peer_urls), interval_time, min_interval_time, leecher_cnt, seed_cnt};
+}
+
+std::optional<Tracker::Swarm_metadata> Udp_tracker::extract_scrape_reply(const QByteArray & torrent_stats) {
+	constexpr auto torrent_stats_size = 12;
+
+	if(torrent_stats.size() < torrent_stats_size) {
+		return {};
+	}
+
+	const auto seed_cnt = [&torrent_stats] {
+		constexpr auto seed_cnt_offset = 0;
+		return util::extract_integer<std::int32_t>(torrent_stats, seed_cnt_offset);
+	}();
+
+	const auto completed_cnt = [&torrent_stats] {
+		constexpr auto dl_cnt_offset = 4;
+		return util::extract_integer<std::int32_t>(torrent_stats, dl_cnt_offset);
+	}();
+
+	const auto leecher_cnt = [&torrent_stats] {
+		constexpr auto leecher_cnt_offset = 8;
+		return util::extract_integer<std::int32_t>(torrent_stats, leecher_cnt_offset);
+	}();
+
+	return Swarm_metadata{seed_cnt, completed_cnt, leecher_cnt};
+}
\ No newline at end of file
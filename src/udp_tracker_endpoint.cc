@@ -0,0 +1,360 @@
+#include "udp_tracker_endpoint.h"
+#include "util.h"
+
+#include <QNetworkDatagram>
+#include <QRandomGenerator>
+#include <QtEndian>
+#include <QSet>
+
+Udp_tracker_endpoint::Udp_tracker_endpoint(QObject * const parent) : QObject(parent) {
+
+	// dual-stack, so ipv4 trackers are reached through the same socket
+	if(!udp_socket_.bind(QHostAddress::Any)) {
+		qDebug() << "could not bind the udp tracker socket" << udp_socket_.errorString();
+		return;
+	}
+
+	instance_ = this;
+
+	connect(&udp_socket_, &QUdpSocket::readyRead, this, &Udp_tracker_endpoint::on_ready_read);
+	tick_timer_.setInterval(std::chrono::seconds(1));
+	tick_timer_.callOnTimeout(this, &Udp_tracker_endpoint::on_tick);
+	scrape_batch_timer_.setSingleShot(true);
+	scrape_batch_timer_.callOnTimeout(this, &Udp_tracker_endpoint::send_scrapes);
+}
+
+QByteArray Udp_tracker_endpoint::craft_connect_request() noexcept {
+	using util::conversion::convert_to_hex;
+
+	const static auto connect_request = [] {
+		constexpr auto protocol_constant = 0x41727101980;
+		constexpr auto connect_action = 0;
+		constexpr auto txn_id_placeholder = 0;
+		return QByteArray::fromHex(convert_to_hex(protocol_constant) + convert_to_hex(connect_action) + convert_to_hex(txn_id_placeholder));
+	}();
+
+	return connect_request;
+}
+
+std::int32_t Udp_tracker_endpoint::unique_txn_id() const noexcept {
+	std::int32_t txn_id = 0;
+
+	do {
+		txn_id = static_cast<std::int32_t>(QRandomGenerator::global()->generate());
+	} while(requests_.contains(txn_id));
+
+	return txn_id;
+}
+
+std::optional<Udp_tracker_endpoint::Connection> Udp_tracker_endpoint::cached_connection(const Tracker_endpoint & tracker_endpoint) const noexcept {
+	const auto connection_itr = connections_.constFind(tracker_endpoint);
+
+	if(connection_itr == connections_.cend() || std::chrono::steady_clock::now() - connection_itr->connected_time >= connection_id_ttl) {
+		return {};
+	}
+
+	return *connection_itr;
+}
+
+void Udp_tracker_endpoint::send_request(const QHostAddress & address, const std::uint16_t port, const QObject * const context, Request_crafter craft_request,
+						    Reply_handler on_reply) noexcept {
+	assert(!address.isNull());
+	assert(context);
+	assert(craft_request && on_reply);
+
+	Request request;
+	request.tracker_endpoint = {address, port};
+	request.context = context;
+	request.craft_request = std::move(craft_request);
+	request.on_reply = std::move(on_reply);
+
+	if(const auto connection = cached_connection(request.tracker_endpoint)) {
+		send_with_connection(std::move(request), *connection);
+	} else {
+		connect_then_send(std::move(request));
+	}
+}
+
+void Udp_tracker_endpoint::connect_then_send(Request request) noexcept {
+	const auto tracker_endpoint = request.tracker_endpoint;
+	const auto connect_in_flight = requests_awaiting_connection_.contains(tracker_endpoint);
+
+	// every request queued behind the same connect shares its connection id
+	requests_awaiting_connection_[tracker_endpoint].push_back(std::move(request));
+
+	if(connect_in_flight) {
+		return;
+	}
+
+	connections_.remove(tracker_endpoint);
+
+	Request connect_request;
+	connect_request.tracker_endpoint = tracker_endpoint;
+	connect_request.packet = craft_connect_request();
+	connect_request.is_connect = true;
+
+	transmit(unique_txn_id(), std::move(connect_request));
+}
+
+void Udp_tracker_endpoint::send_with_connection(Request request, const Connection & connection) noexcept {
+	request.packet = QByteArray::fromHex(request.craft_request(connection.id));
+	request.connected_time = connection.connected_time;
+
+	transmit(unique_txn_id(), std::move(request));
+}
+
+void Udp_tracker_endpoint::cancel_requests(const QObject * const context) noexcept {
+
+	auto is_cancelled = [context](const Request & request) {
+		return !request.is_connect && (!request.context || request.context == context);
+	};
+
+	for(auto request_itr = requests_.begin(); request_itr != requests_.end();) {
+
+		if(is_cancelled(*request_itr)) {
+			request_itr = requests_.erase(request_itr);
+		} else {
+			++request_itr;
+		}
+	}
+
+	// the connect itself stays in flight, its id is cached for whoever asks next
+	for(auto & awaiting_requests : requests_awaiting_connection_) {
+		awaiting_requests.removeIf(is_cancelled);
+	}
+
+	for(auto & queued_scrapes : queued_scrapes_) {
+		queued_scrapes.removeIf([context](const Queued_scrape & queued_scrape) {
+			return !queued_scrape.context || queued_scrape.context == context;
+		});
+	}
+}
+
+void Udp_tracker_endpoint::queue_scrape(const QHostAddress & address, const std::uint16_t port, const QObject * const context, const QByteArray & info_sha1_hash,
+						    Reply_handler on_reply) noexcept {
+	assert(!address.isNull());
+	assert(context);
+	assert(info_sha1_hash.size() == 40);
+	assert(on_reply);
+
+	queued_scrapes_[{address, port}].push_back({context, info_sha1_hash, std::move(on_reply)});
+
+	if(!scrape_batch_timer_.isActive()) {
+		scrape_batch_timer_.start(scrape_batch_delay);
+	}
+}
+
+void Udp_tracker_endpoint::send_scrapes() noexcept {
+	using util::conversion::convert_to_hex;
+
+	for(auto queued_scrapes_itr = queued_scrapes_.cbegin(); queued_scrapes_itr != queued_scrapes_.cend(); ++queued_scrapes_itr) {
+		QHash<QByteArray, QList<Queued_scrape>> scrapes_by_hash; // torrents may share a hash, e.g. a magnet handing over
+
+		std::ranges::for_each(queued_scrapes_itr.value(), [&scrapes_by_hash](const Queued_scrape & queued_scrape) {
+			if(queued_scrape.context) {
+				scrapes_by_hash[queued_scrape.info_sha1_hash].push_back(queued_scrape);
+			}
+		});
+
+		const auto info_sha1_hashes = scrapes_by_hash.keys();
+
+		for(qsizetype batch_begin_idx = 0; batch_begin_idx < info_sha1_hashes.size(); batch_begin_idx += max_scrape_hash_cnt) {
+			const auto batch_hashes = info_sha1_hashes.mid(batch_begin_idx, max_scrape_hash_cnt);
+
+			auto craft_request = [batch_hashes](const std::int64_t connection_id) {
+				constexpr auto scrape_action = 2;
+				constexpr auto txn_id_placeholder = 0; // assigned in transmit
+
+				auto scrape_request = convert_to_hex(connection_id) + convert_to_hex(scrape_action) + convert_to_hex(txn_id_placeholder);
+
+				std::ranges::for_each(batch_hashes, [&scrape_request](const QByteArray & info_sha1_hash) {
+					scrape_request += info_sha1_hash;
+				});
+
+				return scrape_request;
+			};
+
+			auto on_reply = [batch_hashes, scrapes_by_hash](const std::optional<QByteArray> & reply) {
+				constexpr auto scrape_action = 2;
+				constexpr auto header_size = 8;
+				constexpr auto torrent_stats_size = 12;
+
+				// the tracker answers in the order the hashes were asked
+				const auto is_valid_reply = reply && util::extract_integer<std::int32_t>(*reply, 0) == scrape_action &&
+							    reply->size() >= header_size + torrent_stats_size * batch_hashes.size();
+
+				for(qsizetype hash_idx = 0; hash_idx < batch_hashes.size(); ++hash_idx) {
+					const auto torrent_stats = is_valid_reply ? reply->sliced(header_size + torrent_stats_size * hash_idx, torrent_stats_size) : std::optional<QByteArray>{};
+
+					std::ranges::for_each(scrapes_by_hash[batch_hashes[hash_idx]], [&torrent_stats](const Queued_scrape & queued_scrape) {
+						if(queued_scrape.context) {
+							queued_scrape.on_reply(torrent_stats);
+						}
+					});
+				}
+			};
+
+			const auto & [address, port] = queued_scrapes_itr.key();
+			send_request(address, port, this, std::move(craft_request), std::move(on_reply));
+		}
+	}
+
+	queued_scrapes_.clear();
+}
+
+void Udp_tracker_endpoint::transmit(const std::int32_t txn_id, Request request) noexcept {
+	constexpr auto txn_id_offset = 12;
+	assert(request.packet.size() >= txn_id_offset + static_cast<qsizetype>(sizeof(txn_id)));
+
+	qToBigEndian(txn_id, request.packet.data() + txn_id_offset);
+	udp_socket_.writeDatagram(request.packet, request.tracker_endpoint.first, request.tracker_endpoint.second);
+
+	requests_[txn_id] = std::move(request);
+	schedule_timeout(txn_id);
+}
+
+void Udp_tracker_endpoint::schedule_timeout(const std::int32_t txn_id) noexcept {
+	constexpr auto protocol_constant = 15;
+
+	auto & request = requests_[txn_id];
+	request.deadline_tick = current_tick_ + protocol_constant * (std::int64_t{1} << request.timeout_factor);
+	timer_wheel_[static_cast<std::size_t>(request.deadline_tick % timer_wheel_slot_cnt)].push_back(txn_id);
+
+	if(!tick_timer_.isActive()) {
+		tick_timer_.start();
+	}
+}
+
+void Udp_tracker_endpoint::on_ready_read() noexcept {
+
+	while(udp_socket_.hasPendingDatagrams()) {
+		const auto datagram = udp_socket_.receiveDatagram();
+		on_reply_received(datagram.data(), datagram.senderAddress(), static_cast<std::uint16_t>(datagram.senderPort()));
+	}
+}
+
+void Udp_tracker_endpoint::on_reply_received(const QByteArray & reply, const QHostAddress & address, const std::uint16_t port) noexcept {
+	constexpr auto min_reply_size = 8;
+
+	if(reply.size() < min_reply_size) {
+		return;
+	}
+
+	const auto txn_id = util::extract_integer<std::int32_t>(reply, 4);
+	const auto request_itr = requests_.find(txn_id);
+
+	// answered already, cancelled or not ours
+	if(request_itr == requests_.end() || request_itr->tracker_endpoint.second != port ||
+	   !request_itr->tracker_endpoint.first.isEqual(address, QHostAddress::ConvertV4MappedToIPv4)) {
+		return;
+	}
+
+	auto request = std::move(*request_itr);
+	requests_.erase(request_itr);
+
+	if(request.is_connect) {
+		on_connect_finished(request.tracker_endpoint, reply);
+	} else if(request.context) {
+		request.on_reply(reply);
+	}
+}
+
+void Udp_tracker_endpoint::on_connect_finished(const Tracker_endpoint & tracker_endpoint, const std::optional<QByteArray> & reply) noexcept {
+	constexpr auto connect_action = 0;
+	constexpr auto error_action = 3;
+	constexpr auto connect_reply_size = 16;
+
+	auto awaiting_requests = requests_awaiting_connection_.take(tracker_endpoint);
+
+	if(reply && reply->size() >= connect_reply_size && util::extract_integer<std::int32_t>(*reply, 0) == connect_action) {
+		const Connection connection{util::extract_integer<std::int64_t>(*reply, 8), std::chrono::steady_clock::now()};
+		connections_[tracker_endpoint] = connection;
+
+		std::ranges::for_each(awaiting_requests, [this, &connection](Request & request) {
+			if(request.context) {
+				send_with_connection(std::move(request), connection);
+			}
+		});
+
+		return;
+	}
+
+	// the tracker's error (or nothing when it never answered) goes to everyone that waited on it
+	const auto is_error = reply && util::extract_integer<std::int32_t>(*reply, 0) == error_action;
+
+	if(reply && !is_error) {
+		qDebug() << "Invalid connect reply from tracker" << tracker_endpoint.first;
+	}
+
+	std::ranges::for_each(awaiting_requests, [&reply, is_error](const Request & request) {
+		if(request.context) {
+			request.on_reply(is_error ? reply : std::nullopt);
+		}
+	});
+}
+
+void Udp_tracker_endpoint::on_tick() noexcept {
+	++current_tick_;
+
+	auto & timer_wheel_slot = timer_wheel_[static_cast<std::size_t>(current_tick_ % timer_wheel_slot_cnt)];
+	const auto slot_txn_ids = std::exchange(timer_wheel_slot, {});
+
+	// entries of answered or rescheduled requests are dropped lazily here
+	for(const auto txn_id : QSet<std::int32_t>(slot_txn_ids.cbegin(), slot_txn_ids.cend())) {
+		const auto request_itr = requests_.find(txn_id);
+
+		if(request_itr == requests_.end() || request_itr->deadline_tick < current_tick_) {
+			continue;
+		}
+
+		if(request_itr->deadline_tick > current_tick_) { // a later lap of the wheel
+			timer_wheel_slot.push_back(txn_id);
+			continue;
+		}
+
+		auto request = std::move(*request_itr);
+		requests_.erase(request_itr);
+
+		if(!request.is_connect && !request.context) {
+			continue;
+		}
+
+		if(++request.timeout_factor > max_timeout_factor) {
+
+			if(request.is_connect) {
+				on_connect_finished(request.tracker_endpoint, {});
+			} else {
+				request.on_reply({});
+			}
+
+			continue;
+		}
+
+		// the connection id went stale while waiting, the request queues up for a fresh one
+		if(!request.is_connect && std::chrono::steady_clock::now() - request.connected_time >= connection_id_ttl) {
+
+			if(const auto connection = cached_connection(request.tracker_endpoint)) {
+				send_with_connection(std::move(request), *connection);
+			} else {
+				connect_then_send(std::move(request));
+			}
+
+			continue;
+		}
+
+		transmit(txn_id, std::move(request));
+	}
+
+	for(auto connection_itr = connections_.begin(); connection_itr != connections_.end();) {
+
+		if(std::chrono::steady_clock::now() - connection_itr->connected_time >= connection_id_ttl) {
+			connection_itr = connections_.erase(connection_itr);
+		} else {
+			++connection_itr;
+		}
+	}
+
+	if(requests_.isEmpty()) {
+		tick_timer_.stop();
+	}
+}
\ No newline at end of file
@@ -0,0 +1,83 @@
+#include "utp_multiplexer.h"
+#include "utp_socket.h"
+
+#include <QNetworkDatagram>
+#include <random>
+
+Utp_multiplexer::Utp_multiplexer(const std::uint16_t port, QObject * const parent) : QObject(parent) {
+
+	if(!udp_socket_.bind(QHostAddress::Any, port)) {
+		qDebug() << "could not bind the uTP socket on port" << port << udp_socket_.errorString();
+	}
+
+	connect(&udp_socket_, &QUdpSocket::readyRead, this, &Utp_multiplexer::on_ready_read);
+}
+
+QByteArray Utp_multiplexer::connection_key(const QHostAddress & peer_address, const std::uint16_t peer_port, const std::uint16_t connection_id) noexcept {
+	return peer_address.toString().toLatin1() + ':' + QByteArray::number(peer_port) + '/' + QByteArray::number(connection_id);
+}
+
+std::uint16_t Utp_multiplexer::unused_connection_id(const QHostAddress & peer_address, const std::uint16_t peer_port) const noexcept {
+	static std::mt19937 random_generator(std::random_device{}());
+	std::uniform_int_distribution<std::uint16_t> connection_id_range;
+
+	for(;;) {
+		// the peer sends with our id + 1, which has to be free for it too
+		if(const auto connection_id = connection_id_range(random_generator);
+		   !sockets_.contains(connection_key(peer_address, peer_port, connection_id)) &&
+		   !sockets_.contains(connection_key(peer_address, peer_port, static_cast<std::uint16_t>(connection_id + 1)))) {
+			return connection_id;
+		}
+	}
+}
+
+void Utp_multiplexer::register_socket(Utp_socket * const socket) noexcept {
+	assert(socket);
+	sockets_[connection_key(socket->peer_host_address(), socket->peer_host_port(), socket->receive_connection_id())] = socket;
+}
+
+void Utp_multiplexer::unregister_socket(const Utp_socket * const socket) noexcept {
+	assert(socket);
+
+	if(const auto socket_itr = sockets_.constFind(connection_key(socket->peer_host_address(), socket->peer_host_port(), socket->receive_connection_id()));
+	   socket_itr != sockets_.cend() && *socket_itr == socket) {
+		sockets_.erase(socket_itr);
+	}
+}
+
+void Utp_multiplexer::send_datagram(const QByteArray & datagram, const QHostAddress & peer_address, const std::uint16_t peer_port) noexcept {
+	udp_socket_.writeDatagram(datagram, peer_address, peer_port);
+}
+
+void Utp_multiplexer::on_ready_read() noexcept {
+
+	while(udp_socket_.hasPendingDatagrams()) {
+		const auto datagram = udp_socket_.receiveDatagram();
+		const auto data = datagram.data();
+		const auto peer_port = static_cast<std::uint16_t>(datagram.senderPort());
+		auto peer_address = datagram.senderAddress();
+
+		{
+			bool is_ipv4_mapped = false;
+
+			if(const auto ipv4_address = peer_address.toIPv4Address(&is_ipv4_mapped); is_ipv4_mapped) {
+				peer_address = QHostAddress(ipv4_address);
+			}
+		}
+
+		const auto header = Utp_socket::parse_header(data);
+
+		if(!header) {
+			continue;
+		}
+
+		// a SYN carries the id the peer receives on; the socket answering it receives on id + 1
+		const auto recv_connection_id = header->type == Utp_socket::Packet_Type::Syn ? static_cast<std::uint16_t>(header->connection_id + 1) : header->connection_id;
+
+		if(const auto socket_itr = sockets_.constFind(connection_key(peer_address, peer_port, recv_connection_id)); socket_itr != sockets_.cend()) {
+			(*socket_itr)->on_packet_received(*header, data.sliced(header->payload_offset));
+		} else if(header->type == Utp_socket::Packet_Type::Syn) {
+			emit incoming_connection(new Utp_socket(peer_address, peer_port, *header, this, nullptr));
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,568 @@
+#include "utp_socket.h"
+#include "utp_multiplexer.h"
+
+#include <QtEndian>
+#include <random>
+
+std::uint16_t Utp_socket::random_seq_nr() noexcept {
+	static std::mt19937 random_generator(std::random_device{}());
+	static std::uniform_int_distribution<std::uint16_t> seq_nr_range;
+	return seq_nr_range(random_generator);
+}
+
+QUrl Utp_socket::make_peer_url(const QHostAddress & peer_address, const std::uint16_t peer_port) noexcept {
+	QUrl peer_url;
+	peer_url.setHost(peer_address.toString());
+	peer_url.setPort(peer_port);
+	return peer_url;
+}
+
+Utp_socket::Utp_socket(QUrl peer_url, Utp_multiplexer * const multiplexer, QObject * const parent)
+    : Tcp_socket(std::move(peer_url), parent, true, Unconnected_tag{}),
+	multiplexer_(multiplexer),
+	peer_host_address_(this->peer_url().host()),
+	peer_host_port_(static_cast<std::uint16_t>(this->peer_url().port())) {
+	assert(multiplexer);
+
+	recv_connection_id_ = multiplexer->unused_connection_id(peer_host_address_, peer_host_port_);
+	send_connection_id_ = static_cast<std::uint16_t>(recv_connection_id_ + 1);
+
+	configure_utp_connections();
+	multiplexer->register_socket(this);
+	setSocketState(SocketState::ConnectingState);
+
+	outgoing_packets_.insert(seq_nr_, {{}, Packet_Type::Syn});
+	transmit(seq_nr_++);
+}
+
+Utp_socket::Utp_socket(const QHostAddress & peer_address, const std::uint16_t peer_port, const Header & syn_header, Utp_multiplexer * const multiplexer,
+			     QObject * const parent)
+    : Tcp_socket(make_peer_url(peer_address, peer_port), parent, false, Unconnected_tag{}),
+	multiplexer_(multiplexer),
+	peer_host_address_(peer_address),
+	peer_wnd_size_(syn_header.wnd_size),
+	reply_micro_(timestamp_us() - syn_header.timestamp_us),
+	peer_host_port_(peer_port),
+	recv_connection_id_(static_cast<std::uint16_t>(syn_header.connection_id + 1)),
+	send_connection_id_(syn_header.connection_id),
+	seq_nr_(random_seq_nr()),
+	ack_nr_(syn_header.seq_nr) {
+	assert(multiplexer);
+	assert(syn_header.type == Packet_Type::Syn);
+
+	configure_utp_connections();
+	multiplexer->register_socket(this);
+	setSocketState(SocketState::ConnectedState);
+	send(Packet_Type::State, seq_nr_);
+	emit connected();
+}
+
+Utp_socket::~Utp_socket() {
+
+	if(state() != SocketState::UnconnectedState) {
+		send(Packet_Type::Reset, seq_nr_);
+	}
+
+	if(multiplexer_) {
+		multiplexer_->unregister_socket(this);
+	}
+}
+
+void Utp_socket::configure_utp_connections() noexcept {
+	setPeerAddress(peer_host_address_);
+	setPeerPort(peer_host_port_);
+	setOpenMode(QIODevice::ReadWrite | QIODevice::Unbuffered);
+
+	retransmit_timer_.setSingleShot(true);
+	retransmit_timer_.callOnTimeout(this, &Utp_socket::on_retransmit_timeout);
+
+	// LEDBAT base delay: the lowest delay over the last two minutes, so that route changes are eventually forgotten
+	base_delays_us_.push_back(std::numeric_limits<std::uint32_t>::max());
+
+	base_delay_timer_.callOnTimeout(this, [&base_delays_us_ = base_delays_us_] {
+		constexpr auto base_delay_history_size = 2;
+		base_delays_us_.push_back(std::numeric_limits<std::uint32_t>::max());
+
+		if(base_delays_us_.size() > base_delay_history_size) {
+			base_delays_us_.removeFirst();
+		}
+	});
+
+	base_delay_timer_.start(std::chrono::minutes(1));
+}
+
+std::uint32_t Utp_socket::timestamp_us() noexcept {
+	using namespace std::chrono;
+	return static_cast<std::uint32_t>(duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count());
+}
+
+std::optional<Utp_socket::Header> Utp_socket::parse_header(const QByteArray & datagram) noexcept {
+
+	if(datagram.size() < header_size) {
+		return {};
+	}
+
+	const auto * const data = reinterpret_cast<const uchar *>(datagram.constData());
+	const auto packet_type = static_cast<std::uint8_t>(data[0] >> 4);
+
+	if((data[0] & 0xf) != utp_version || packet_type > static_cast<std::uint8_t>(Packet_Type::Syn)) {
+		return {};
+	}
+
+	Header header;
+	header.type = static_cast<Packet_Type>(packet_type);
+	header.connection_id = qFromBigEndian<std::uint16_t>(data + 2);
+	header.timestamp_us = qFromBigEndian<std::uint32_t>(data + 4);
+	header.timestamp_diff_us = qFromBigEndian<std::uint32_t>(data + 8);
+	header.wnd_size = qFromBigEndian<std::uint32_t>(data + 12);
+	header.seq_nr = qFromBigEndian<std::uint16_t>(data + 16);
+	header.ack_nr = qFromBigEndian<std::uint16_t>(data + 18);
+	header.payload_offset = header_size;
+
+	// each extension starts with the type of the one after it and its own length. only selective acks are understood
+	for(auto extension_type = data[1]; extension_type;) {
+
+		if(header.payload_offset + 2 > datagram.size()) {
+			return {};
+		}
+
+		const auto next_extension_type = data[header.payload_offset];
+		const auto extension_size = static_cast<qsizetype>(data[header.payload_offset + 1]);
+		const auto extension_offset = header.payload_offset + 2;
+
+		if(extension_offset + extension_size > datagram.size()) {
+			return {};
+		}
+
+		if(extension_type == selective_ack_extension && extension_size && extension_size % 4 == 0) {
+			header.selective_acks = datagram.sliced(extension_offset, extension_size);
+		}
+
+		header.payload_offset = extension_offset + extension_size;
+		extension_type = next_extension_type;
+	}
+
+	return header;
+}
+
+qint64 Utp_socket::bytesAvailable() const {
+	return receive_buffer_.size() + QIODevice::bytesAvailable();
+}
+
+qint64 Utp_socket::readData(char * const data, const qint64 max_size) {
+	const auto read_byte_cnt = std::min<qint64>(max_size, receive_buffer_.size());
+	const auto was_window_closed = receive_window() < max_payload_size;
+
+	std::copy_n(receive_buffer_.constData(), read_byte_cnt, data);
+	receive_buffer_.remove(0, read_byte_cnt);
+
+	// the peer stopped sending at our closed window, tell it that there is room again
+	if(was_window_closed && receive_window() >= max_payload_size && is_established()) {
+		send(Packet_Type::State, seq_nr_);
+	}
+
+	return read_byte_cnt;
+}
+
+qint64 Utp_socket::writeData(const char * const data, const qint64 size) {
+
+	if(state() != SocketState::ConnectedState) {
+		return -1;
+	}
+
+	send_buffer_.append(data, size);
+	flush_send_buffer();
+	return size;
+}
+
+void Utp_socket::disconnectFromHost() {
+
+	if(state() != SocketState::ConnectedState) {
+		return close_connection();
+	}
+
+	// like QAbstractSocket: the written data still goes out, then the FIN, and the socket closes once both are acked
+	setSocketState(SocketState::ClosingState);
+	flush_send_buffer();
+}
+
+void Utp_socket::send(const Packet_Type type, const std::uint16_t seq_nr, const QByteArray & payload) noexcept {
+
+	if(!multiplexer_) {
+		return;
+	}
+
+	QByteArray datagram(header_size, '\x00');
+	auto * const data = reinterpret_cast<uchar *>(datagram.data());
+	const auto selective_acks = craft_selective_acks();
+
+	data[0] = static_cast<uchar>(static_cast<std::uint8_t>(type) << 4 | utp_version);
+	data[1] = selective_acks.isEmpty() ? 0 : selective_ack_extension;
+	qToBigEndian(type == Packet_Type::Syn ? recv_connection_id_ : send_connection_id_, data + 2);
+	qToBigEndian(timestamp_us(), data + 4);
+	qToBigEndian(reply_micro_, data + 8);
+	qToBigEndian(static_cast<std::uint32_t>(receive_window()), data + 12);
+	qToBigEndian(seq_nr, data + 16);
+	qToBigEndian(ack_nr_, data + 18);
+
+	if(!selective_acks.isEmpty()) {
+		datagram += '\x00'; // last extension
+		datagram += static_cast<char>(selective_acks.size());
+		datagram += selective_acks;
+	}
+
+	multiplexer_->send_datagram(datagram + payload, peer_host_address_, peer_host_port_);
+}
+
+QByteArray Utp_socket::craft_selective_acks() const noexcept {
+
+	if(reordered_payloads_.isEmpty()) {
+		return {};
+	}
+
+	QByteArray selective_acks;
+
+	for(auto payload_itr = reordered_payloads_.cbegin(); payload_itr != reordered_payloads_.cend(); ++payload_itr) {
+		const auto bit_idx = static_cast<qsizetype>(static_cast<std::uint16_t>(payload_itr.key() - ack_nr_ - 2));
+
+		if(bit_idx >= max_selective_ack_size * 8) {
+			continue;
+		}
+
+		if(const auto byte_idx = bit_idx / 8; byte_idx >= selective_acks.size()) {
+			constexpr auto mask_granularity = 4;
+			selective_acks.append((byte_idx / mask_granularity + 1) * mask_granularity - selective_acks.size(), '\x00');
+		}
+
+		selective_acks[bit_idx / 8] = static_cast<char>(selective_acks[bit_idx / 8] | 1 << bit_idx % 8);
+	}
+
+	return selective_acks;
+}
+
+void Utp_socket::transmit(const std::uint16_t seq_nr) noexcept {
+	assert(outgoing_packets_.contains(seq_nr));
+
+	auto & packet = outgoing_packets_[seq_nr];
+	packet.sent_time = std::chrono::steady_clock::now();
+	++packet.transmission_cnt;
+	send(packet.type, seq_nr, packet.payload);
+
+	if(!retransmit_timer_.isActive()) {
+		retransmit_timer_.start(rto_);
+	}
+}
+
+void Utp_socket::flush_send_buffer() noexcept {
+
+	while(!send_buffer_.isEmpty() && is_established()) {
+		const auto payload_size = std::min<std::int64_t>(max_payload_size, send_buffer_.size());
+
+		// with nothing in flight one packet always goes out so that a closed peer window gets probed
+		if(in_flight_byte_cnt_ && in_flight_byte_cnt_ + payload_size > send_window()) {
+			break;
+		}
+
+		outgoing_packets_.insert(seq_nr_, {send_buffer_.first(payload_size), Packet_Type::Data});
+		send_buffer_.remove(0, payload_size);
+		in_flight_byte_cnt_ += payload_size;
+		transmit(seq_nr_++);
+	}
+
+	// retransmitted like data, a lost FIN would otherwise leave the peer waiting for the rest of the stream
+	if(state() == SocketState::ClosingState && send_buffer_.isEmpty() && !fin_queued_) {
+		fin_queued_ = true;
+		outgoing_packets_.insert(seq_nr_, {{}, Packet_Type::Fin});
+		transmit(seq_nr_++);
+	}
+}
+
+void Utp_socket::on_packet_received(const Header & header, const QByteArray & payload) noexcept {
+	reply_micro_ = timestamp_us() - header.timestamp_us;
+	peer_wnd_size_ = header.wnd_size;
+
+	switch(header.type) {
+
+		case Packet_Type::Reset: {
+			return fail(SocketError::RemoteHostClosedError, "uTP connection reset by peer");
+		}
+
+		case Packet_Type::Syn: {
+
+			// our reply got lost
+			if(state() == SocketState::ConnectedState) {
+				send(Packet_Type::State, seq_nr_);
+			}
+
+			break;
+		}
+
+		case Packet_Type::State: {
+			on_ack_received(header);
+			break;
+		}
+
+		case Packet_Type::Data:
+			[[fallthrough]];
+		case Packet_Type::Fin: {
+			on_ack_received(header);
+
+			if(is_established()) {
+				on_data_received(header, payload);
+			}
+
+			break;
+		}
+	}
+}
+
+void Utp_socket::on_ack_received(const Header & header) noexcept {
+
+	if(state() == SocketState::ConnectingState) {
+		const auto syn_seq_nr = static_cast<std::uint16_t>(seq_nr_ - 1);
+
+		if(header.type != Packet_Type::State || header.ack_nr != syn_seq_nr) {
+			return;
+		}
+
+		// the first data packet of the peer carries the seq_nr of its reply
+		ack_nr_ = static_cast<std::uint16_t>(header.seq_nr - 1);
+		last_ack_nr_ = header.ack_nr;
+		outgoing_packets_.remove(syn_seq_nr);
+		retransmit_timer_.stop();
+		setSocketState(SocketState::ConnectedState);
+		emit connected();
+		return flush_send_buffer();
+	}
+
+	const auto now = std::chrono::steady_clock::now();
+	std::optional<std::chrono::steady_clock::time_point> rtt_sample_sent_time;
+	std::int64_t acked_byte_cnt = 0;
+	bool acked_any = false;
+
+	for(auto packet_itr = outgoing_packets_.begin(); packet_itr != outgoing_packets_.end();) {
+
+		if(is_seq_less(header.ack_nr, packet_itr.key())) {
+			++packet_itr;
+			continue;
+		}
+
+		// karn: retransmitted packets don't produce rtt samples
+		if(const auto & packet = *packet_itr; packet.transmission_cnt == 1 && (!rtt_sample_sent_time || packet.sent_time > *rtt_sample_sent_time)) {
+			rtt_sample_sent_time = packet.sent_time;
+		}
+
+		acked_byte_cnt += packet_itr->payload.size();
+		acked_any = true;
+		packet_itr = outgoing_packets_.erase(packet_itr);
+	}
+
+	if(const auto selectively_acked_byte_cnt = on_selective_acks_received(header); selectively_acked_byte_cnt >= 0) {
+		acked_byte_cnt += selectively_acked_byte_cnt;
+		acked_any = true;
+	}
+
+	if(acked_any) {
+		in_flight_byte_cnt_ -= acked_byte_cnt;
+		duplicate_ack_cnt_ = 0;
+		assert(in_flight_byte_cnt_ >= 0);
+
+		if(rtt_sample_sent_time) {
+			using namespace std::chrono;
+
+			const auto rtt_sample = duration_cast<microseconds>(now - *rtt_sample_sent_time);
+
+			if(rtt_ == microseconds::zero()) {
+				rtt_ = rtt_sample;
+				rtt_var_ = rtt_sample / 2;
+			} else {
+				rtt_var_ += (abs(rtt_ - rtt_sample) - rtt_var_) / 4;
+				rtt_ += (rtt_sample - rtt_) / 8;
+			}
+
+			constexpr milliseconds min_rto(500);
+			rto_ = std::max(min_rto, duration_cast<milliseconds>(rtt_ + 4 * rtt_var_));
+		}
+
+		if(acked_byte_cnt) {
+			update_congestion_window(acked_byte_cnt, header.timestamp_diff_us);
+		}
+
+		outgoing_packets_.isEmpty() ? retransmit_timer_.stop() : retransmit_timer_.start(rto_);
+	} else if(header.type == Packet_Type::State && header.ack_nr == last_ack_nr_ && !outgoing_packets_.isEmpty()) {
+
+		// fast retransmit of the packet the peer keeps asking for
+		if(const auto lost_seq_nr = static_cast<std::uint16_t>(header.ack_nr + 1); ++duplicate_ack_cnt_ == duplicate_ack_threshold && outgoing_packets_.contains(lost_seq_nr)) {
+			cwnd_ = std::max(static_cast<double>(max_payload_size), cwnd_ / 2);
+			transmit(lost_seq_nr);
+		}
+	}
+
+	last_ack_nr_ = header.ack_nr;
+	flush_send_buffer();
+
+	if(fin_queued_ && outgoing_packets_.isEmpty()) {
+		close_connection();
+	}
+}
+
+// returns the payload bytes of the packets it acked, -1 when it acked none
+std::int64_t Utp_socket::on_selective_acks_received(const Header & header) noexcept {
+	std::int64_t acked_byte_cnt = -1;
+	qsizetype received_past_hole_cnt = 0;
+
+	for(qsizetype bit_idx = 0; bit_idx < header.selective_acks.size() * 8; ++bit_idx) {
+
+		if(!(static_cast<std::uint8_t>(header.selective_acks[bit_idx / 8]) >> bit_idx % 8 & 1)) {
+			continue;
+		}
+
+		++received_past_hole_cnt;
+
+		if(const auto packet_itr = outgoing_packets_.find(static_cast<std::uint16_t>(header.ack_nr + 2 + bit_idx)); packet_itr != outgoing_packets_.end()) {
+			acked_byte_cnt = std::max<std::int64_t>(acked_byte_cnt, 0) + packet_itr->payload.size();
+			outgoing_packets_.erase(packet_itr);
+		}
+	}
+
+	// enough later packets made it for ack_nr + 1 to count as lost, it is resent once instead of waiting for the timeout
+	if(const auto lost_packet_itr = outgoing_packets_.find(static_cast<std::uint16_t>(header.ack_nr + 1));
+	   received_past_hole_cnt >= duplicate_ack_threshold && lost_packet_itr != outgoing_packets_.end() && lost_packet_itr->transmission_cnt == 1) {
+		cwnd_ = std::max(static_cast<double>(max_payload_size), cwnd_ / 2);
+		transmit(lost_packet_itr.key());
+	}
+
+	return acked_byte_cnt;
+}
+
+void Utp_socket::update_congestion_window(const std::int64_t acked_byte_cnt, const std::uint32_t peer_delay_us) noexcept {
+	assert(acked_byte_cnt > 0);
+	assert(!base_delays_us_.isEmpty());
+
+	// the peer's timestamp_diff_us is the one-way delay of our packets plus a constant clock offset that cancels out below
+	if(!peer_delay_us) {
+		return;
+	}
+
+	base_delays_us_.back() = std::min(base_delays_us_.back(), peer_delay_us);
+
+	const auto base_delay_us = *std::ranges::min_element(base_delays_us_);
+	const auto queuing_delay_us = static_cast<double>(peer_delay_us - base_delay_us);
+	const auto off_target = (target_delay_us - queuing_delay_us) / target_delay_us;
+	const auto cwnd_delta = off_target * static_cast<double>(acked_byte_cnt) * static_cast<double>(max_payload_size) / cwnd_;
+
+	cwnd_ = std::clamp(cwnd_ + cwnd_delta, static_cast<double>(max_payload_size), static_cast<double>(max_cwnd));
+}
+
+void Utp_socket::on_data_received(const Header & header, const QByteArray & payload) noexcept {
+
+	if(header.type == Packet_Type::Fin) {
+		fin_seq_nr_ = header.seq_nr;
+	}
+
+	if(!is_seq_less(ack_nr_, header.seq_nr)) { // duplicate, our ack got lost
+		return send(Packet_Type::State, seq_nr_);
+	}
+
+	// past our advertised window: dropped unacked, the peer resends it once the window opens
+	if(payload.size() > receive_window()) {
+		qDebug() << "uTP peer overran the receive window" << peer_url();
+		return send(Packet_Type::State, seq_nr_);
+	}
+
+	if(header.seq_nr != static_cast<std::uint16_t>(ack_nr_ + 1)) {
+
+		if(reordered_payloads_.size() < max_reordered_packet_cnt) {
+			reordered_payloads_.insert(header.seq_nr, payload);
+		}
+
+		return send(Packet_Type::State, seq_nr_);
+	}
+
+	const auto prev_receive_buffer_size = receive_buffer_.size();
+
+	ack_nr_ = header.seq_nr;
+	receive_buffer_ += payload;
+
+	for(auto payload_itr = reordered_payloads_.find(static_cast<std::uint16_t>(ack_nr_ + 1));
+	    payload_itr != reordered_payloads_.end() && payload_itr->size() <= receive_window(); payload_itr = reordered_payloads_.find(static_cast<std::uint16_t>(ack_nr_ + 1))) {
+		++ack_nr_;
+		receive_buffer_ += *payload_itr;
+		reordered_payloads_.erase(payload_itr);
+	}
+
+	send(Packet_Type::State, seq_nr_);
+
+	if(receive_buffer_.size() > prev_receive_buffer_size) {
+		emit readyRead();
+	}
+
+	if(fin_seq_nr_ && *fin_seq_nr_ == ack_nr_ && state() == SocketState::ConnectedState) {
+		close_connection();
+	}
+}
+
+void Utp_socket::on_retransmit_timeout() noexcept {
+
+	if(outgoing_packets_.isEmpty()) {
+		return;
+	}
+
+	auto oldest_packet_itr = outgoing_packets_.begin();
+
+	for(auto packet_itr = outgoing_packets_.begin(); packet_itr != outgoing_packets_.end(); ++packet_itr) {
+		if(is_seq_less(packet_itr.key(), oldest_packet_itr.key())) {
+			oldest_packet_itr = packet_itr;
+		}
+	}
+
+	const auto max_packet_transmission_cnt = oldest_packet_itr->type == Packet_Type::Syn ? max_syn_transmission_cnt : max_transmission_cnt;
+
+	if(oldest_packet_itr->transmission_cnt >= max_packet_transmission_cnt) {
+		return fail(SocketError::SocketTimeoutError, "uTP peer stopped responding");
+	}
+
+	constexpr std::chrono::seconds max_rto(60);
+	rto_ = std::min<std::chrono::milliseconds>(rto_ * 2, max_rto);
+	cwnd_ = max_payload_size;
+
+	transmit(oldest_packet_itr.key());
+	retransmit_timer_.start(rto_);
+}
+
+void Utp_socket::fail(const QAbstractSocket::SocketError socket_error, const QString & error_string) noexcept {
+	close_connection();
+	setSocketError(socket_error);
+	setErrorString(error_string);
+	emit errorOccurred(socket_error);
+}
+
+void Utp_socket::close_connection() noexcept {
+
+	if(state() == SocketState::UnconnectedState) {
+		return;
+	}
+
+	const auto was_connected = is_established();
+
+	retransmit_timer_.stop();
+	base_delay_timer_.stop();
+	outgoing_packets_.clear();
+	reordered_payloads_.clear();
+	send_buffer_.clear();
+	in_flight_byte_cnt_ = 0;
+
+	setSocketState(SocketState::UnconnectedState);
+
+	if(multiplexer_) {
+		multiplexer_->unregister_socket(this);
+	}
+
+	if(isOpen()) {
+		QIODevice::close();
+	}
+
+	if(was_connected) {
+		emit disconnected();
+	}
+}
\ No newline at end of file
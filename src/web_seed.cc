@@ -0,0 +1,153 @@
+#include "web_seed.h"
+
+#include <QNetworkRequest>
+#include <numeric>
+
+Web_seed::Web_seed(QUrl url, const bencode::Metadata & torrent_metadata, QNetworkAccessManager * const network_manager, QObject * const parent)
+    : QObject(parent),
+	url_(std::move(url)),
+	file_urls_(file_urls(url_, torrent_metadata)),
+	network_manager_(network_manager) {
+	assert(url_.isValid());
+	assert(network_manager_);
+	assert(!file_urls_.isEmpty());
+}
+
+QList<QUrl> Web_seed::file_urls(const QUrl & url, const bencode::Metadata & torrent_metadata) noexcept {
+
+	auto encode_path = [](const std::string & path) {
+		QByteArrayList encoded_segments;
+
+		for(const auto & segment : QByteArray(path.data(), static_cast<qsizetype>(path.size())).split('/')) {
+			encoded_segments.push_back(segment.toPercentEncoding());
+		}
+
+		return encoded_segments.join('/');
+	};
+
+	auto encoded_url = url.toEncoded();
+	const auto is_directory_url = encoded_url.endsWith('/');
+	const auto encoded_name = encode_path(torrent_metadata.name);
+
+	// BEP 19: a single file url is used as is unless it names a directory, multi file torrents live under <url>/<name>/
+	if(torrent_metadata.single_file) {
+		return {is_directory_url ? QUrl::fromEncoded(encoded_url + encoded_name) : url};
+	}
+
+	if(!is_directory_url) {
+		encoded_url += '/';
+	}
+
+	QList<QUrl> file_urls;
+	file_urls.reserve(static_cast<qsizetype>(torrent_metadata.file_info.size()));
+
+	for(const auto & [file_path, file_size] : torrent_metadata.file_info) {
+		file_urls.push_back(QUrl::fromEncoded(encoded_url + encoded_name + '/' + encode_path(file_path)));
+	}
+
+	return file_urls;
+}
+
+void Web_seed::fetch(const std::int32_t first_piece_idx, const std::int32_t piece_cnt, QList<File_range> file_ranges) noexcept {
+	assert(is_idle());
+	assert(first_piece_idx >= 0 && piece_cnt > 0);
+	assert(!file_ranges.isEmpty());
+
+	first_piece_idx_ = first_piece_idx;
+	piece_cnt_ = piece_cnt;
+	file_ranges_ = std::move(file_ranges);
+
+	pieces_.clear();
+	pieces_.reserve(std::accumulate(file_ranges_.cbegin(), file_ranges_.cend(), qsizetype{0}, [](const qsizetype byte_cnt, const File_range & file_range) {
+		return byte_cnt + static_cast<qsizetype>(file_range.byte_cnt);
+	}));
+
+	fetch_next_range();
+}
+
+void Web_seed::fetch_next_range() noexcept {
+
+	if(file_ranges_.isEmpty()) {
+		const auto first_piece_idx = first_piece_idx_;
+		const auto piece_cnt = std::exchange(piece_cnt_, 0);
+		failure_cnt_ = 0;
+		emit pieces_received(first_piece_idx, piece_cnt, std::exchange(pieces_, {}));
+		return;
+	}
+
+	if(!network_manager_) {
+		return fail_fetch();
+	}
+
+	const auto file_range = file_ranges_.takeFirst();
+	assert(file_range.file_idx >= 0 && file_range.file_idx < file_urls_.size());
+	assert(file_range.file_offset >= 0 && file_range.byte_cnt > 0);
+
+	QNetworkRequest request(file_urls_[file_range.file_idx]);
+	request.setRawHeader("Range", "bytes=" + QByteArray::number(file_range.file_offset) + '-' + QByteArray::number(file_range.file_offset + file_range.byte_cnt - 1));
+	request.setTransferTimeout(static_cast<std::int32_t>(std::chrono::milliseconds(transfer_timeout).count()));
+
+	auto * const network_reply = network_manager_->get(request);
+	fetch_reply_ = network_reply;
+
+	connect(network_reply, &QNetworkReply::finished, this, [this, network_reply, file_range] {
+		network_reply->deleteLater();
+		on_range_finished(network_reply, file_range);
+	});
+}
+
+void Web_seed::on_range_finished(QNetworkReply * const network_reply, const File_range & file_range) noexcept {
+
+	if(network_reply->error() == QNetworkReply::OperationCanceledError) { // stopped
+		return;
+	}
+
+	if(network_reply->error() != QNetworkReply::NoError) {
+		qDebug() << "web seed request failed" << network_reply->url() << network_reply->errorString();
+		return fail_fetch();
+	}
+
+	// a server that ignores the range sends the whole file with 200, which is of no use for a piece run
+	constexpr auto partial_content_status = 206;
+
+	if(network_reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() != partial_content_status) {
+		qDebug() << "web seed does not serve byte ranges" << network_reply->url();
+		return fail_fetch();
+	}
+
+	const auto range_data = network_reply->readAll();
+
+	if(range_data.size() != file_range.byte_cnt) {
+		qDebug() << "web seed sent a range of the wrong size" << network_reply->url() << range_data.size() << file_range.byte_cnt;
+		return fail_fetch();
+	}
+
+	pieces_ += range_data;
+	fetch_next_range();
+}
+
+void Web_seed::fail_fetch() noexcept {
+	const auto first_piece_idx = first_piece_idx_;
+	const auto piece_cnt = std::exchange(piece_cnt_, 0);
+
+	file_ranges_.clear();
+	pieces_.clear();
+	on_pieces_rejected();
+
+	emit fetch_failed(first_piece_idx, piece_cnt);
+}
+
+void Web_seed::on_pieces_rejected() noexcept {
+	++failure_cnt_;
+	retry_timer_.start();
+}
+
+void Web_seed::stop() noexcept {
+	piece_cnt_ = 0;
+	file_ranges_.clear();
+	pieces_.clear();
+
+	if(fetch_reply_) {
+		fetch_reply_->abort();
+	}
+}
\ No newline at end of file
@@ -0,0 +1,251 @@
+#include "dht_node.h"
+
+#include <QCoreApplication>
+#include <QStandardPaths>
+#include <QNetworkDatagram>
+#include <QSignalSpy>
+#include <QSettings>
+#include <QTest>
+#include <memory>
+#include <vector>
+
+namespace {
+
+constexpr std::uint16_t announced_listen_port = 51413;
+
+QByteArray bencoded_string(const QByteArray & str) noexcept {
+	return QByteArray::number(str.size()) + ':' + str;
+}
+
+std::optional<QByteArray> extract_string(const bencode::dictionary & dict, const std::string & key) noexcept {
+
+	if(const auto value_itr = dict.find(key); value_itr != dict.end()) {
+		if(const auto * const value = std::any_cast<std::string>(&value_itr->second)) {
+			return QByteArray(value->data(), static_cast<qsizetype>(value->size()));
+		}
+	}
+
+	return {};
+}
+
+std::optional<bencode::dictionary> extract_dictionary(const bencode::dictionary & dict, const std::string & key) noexcept {
+
+	if(const auto value_itr = dict.find(key); value_itr != dict.end()) {
+		if(const auto * const value = std::any_cast<bencode::dictionary>(&value_itr->second)) {
+			return *value;
+		}
+	}
+
+	return {};
+}
+
+QByteArray compact_endpoint(const std::uint16_t port) noexcept {
+	return QByteArray::fromHex("7f000001") + static_cast<char>(port >> 8) + static_cast<char>(port & 0xff);
+}
+
+// the compact peers in the "values" of a get_peers response
+QList<QByteArray> extract_values(const bencode::dictionary & response) noexcept {
+	QList<QByteArray> values;
+
+	if(const auto values_itr = response.find("values"); values_itr != response.end()) {
+		if(const auto * const value_list = std::any_cast<bencode::list>(&values_itr->second)) {
+			for(const auto & value : *value_list) {
+				if(const auto * const compact_peer = std::any_cast<std::string>(&value)) {
+					values.push_back(QByteArray(compact_peer->data(), static_cast<qsizetype>(compact_peer->size())));
+				}
+			}
+		}
+	}
+
+	return values;
+}
+
+// speaks krpc to a node directly, for the queries a Dht_node would never send on its own (e.g. with a forged token)
+class Krpc_client {
+public:
+	Krpc_client() {
+		udp_socket_.bind(QHostAddress::LocalHost, 0);
+	}
+
+	// the whole reply, nullopt if none came or it did not parse
+	std::optional<bencode::dictionary> query(const std::uint16_t node_port, const QByteArray & query_name, const QByteArray & arguments) noexcept {
+		const auto message = "d1:ad2:id" + bencoded_string(id_) + arguments + "e1:q" + bencoded_string(query_name) + "1:t2:aa1:y1:qe";
+
+		QSignalSpy ready_read_spy(&udp_socket_, &QUdpSocket::readyRead);
+		udp_socket_.writeDatagram(message, QHostAddress::LocalHost, node_port);
+
+		if(!udp_socket_.hasPendingDatagrams() && !ready_read_spy.wait(2000)) {
+			return {};
+		}
+
+		try {
+			return bencode::parse_content(udp_socket_.receiveDatagram().data());
+		} catch(const std::exception & exception) {
+			qDebug() << "invalid DHT reply" << exception.what();
+			return {};
+		}
+	}
+
+private:
+	QUdpSocket udp_socket_;
+	QByteArray id_ = QByteArray(20, 'k');
+};
+
+} // namespace
+
+class Dht_node_test : public QObject {
+	Q_OBJECT
+private slots:
+	void initTestCase() noexcept;
+	void init() noexcept;
+	void cleanup() noexcept;
+	void bootstraps() noexcept;
+	void finds_announced_peers() noexcept;
+	void validates_announce_tokens() noexcept;
+
+private:
+	// a node on an ephemeral port that bootstraps off the one listening on bootstrap_port
+	static std::unique_ptr<Dht_node> make_node(std::uint16_t bootstrap_port) noexcept;
+	bool start_network(qsizetype node_cnt) noexcept;
+	///
+	constexpr static auto info_sha1_hash = "c12fe1c06bba254a9dc9f519b335aa7c1367a88a";
+	std::vector<std::unique_ptr<Dht_node>> nodes_;
+};
+
+std::unique_ptr<Dht_node> Dht_node_test::make_node(const std::uint16_t bootstrap_port) noexcept {
+	QSettings settings;
+	settings.remove("dht/node_id"); // the nodes share the settings, each needs an id of its own
+	settings.setValue("dht/bootstrap_nodes", QStringList{"127.0.0.1:" + QString::number(bootstrap_port)});
+	return std::make_unique<Dht_node>();
+}
+
+bool Dht_node_test::start_network(const qsizetype node_cnt) noexcept {
+	assert(node_cnt > 1);
+
+	// the seed has nobody but itself to bootstrap off, it picks its port first so that it knows it
+	const auto seed_port = [] {
+		QUdpSocket udp_socket;
+		udp_socket.bind(QHostAddress::LocalHost, 0);
+		return udp_socket.localPort();
+	}();
+
+	{
+		QSettings settings;
+		settings.setValue("network/dht_port", seed_port);
+		nodes_.push_back(make_node(seed_port));
+		settings.setValue("network/dht_port", 0);
+	}
+
+	if(nodes_.front()->local_port() != seed_port) {
+		return false;
+	}
+
+	// one at a time, so that each newcomer hears about the ones before it from the seed
+	for(qsizetype node_idx = 1; node_idx < node_cnt; ++node_idx) {
+		const auto * const node = nodes_.emplace_back(make_node(seed_port)).get();
+
+		if(!QTest::qWaitFor([&seed_node = *nodes_.front(), node, node_idx] { return seed_node.node_count() == node_idx && node->node_count() == node_idx; })) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void Dht_node_test::initTestCase() noexcept {
+	QStandardPaths::setTestModeEnabled(true);
+	QCoreApplication::setOrganizationName("conat");
+	QCoreApplication::setApplicationName("torapp_dht_node_test");
+}
+
+void Dht_node_test::init() noexcept {
+	QSettings settings;
+	settings.clear();
+	settings.setValue("network/dht_port", 0);
+	settings.setValue("network/listen_port", announced_listen_port);
+}
+
+void Dht_node_test::cleanup() noexcept {
+	nodes_.clear();
+}
+
+void Dht_node_test::bootstraps() noexcept {
+	constexpr qsizetype node_cnt = 4;
+	QVERIFY(start_network(node_cnt));
+
+	// the lookups for their own ids introduce every node to every other one
+	for(const auto & node : nodes_) {
+		QTRY_COMPARE(node->node_count(), node_cnt - 1);
+	}
+}
+
+void Dht_node_test::finds_announced_peers() noexcept {
+	QVERIFY(start_network(4));
+
+	auto & announcing_node = *nodes_.back();
+	auto & searching_node = *nodes_[1];
+	announcing_node.add_torrent(info_sha1_hash);
+
+	// the get_peers lookup hands out tokens, the announce that follows stores the peer at the nodes that answered
+	Krpc_client krpc_client;
+	const auto get_peers_arguments = "9:info_hash" + bencoded_string(QByteArray::fromHex(info_sha1_hash));
+
+	QVERIFY(QTest::qWaitFor([&krpc_client, &get_peers_arguments, seed_port = nodes_.front()->local_port()] {
+		const auto reply = krpc_client.query(seed_port, "get_peers", get_peers_arguments);
+		const auto response = reply ? extract_dictionary(*reply, "r") : std::nullopt;
+		return response && extract_values(*response).contains(compact_endpoint(announced_listen_port));
+	}));
+
+	QSignalSpy peers_found_spy(&searching_node, &Dht_node::peers_found);
+	searching_node.add_torrent(info_sha1_hash);
+
+	QTRY_VERIFY(!peers_found_spy.isEmpty());
+	QCOMPARE(peers_found_spy.front().front().toByteArray(), QByteArray(info_sha1_hash));
+
+	const auto peer_urls = qvariant_cast<QList<QUrl>>(peers_found_spy.front().back());
+	QCOMPARE(peer_urls.size(), 1);
+	QCOMPARE(peer_urls.front().host(), QString("127.0.0.1"));
+	QCOMPARE(peer_urls.front().port(), static_cast<int>(announced_listen_port));
+}
+
+void Dht_node_test::validates_announce_tokens() noexcept {
+	QVERIFY(start_network(2));
+
+	Krpc_client krpc_client;
+	const auto node_port = nodes_.front()->local_port();
+	const auto info_hash_argument = "9:info_hash" + bencoded_string(QByteArray::fromHex(info_sha1_hash));
+	constexpr std::uint16_t announced_port = 6881;
+
+	const auto announce = [&](const QByteArray & token) {
+		return krpc_client.query(node_port, "announce_peer", info_hash_argument + "4:porti" + QByteArray::number(announced_port) + "e5:token" + bencoded_string(token));
+	};
+
+	const auto forged_reply = announce("forged");
+	QVERIFY(forged_reply);
+	QCOMPARE(extract_string(*forged_reply, "y").value_or(QByteArray{}), QByteArray("e"));
+
+	const auto get_peers_reply = krpc_client.query(node_port, "get_peers", info_hash_argument);
+	QVERIFY(get_peers_reply);
+
+	const auto get_peers_response = extract_dictionary(*get_peers_reply, "r");
+	QVERIFY(get_peers_response);
+	QVERIFY(extract_values(*get_peers_response).isEmpty());
+
+	const auto token = extract_string(*get_peers_response, "token");
+	QVERIFY(token && !token->isEmpty());
+
+	const auto announce_reply = announce(*token);
+	QVERIFY(announce_reply);
+	QCOMPARE(extract_string(*announce_reply, "y").value_or(QByteArray{}), QByteArray("r"));
+
+	const auto stored_peers_reply = krpc_client.query(node_port, "get_peers", info_hash_argument);
+	QVERIFY(stored_peers_reply);
+
+	const auto stored_peers_response = extract_dictionary(*stored_peers_reply, "r");
+	QVERIFY(stored_peers_response);
+	QCOMPARE(extract_values(*stored_peers_response), QList<QByteArray>{compact_endpoint(announced_port)});
+}
+
+QTEST_GUILESS_MAIN(Dht_node_test)
+
+#include "dht_node_test.moc"
\ No newline at end of file
@@ -0,0 +1,100 @@
+#include "local_discovery.h"
+
+#include <QCoreApplication>
+#include <QStandardPaths>
+#include <QSignalSpy>
+#include <QSettings>
+#include <QTest>
+#include <memory>
+
+namespace {
+
+constexpr std::uint16_t announced_listen_port = 51413;
+constexpr auto magnet_hash = "C12FE1C06BBA254A9DC9F519B335AA7C1367A88A"; // as the xt of a magnet link may carry it
+const QHostAddress ipv4_group("239.192.152.143");
+constexpr std::uint16_t multicast_port = 6771;
+
+} // namespace
+
+class Local_discovery_test : public QObject {
+	Q_OBJECT
+private slots:
+	void initTestCase() noexcept;
+	void init() noexcept;
+	void finds_other_instance() noexcept;
+	void normalizes_announced_hash() noexcept;
+
+private:
+	// null when the machine has no route for the multicast group
+	static std::unique_ptr<Local_discovery> make_instance() noexcept;
+};
+
+std::unique_ptr<Local_discovery> Local_discovery_test::make_instance() noexcept {
+	auto local_discovery = std::make_unique<Local_discovery>();
+	return Local_discovery::instance() == local_discovery.get() ? std::move(local_discovery) : nullptr;
+}
+
+void Local_discovery_test::initTestCase() noexcept {
+	QStandardPaths::setTestModeEnabled(true);
+	QCoreApplication::setOrganizationName("conat");
+	QCoreApplication::setApplicationName("torapp_local_discovery_test");
+}
+
+void Local_discovery_test::init() noexcept {
+	QSettings settings;
+	settings.clear();
+	settings.setValue("network/enable_ipv6", false);
+	settings.setValue("network/listen_port", announced_listen_port);
+}
+
+void Local_discovery_test::finds_other_instance() noexcept {
+	const auto searching_instance = make_instance();
+	const auto announcing_instance = make_instance();
+
+	if(!searching_instance || !announcing_instance) {
+		QSKIP("could not join the LSD multicast group");
+	}
+
+	QSignalSpy peers_found_spy(searching_instance.get(), &Local_discovery::peers_found);
+
+	// each side registers the magnet hash in a different case
+	searching_instance->add_torrent(QByteArray(magnet_hash).toLower());
+	announcing_instance->add_torrent(magnet_hash);
+
+	QTRY_VERIFY(!peers_found_spy.isEmpty());
+	QCOMPARE(peers_found_spy.front().front().toByteArray(), QByteArray(magnet_hash).toLower());
+
+	const auto peer_urls = qvariant_cast<QList<QUrl>>(peers_found_spy.front().back());
+	QCOMPARE(peer_urls.size(), 1);
+	QCOMPARE(peer_urls.front().port(), static_cast<int>(announced_listen_port));
+}
+
+void Local_discovery_test::normalizes_announced_hash() noexcept {
+	const auto local_discovery = make_instance();
+
+	if(!local_discovery) {
+		QSKIP("could not join the LSD multicast group");
+	}
+
+	local_discovery->add_torrent(magnet_hash);
+	QSignalSpy peers_found_spy(local_discovery.get(), &Local_discovery::peers_found);
+
+	// another client, announcing the uppercase hash with bare '\n' line endings
+	constexpr std::uint16_t peer_port = 6881;
+	const auto announce = "BT-SEARCH * HTTP/1.1\nHost: 239.192.152.143:6771\nPort: " + QByteArray::number(peer_port) + "\nInfohash: " + magnet_hash +
+				    "\ncookie: other\n\n\n";
+
+	QUdpSocket udp_socket;
+	QCOMPARE(udp_socket.writeDatagram(announce, ipv4_group, multicast_port), announce.size());
+
+	QTRY_VERIFY(!peers_found_spy.isEmpty());
+	QCOMPARE(peers_found_spy.front().front().toByteArray(), QByteArray(magnet_hash).toLower());
+
+	const auto peer_urls = qvariant_cast<QList<QUrl>>(peers_found_spy.front().back());
+	QCOMPARE(peer_urls.size(), 1);
+	QCOMPARE(peer_urls.front().port(), static_cast<int>(peer_port));
+}
+
+QTEST_GUILESS_MAIN(Local_discovery_test)
+
+#include "local_discovery_test.moc"
\ No newline at end of file
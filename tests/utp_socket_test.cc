@@ -0,0 +1,239 @@
+#include "utp_multiplexer.h"
+#include "utp_socket.h"
+
+#include <QNetworkDatagram>
+#include <QRandomGenerator>
+#include <QSignalSpy>
+#include <QUdpSocket>
+#include <QPointer>
+#include <QTimer>
+#include <QTest>
+#include <optional>
+#include <utility>
+
+namespace {
+
+// sits between the dialing and the listening multiplexer and relays their datagrams, dropping or reordering some on the way
+class Udp_relay {
+public:
+	explicit Udp_relay(const std::uint16_t listener_port) : listener_port_(listener_port) {
+		udp_socket_.bind(QHostAddress::LocalHost, 0);
+
+		QObject::connect(&udp_socket_, &QUdpSocket::readyRead, &udp_socket_, [this] {
+			while(udp_socket_.hasPendingDatagrams()) {
+				relay(udp_socket_.receiveDatagram());
+			}
+		});
+
+		held_timer_.setSingleShot(true);
+
+		// nothing came along to swap with
+		held_timer_.callOnTimeout(&udp_socket_, [this] {
+			if(held_datagram_) {
+				forward(*std::exchange(held_datagram_, std::nullopt));
+			}
+		});
+	}
+
+	std::uint16_t port() const noexcept {
+		return udp_socket_.localPort();
+	}
+
+	qsizetype dropped_count() const noexcept {
+		return dropped_cnt_;
+	}
+
+	qsizetype drop_interval = 0; // every nth datagram is lost, none for 0
+	bool reorders = false;	     // each pair of datagrams is swapped
+
+private:
+	void relay(const QNetworkDatagram & datagram) noexcept {
+
+		if(datagram.senderPort() != listener_port_) {
+			dialer_port_ = static_cast<std::uint16_t>(datagram.senderPort());
+		}
+
+		// the handshake is left alone, a lost SYN only costs a retransmit timeout
+		if(++relayed_cnt_ > handshake_datagram_cnt && drop_interval && relayed_cnt_ % drop_interval == 0) {
+			++dropped_cnt_;
+			return;
+		}
+
+		if(!reorders || relayed_cnt_ <= handshake_datagram_cnt) {
+			return forward(datagram);
+		}
+
+		if(!held_datagram_) {
+			held_datagram_ = datagram;
+			held_timer_.start(std::chrono::milliseconds(20));
+			return;
+		}
+
+		held_timer_.stop();
+		forward(datagram);
+		forward(*std::exchange(held_datagram_, std::nullopt));
+	}
+
+	void forward(const QNetworkDatagram & datagram) noexcept {
+		const auto destination_port = datagram.senderPort() == listener_port_ ? dialer_port_ : listener_port_;
+		udp_socket_.writeDatagram(datagram.data(), QHostAddress::LocalHost, destination_port);
+	}
+	///
+	constexpr static qsizetype handshake_datagram_cnt = 2;
+	QUdpSocket udp_socket_;
+	QTimer held_timer_;
+	std::optional<QNetworkDatagram> held_datagram_;
+	qsizetype relayed_cnt_ = 0;
+	qsizetype dropped_cnt_ = 0;
+	std::uint16_t listener_port_ = 0;
+	std::uint16_t dialer_port_ = 0;
+};
+
+// two multiplexers on the loopback interface, the dialing one reaching the listening one through a relay
+struct Loopback_peers {
+	Loopback_peers() : relay(listener.local_port()) {
+		QObject::connect(&listener, &Utp_multiplexer::incoming_connection, &listener, [this](Utp_socket * const socket) {
+			incoming_socket = socket;
+		});
+
+		QUrl peer_url;
+		peer_url.setHost(QHostAddress(QHostAddress::LocalHost).toString());
+		peer_url.setPort(relay.port());
+		outgoing_socket = new Utp_socket(std::move(peer_url), &dialer, nullptr);
+	}
+
+	~Loopback_peers() {
+		delete outgoing_socket;
+		delete incoming_socket;
+	}
+
+	Utp_multiplexer listener{0};
+	Utp_multiplexer dialer{0};
+	Udp_relay relay;
+	QPointer<Utp_socket> outgoing_socket;
+	QPointer<Utp_socket> incoming_socket;
+};
+
+QByteArray random_bytes(const qsizetype byte_cnt) noexcept {
+	QByteArray bytes(byte_cnt, Qt::Uninitialized);
+
+	for(auto & byte : bytes) {
+		byte = static_cast<char>(QRandomGenerator::global()->bounded(256));
+	}
+
+	return bytes;
+}
+
+} // namespace
+
+class Utp_socket_test : public QObject {
+	Q_OBJECT
+private slots:
+	void connects() noexcept;
+	void transfers() noexcept;
+	void recovers_lost_packets() noexcept;
+	void reassembles_reordered_packets() noexcept;
+	void holds_to_receive_window() noexcept;
+	void delivers_written_data_before_closing() noexcept;
+
+private:
+	static void verify_transfer(Loopback_peers & peers, qsizetype byte_cnt) noexcept;
+	///
+	constexpr static int transfer_timeout_ms = 30'000;
+};
+
+void Utp_socket_test::verify_transfer(Loopback_peers & peers, const qsizetype byte_cnt) noexcept {
+	QTRY_VERIFY(peers.incoming_socket && peers.outgoing_socket->state() == QAbstractSocket::ConnectedState);
+
+	QByteArray received;
+
+	QObject::connect(peers.incoming_socket, &Utp_socket::readyRead, peers.incoming_socket, [&received, socket = peers.incoming_socket] {
+		received += socket->readAll();
+	});
+
+	const auto sent = random_bytes(byte_cnt);
+	QCOMPARE(peers.outgoing_socket->write(sent), byte_cnt);
+
+	QTRY_COMPARE_WITH_TIMEOUT(received.size(), byte_cnt, transfer_timeout_ms);
+	QVERIFY(received == sent);
+}
+
+void Utp_socket_test::connects() noexcept {
+	Loopback_peers peers;
+	QVERIFY(peers.listener.is_bound() && peers.dialer.is_bound());
+
+	QSignalSpy connected_spy(peers.outgoing_socket.data(), &Utp_socket::connected);
+	QTRY_COMPARE(connected_spy.count(), 1);
+	QTRY_VERIFY(peers.incoming_socket);
+	QCOMPARE(peers.incoming_socket->state(), QAbstractSocket::ConnectedState);
+	QVERIFY(!peers.incoming_socket->is_outgoing());
+}
+
+void Utp_socket_test::transfers() noexcept {
+	Loopback_peers peers;
+	verify_transfer(peers, 256 * 1024);
+}
+
+void Utp_socket_test::recovers_lost_packets() noexcept {
+	Loopback_peers peers;
+	peers.relay.drop_interval = 10;
+	verify_transfer(peers, 256 * 1024);
+	QVERIFY(peers.relay.dropped_count());
+}
+
+void Utp_socket_test::reassembles_reordered_packets() noexcept {
+	Loopback_peers peers;
+	peers.relay.reorders = true;
+	verify_transfer(peers, 256 * 1024);
+}
+
+void Utp_socket_test::holds_to_receive_window() noexcept {
+	Loopback_peers peers;
+	QTRY_VERIFY(peers.incoming_socket && peers.outgoing_socket->state() == QAbstractSocket::ConnectedState);
+
+	// nobody reads, so the window closes at 1 MiB however much is written
+	constexpr qsizetype max_receive_buffer_size = 1 << 20;
+	const auto sent = random_bytes(2 * max_receive_buffer_size);
+	QCOMPARE(peers.outgoing_socket->write(sent), sent.size());
+
+	QTRY_VERIFY(peers.incoming_socket->bytesAvailable() > max_receive_buffer_size - 1400);
+	QTest::qWait(500);
+	QVERIFY(peers.incoming_socket->bytesAvailable() <= max_receive_buffer_size);
+
+	// reading reopens the window and the rest follows
+	auto received = peers.incoming_socket->readAll();
+
+	QObject::connect(peers.incoming_socket, &Utp_socket::readyRead, peers.incoming_socket, [&received, socket = peers.incoming_socket] {
+		received += socket->readAll();
+	});
+
+	QTRY_COMPARE_WITH_TIMEOUT(received.size(), sent.size(), transfer_timeout_ms);
+	QVERIFY(received == sent);
+}
+
+void Utp_socket_test::delivers_written_data_before_closing() noexcept {
+	Loopback_peers peers;
+	peers.relay.drop_interval = 7;
+	QTRY_VERIFY(peers.incoming_socket && peers.outgoing_socket->state() == QAbstractSocket::ConnectedState);
+
+	QByteArray received;
+	QSignalSpy disconnected_spy(peers.incoming_socket.data(), &Utp_socket::disconnected);
+
+	QObject::connect(peers.incoming_socket, &Utp_socket::readyRead, peers.incoming_socket, [&received, socket = peers.incoming_socket] {
+		received += socket->readAll();
+	});
+
+	// closed right after the write, nothing is acked yet
+	const auto sent = random_bytes(64 * 1024);
+	QCOMPARE(peers.outgoing_socket->write(sent), sent.size());
+	peers.outgoing_socket->disconnectFromHost();
+	QCOMPARE(peers.outgoing_socket->state(), QAbstractSocket::ClosingState);
+
+	QTRY_COMPARE_WITH_TIMEOUT(disconnected_spy.count(), 1, transfer_timeout_ms);
+	QVERIFY(received == sent);
+	QTRY_VERIFY_WITH_TIMEOUT(!peers.outgoing_socket || peers.outgoing_socket->state() == QAbstractSocket::UnconnectedState, transfer_timeout_ms);
+}
+
+QTEST_GUILESS_MAIN(Utp_socket_test)
+
+#include "utp_socket_test.moc"
\ No newline at end of file